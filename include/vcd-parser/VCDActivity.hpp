@@ -0,0 +1,394 @@
+#pragma once
+
+#include <vcd-parser/VCDPackedVector.hpp>
+#include <vcd-parser/VCDTypes.hpp>
+#include <vcd-parser/VCDVisitor.hpp>
+
+#include <algorithm>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/*!
+@file VCDActivity.hpp
+@brief Toggle counts and time spent at 1, x and z, collected while parsing.
+*/
+
+//! Number of set bits of a word.
+inline unsigned vcd_popcount(uint64_t word) {
+#if defined(__GNUC__) || defined(__clang__)
+  return static_cast<unsigned>(__builtin_popcountll(word));
+#else
+  return static_cast<unsigned>(std::bitset<64>(word).count());
+#endif
+}
+
+/*!
+@brief Switching activity of a signal or of a group of signals.
+@details Times are bit-times, the time each bit spent in a state summed
+over the bits, so the ratios stay meaningful when signals of different
+widths are added up. Reals only count changes.
+*/
+struct VCDActivity {
+  uint64_t changes = 0;  //!< Value changes, including those to the same value
+  uint64_t toggles = 0;  //!< 0 to 1 and 1 to 0 transitions, summed over the bits
+  uint64_t time_1 = 0;   //!< Bit-time at 1
+  uint64_t time_xz = 0;  //!< Bit-time at x or z
+  uint64_t observed = 0; //!< Bit-time since the first value
+  std::size_t width = 0; //!< Bits, 0 for reals
+
+  //! Toggles of each bit, bit 0 first, only if VCDActivityCounter::per_bit is set.
+  std::vector<uint64_t> bit_toggles;
+
+  //! Fraction of the observed time at 1.
+  [[nodiscard]] double duty_cycle() const {
+    return observed == 0 ? 0.0 : static_cast<double>(time_1) / static_cast<double>(observed);
+  }
+
+  //! Fraction of the observed time at x or z.
+  [[nodiscard]] double xz_fraction() const {
+    return observed == 0 ? 0.0 : static_cast<double>(time_xz) / static_cast<double>(observed);
+  }
+
+  //! Add the activity of another signal, bit_toggles are not added.
+  VCDActivity& operator+=(const VCDActivity& other) {
+    changes += other.changes;
+    toggles += other.toggles;
+    time_1 += other.time_1;
+    time_xz += other.time_xz;
+    observed += other.observed;
+    width += other.width;
+    return *this;
+  }
+};
+
+/*!
+@brief Collects the switching activity of every signal in a single pass over a parse.
+@details Passed to VCDFileParser::parse_file() as the visitor, the
+counter updates its totals on every value change and forwards the parse
+to target, if set, e.g. a VCDFileBuilder. Without a target, it needs
+memory for the state of each signal only, whatever the length of the
+file, and with the parser's selection only selected signals are
+counted. A vector change is packed into words of a value and an unknown
+plane by VCDPackedVector::pack_ascii(), and compared with the previous
+state a word at a time by XOR and popcount. Vectors shorter than the
+declared size are extended as in VCDTimeline. A signal is observed from
+its first value to the last timestamp of the file. Results are complete
+after the parse finished.
+*/
+class VCDActivityCounter : public VCDVisitor {
+
+public:
+  //! Count, optionally forwarding the parse to a target visitor.
+  explicit VCDActivityCounter(VCDVisitor* target = nullptr) : target(target) {}
+
+  //! Count the toggles of each bit of a vector, see VCDActivity::bit_toggles.
+  bool per_bit = false;
+
+  //! Activity of a signal by dense index, empty for an index without changes.
+  [[nodiscard]] const VCDActivity& get_activity(VCDSignalIndex index) const {
+    static const VCDActivity none;
+    return index < activity.size() ? activity[index] : none;
+  }
+
+  //! Number of signal indices seen.
+  [[nodiscard]] std::size_t size() const {
+    return activity.size();
+  }
+
+  /*!
+  @brief Sum of the activity of the signals in a scope and its subscopes.
+  @param scope in - The scope path, e.g. "testbench.uut", as in
+  VCDPathIndex, empty for all declared signals.
+  @details Aliases of a signal count once.
+  */
+  [[nodiscard]] VCDActivity subtree(std::string_view scope) const {
+    VCDActivity total;
+    std::vector<bool> counted(activity.size(), false);
+    for (const auto& [path, index] : declared) {
+      const std::string_view name = path;
+      const bool inside = scope.empty() || (name.size() > scope.size() && name.compare(0, scope.size(), scope) == 0 &&
+                                            name[scope.size()] == '.');
+      if (inside && index < activity.size() && !counted[index]) {
+        counted[index] = true;
+        total += activity[index];
+      }
+    }
+    return total;
+  }
+
+  //! Sum of the activity of every scope subtree, by scope path, see subtree().
+  [[nodiscard]] std::map<std::string, VCDActivity> per_scope() const {
+    // Each index adds to the union of the scopes enclosing its aliases.
+    std::vector<std::size_t> order(declared.size());
+    for (std::size_t i = 0; i < order.size(); ++i) {
+      order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [this](std::size_t a, std::size_t b) { return declared[a].second < declared[b].second; });
+
+    std::map<std::string, VCDActivity> result;
+    std::vector<std::string_view> scopes;
+    for (std::size_t i = 0; i < order.size();) {
+      const VCDSignalIndex index = declared[order[i]].second;
+      scopes.clear();
+      for (; i < order.size() && declared[order[i]].second == index; ++i) {
+        const std::string_view path = declared[order[i]].first;
+        for (std::size_t dot = path.find('.'); dot != std::string_view::npos; dot = path.find('.', dot + 1)) {
+          scopes.push_back(path.substr(0, dot));
+        }
+      }
+      std::sort(scopes.begin(), scopes.end());
+      scopes.erase(std::unique(scopes.begin(), scopes.end()), scopes.end());
+      for (std::string_view scope : scopes) {
+        if (index < activity.size()) {
+          result[std::string(scope)] += activity[index];
+        }
+      }
+    }
+    return result;
+  }
+
+  //! Last timestamp of the parse.
+  [[nodiscard]] VCDTime end_time() const {
+    return now;
+  }
+
+  void on_date(std::string_view text) override { forward(&VCDVisitor::on_date, text); }
+  void on_version(std::string_view text) override { forward(&VCDVisitor::on_version, text); }
+  void on_comment(std::string_view text) override { forward(&VCDVisitor::on_comment, text); }
+
+  void on_timescale(VCDTimeRes resolution, VCDTimeUnit units) override {
+    forward(&VCDVisitor::on_timescale, resolution, units);
+  }
+
+  void on_scope(const VCDScope& scope) override {
+    scopes.push_back(scope.name);
+    forward(&VCDVisitor::on_scope, scope);
+  }
+
+  void on_upscope() override {
+    if (!scopes.empty()) {
+      scopes.pop_back();
+    }
+    forward(&VCDVisitor::on_upscope);
+  }
+
+  void on_var(const VCDSignal& signal) override {
+    std::string path;
+    for (const std::string& scope : scopes) {
+      path += scope;
+      path += '.';
+    }
+    path += signal.reference;
+    declared.emplace_back(std::move(path), signal.index);
+
+    const bool real = signal.type == VCDVarType::VCD_VAR_REAL || signal.type == VCDVarType::VCD_VAR_REALTIME;
+    declare(signal.index, real ? 0 : static_cast<std::size_t>(std::max(signal.size, VCDSignalSize(1))));
+    forward(&VCDVisitor::on_var, signal);
+  }
+
+  void on_undeclared(VCDSignalIndex index, std::string_view hash) override {
+    forward(&VCDVisitor::on_undeclared, index, hash);
+  }
+
+  void on_header_done() override { forward(&VCDVisitor::on_header_done); }
+
+  void on_timestamp(VCDTime time) override {
+    now = time;
+    forward(&VCDVisitor::on_timestamp, time);
+  }
+
+  void on_scalar_change(VCDTime time, VCDSignalIndex index, VCDBit value) override {
+    if (index >= states.size() || !states[index].declared) {
+      declare(index, 1);
+    }
+    const State& state = states[index];
+    if (state.width > 0) {
+      std::fill_n(scratch.begin(), 2 * state.words, 0);
+      scratch[0] = static_cast<uint64_t>(value) & 1;
+      scratch[state.words] = static_cast<uint64_t>(value) >> 1;
+    }
+    change(time, index);
+    forward(&VCDVisitor::on_scalar_change, time, index, value);
+  }
+
+  void on_vector_change(VCDTime time, VCDSignalIndex index, std::string_view digits) override {
+    if (index >= states.size() || !states[index].declared) {
+      declare(index, std::max<std::size_t>(digits.size(), 1));
+    }
+    const State& state = states[index];
+    if (state.width > 0) {
+      pack(digits, state);
+    }
+    change(time, index);
+    forward(&VCDVisitor::on_vector_change, time, index, digits);
+  }
+
+  void on_real_change(VCDTime time, VCDSignalIndex index, VCDReal value) override {
+    if (index >= states.size() || !states[index].declared) {
+      declare(index, 0);
+    }
+    activity[index].changes++;
+    forward(&VCDVisitor::on_real_change, time, index, value);
+  }
+
+  void on_finish() override {
+    for (VCDSignalIndex index = 0; index < states.size(); ++index) {
+      if (states[index].valid && now > states[index].since) {
+        accumulate(index, now);
+      }
+    }
+    forward(&VCDVisitor::on_finish);
+  }
+
+protected:
+  //! Counting state of a signal.
+  struct State {
+    std::size_t offset = 0;  //!< Position of the value and unknown planes in planes
+    std::size_t words = 0;   //!< Words per plane
+    std::size_t width = 0;   //!< Bits, 0 for reals
+    VCDTime since = 0;       //!< Time of the last change
+    bool valid = false;      //!< Has the signal a value?
+    bool declared = false;   //!< Was the signal declared or has it changed?
+  };
+
+  //! Call a visitor method on the target, if there is one.
+  template <typename Method, typename... Args>
+  void forward(Method method, Args&&... args) {
+    if (target != nullptr) {
+      (target->*method)(std::forward<Args>(args)...);
+    }
+  }
+
+  //! Set the width of a signal the first time it is declared or changes.
+  void declare(VCDSignalIndex index, std::size_t width) {
+    if (index >= states.size()) {
+      states.resize(index + 1);
+      activity.resize(index + 1);
+    }
+    State& state = states[index];
+    if (state.declared) {
+      return;
+    }
+    state.declared = true;
+    state.width = width;
+    state.words = (width + 63) / 64;
+    state.offset = planes.size();
+    planes.resize(planes.size() + 2 * state.words, 0);
+    scratch.resize(std::max(scratch.size(), 2 * state.words), 0);
+    activity[index].width = width;
+    if (per_bit && width > 1) {
+      activity[index].bit_toggles.assign(width, 0);
+    }
+  }
+
+  //! Pack digits into the planes in scratch, extended or cut to the width of the signal.
+  void pack(std::string_view digits, const State& state) {
+    uint64_t* value = scratch.data();
+    uint64_t* unknown = scratch.data() + state.words;
+    std::fill_n(scratch.begin(), 2 * state.words, 0);
+    if (digits.size() >= state.width) {
+      VCDPackedVector::pack_ascii(digits.data() + digits.size() - state.width, state.width, value, unknown);
+      return;
+    }
+
+    VCDPackedVector::pack_ascii(digits.data(), digits.size(), value, unknown);
+    const char first = digits.empty() ? '0' : digits.front();
+    const bool x = first == 'x' || first == 'X';
+    const bool z = first == 'z' || first == 'Z';
+    if (!x && !z) {
+      return;
+    }
+    for (std::size_t w = digits.size() / 64; w < state.words; ++w) {
+      const std::size_t lo = std::max(digits.size(), 64 * w) - 64 * w;
+      const uint64_t mask = ~uint64_t(0) << lo;
+      unknown[w] |= mask;
+      if (z) {
+        value[w] |= mask;
+      }
+    }
+    if (state.width % 64 != 0) {
+      value[state.words - 1] &= (uint64_t(1) << (state.width % 64)) - 1;
+      unknown[state.words - 1] &= (uint64_t(1) << (state.width % 64)) - 1;
+    }
+  }
+
+  //! Add the time in the current state up to time.
+  void accumulate(VCDSignalIndex index, VCDTime time) {
+    State& state = states[index];
+    VCDActivity& counted = activity[index];
+    const auto elapsed = static_cast<uint64_t>(time - state.since);
+    const uint64_t* value = planes.data() + state.offset;
+    const uint64_t* unknown = value + state.words;
+    uint64_t ones = 0;
+    uint64_t xz = 0;
+    for (std::size_t w = 0; w < state.words; ++w) {
+      ones += vcd_popcount(value[w] & ~unknown[w]);
+      xz += vcd_popcount(unknown[w]);
+    }
+    counted.time_1 += ones * elapsed;
+    counted.time_xz += xz * elapsed;
+    counted.observed += state.width * elapsed;
+    state.since = time;
+  }
+
+  //! Count a change of a signal to the planes in scratch.
+  void change(VCDTime time, VCDSignalIndex index) {
+    State& state = states[index];
+    VCDActivity& counted = activity[index];
+    counted.changes++;
+    if (state.width == 0) {
+      return;
+    }
+
+    uint64_t* value = planes.data() + state.offset;
+    uint64_t* unknown = value + state.words;
+    const uint64_t* new_value = scratch.data();
+    const uint64_t* new_unknown = scratch.data() + state.words;
+    if (state.valid) {
+      accumulate(index, time);
+      for (std::size_t w = 0; w < state.words; ++w) {
+        uint64_t toggled = (value[w] ^ new_value[w]) & ~unknown[w] & ~new_unknown[w];
+        counted.toggles += vcd_popcount(toggled);
+        if (!counted.bit_toggles.empty()) {
+          for (; toggled != 0; toggled &= toggled - 1) {
+            counted.bit_toggles[64 * w + vcd_popcount((toggled & (~toggled + 1)) - 1)]++;
+          }
+        }
+      }
+    }
+    std::copy_n(new_value, 2 * state.words, value);
+    state.since = time;
+    state.valid = true;
+  }
+
+  //! Visitor the parse is forwarded to, if any.
+  VCDVisitor* target;
+
+  //! Activity by signal index.
+  std::vector<VCDActivity> activity;
+
+  //! Counting state by signal index.
+  std::vector<State> states;
+
+  //! Value and unknown planes of the state of every signal.
+  std::vector<uint64_t> planes;
+
+  //! Planes of the change being counted.
+  std::vector<uint64_t> scratch;
+
+  //! Path and index of every declared signal.
+  std::vector<std::pair<std::string, VCDSignalIndex>> declared;
+
+  //! Names of the open scopes.
+  std::vector<std::string> scopes;
+
+  //! Time of the last timestamp.
+  VCDTime now = 0;
+};
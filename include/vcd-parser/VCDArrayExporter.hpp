@@ -0,0 +1,507 @@
+#pragma once
+
+#include <vcd-parser/VCDFile.hpp>
+#include <vcd-parser/VCDFileParser.hpp>
+#include <vcd-parser/VCDSignalSelection.hpp>
+#include <vcd-parser/VCDTimeline.hpp>
+#include <vcd-parser/VCDTypes.hpp>
+#include <vcd-parser/VCDValue.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+/*!
+@file VCDArrayExporter.hpp
+@brief Export of signal values as dense arrays for NumPy.
+*/
+
+//! Times at which VCDArrayExporter samples the values of signals.
+enum class VCDExportGrid {
+  CHANGES,     //!< The changes of each signal, with times of its own
+  TIMESTAMPS,  //!< The distinct timestamps of the file, shared by all signals
+  UNIFORM      //!< grid_start, grid_start + grid_step, ... up to grid_end, shared by all signals
+};
+
+/*!
+@brief Writes the values of selected signals as dense arrays.
+@details Each signal declared with an id code is exported once, named
+after its first declaration, e.g. "testbench.uut.pc[31:0]". Values are
+stored by the declared type of the signal:
+- real and realtime: float64, NaN before the first value
+- size 1: uint8 VCDBit codes, 0, 1, 2 for x and 3 for z, x before the first value
+- otherwise: uint64 words of the value plane, least significant word
+  first, of shape (n, words) if the signal is wider than 64 bits, and a
+  second array of the same shape with the unknown plane, which marks x
+  and z bits as in VCDPackedVector. All bits are x before the first value.
+
+Times are int64. With VCDExportGrid::CHANGES every signal has its own
+times, otherwise all signals share the times of the grid and hold the
+value in effect at each of them. Arrays are converted from the timeline
+columns in blocks, without a VCDValue per element, and signals are
+exported in parallel on threads threads. Arrays are native endian.
+*/
+class VCDArrayExporter {
+
+public:
+  //! Signals exported, all if empty.
+  VCDSignalSelection selection;
+
+  //! Times the values are sampled at.
+  VCDExportGrid grid = VCDExportGrid::CHANGES;
+
+  //! First time of a UNIFORM grid.
+  VCDTime grid_start = 0;
+
+  //! Distance of the times of a UNIFORM grid, must be positive.
+  VCDTime grid_step = 1;
+
+  //! Last time of a UNIFORM grid, the last timestamp of the file if unset.
+  VCDTime grid_end = std::numeric_limits<VCDTime>::max();
+
+  //! Number of threads exporting signals, 0 for one per core.
+  unsigned threads = 0;
+
+  //! An exported array.
+  struct Array {
+    std::string name;         //!< Name, e.g. "testbench.clk.values"
+    std::string descr;        //!< NumPy type, e.g. "<u8"
+    std::size_t rows = 0;     //!< Number of elements
+    std::size_t columns = 1;  //!< Words per element of a vector, 1 for other arrays
+    std::size_t offset = 0;   //!< Offset of the data in the file written by write_columns()
+  };
+
+  /*!
+  @brief Write one .npy file per array into a directory.
+  @details The arrays of a signal are "<name>.times.npy", unless the
+  grid is shared, then there is one "times.npy", "<name>.values.npy"
+  and, for vectors, "<name>.unknown.npy", where characters not allowed
+  in file names on Windows are replaced by '_'. The directory is created
+  if needed.
+  @returns false if the grid is invalid or a file cannot be written.
+  */
+  bool write_npy(const VCDFile& file, const std::string& directory) {
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (!plan(file) || error) {
+      return false;
+    }
+
+    const std::filesystem::path base(directory);
+    std::atomic<bool> failed{false};
+    if (grid != VCDExportGrid::CHANGES) {
+      std::ofstream out(base / "times.npy", std::ios::binary);
+      write_npy_header(out, times_array(grid_times.size()));
+      write_block(out, grid_times.data(), grid_times.size());
+      failed = !out;
+    }
+
+    run(file, [&](const Signal& signal, const VCDTimeline& timeline) {
+      bool ok = true;
+      for (std::size_t a = signal.first_array; a < signal.first_array + signal.array_count; ++a) {
+        std::ofstream out(base / file_name(arrays[a].name), std::ios::binary);
+        write_npy_header(out, arrays[a]);
+        write_array(out, signal, timeline, a - signal.first_array);
+        ok = ok && out.good();
+      }
+      if (!ok) {
+        failed = true;
+      }
+    });
+    return !failed;
+  }
+
+  /*!
+  @brief Write all arrays into one file, each 64 byte aligned.
+  @details The file starts with the 8 bytes "VCDARRAY", the size of
+  the header as a little endian uint64, and the header, one line per
+  array with its name, NumPy type, rows, columns and offset, separated
+  by tabs. A shared grid is the array "times". An array can be mapped
+  with numpy.memmap(path, dtype, 'r', offset, (rows, columns)).
+  @returns false if the grid is invalid or the file cannot be written.
+  */
+  bool write_columns(const VCDFile& file, const std::string& path) {
+    if (!plan(file)) {
+      return false;
+    }
+
+    std::vector<Array> listed;
+    if (grid != VCDExportGrid::CHANGES) {
+      listed.push_back(times_array(grid_times.size()));
+    }
+    listed.insert(listed.end(), arrays.begin(), arrays.end());
+
+    // Offsets depend on the size of the header, which grows with them until it is stable.
+    std::string header;
+    do {
+      header_size = header.size();
+      header.clear();
+      std::size_t offset = align(16 + header_size);
+      for (Array& array : listed) {
+        array.offset = offset;
+        offset = align(offset + array.rows * array.columns * element_size(array.descr));
+        header += array.name + '\t' + array.descr + '\t' + std::to_string(array.rows) + '\t' +
+                  std::to_string(array.columns) + '\t' + std::to_string(array.offset) + '\n';
+      }
+    } while (header.size() != header_size);
+    if (grid != VCDExportGrid::CHANGES) {
+      listed.erase(listed.begin());
+    }
+    for (std::size_t a = 0; a < arrays.size(); ++a) {
+      arrays[a].offset = listed[a].offset;
+    }
+
+    {
+      std::ofstream out(path, std::ios::binary | std::ios::trunc);
+      unsigned char size[8];
+      for (int b = 0; b < 8; ++b) {
+        size[b] = static_cast<unsigned char>(static_cast<uint64_t>(header.size()) >> (8 * b));
+      }
+      out.write("VCDARRAY", 8);
+      out.write(reinterpret_cast<const char*>(size), 8);
+      out << header;
+      if (grid != VCDExportGrid::CHANGES) {
+        out.seekp(static_cast<std::streamoff>(align(16 + header.size())));
+        write_block(out, grid_times.data(), grid_times.size());
+      }
+      if (!out) {
+        return false;
+      }
+    }
+    std::error_code error;
+    std::filesystem::resize_file(path, total_size(), error);
+    if (error) {
+      return false;
+    }
+
+    std::atomic<bool> failed{false};
+    run(file, [&](const Signal& signal, const VCDTimeline& timeline) {
+      std::fstream out(path, std::ios::binary | std::ios::in | std::ios::out);
+      for (std::size_t a = signal.first_array; a < signal.first_array + signal.array_count; ++a) {
+        out.seekp(static_cast<std::streamoff>(arrays[a].offset));
+        write_array(out, signal, timeline, a - signal.first_array);
+      }
+      if (!out) {
+        failed = true;
+      }
+    });
+    return !failed;
+  }
+
+  //! The arrays of the signals of the last export, without a shared grid.
+  [[nodiscard]] const std::vector<Array>& get_arrays() const {
+    return arrays;
+  }
+
+  //! The times of the shared grid of the last export.
+  [[nodiscard]] const std::vector<VCDTime>& get_grid() const {
+    return grid_times;
+  }
+
+protected:
+  //! How the values of a signal are stored.
+  enum class Kind { SCALAR, VECTOR, REAL };
+
+  //! An exported signal.
+  struct Signal {
+    VCDSignalIndex index;
+    Kind kind;
+    std::size_t words;
+    std::size_t width;
+    std::size_t first_array;
+    std::size_t array_count;
+  };
+
+  //! Rows converted at a time.
+  static constexpr std::size_t block_rows = 4096;
+
+  //! Choose the signals and arrays to export and build the grid.
+  bool plan(const VCDFile& file) {
+    signals.clear();
+    arrays.clear();
+    grid_times.clear();
+    header_size = 0;
+
+    if (grid == VCDExportGrid::TIMESTAMPS) {
+      const std::vector<VCDTime>& times = file.get_timestamps();
+      std::unique_copy(times.begin(), times.end(), std::back_inserter(grid_times));
+    } else if (grid == VCDExportGrid::UNIFORM) {
+      if (grid_step <= 0) {
+        return false;
+      }
+      const bool bounded = grid_end != std::numeric_limits<VCDTime>::max();
+      if (bounded || !file.get_timestamps().empty()) {
+        const VCDTime end = bounded ? grid_end : file.get_timestamps().back();
+        for (VCDTime t = grid_start; t <= end; t += grid_step) {
+          grid_times.push_back(t);
+          if (end - t < grid_step) {
+            break;
+          }
+        }
+      }
+    }
+
+    std::vector<bool> seen(file.get_signal_index_count(), false);
+    for (const VCDSignal& signal : file.get_signals()) {
+      if (signal.index >= seen.size() || seen[signal.index] || !selection.selects(signal, file.get_signal_path(signal))) {
+        continue;
+      }
+      seen[signal.index] = true;
+
+      std::string name = file.get_signal_path(signal);
+      if (signal.lindex != -1) {
+        name += '[' + std::to_string(signal.lindex);
+        if (signal.rindex != -1) {
+          name += ':' + std::to_string(signal.rindex);
+        }
+        name += ']';
+      }
+
+      const std::size_t rows = grid == VCDExportGrid::CHANGES ? signal_size(file, signal.index) : grid_times.size();
+      Signal exported{signal.index, Kind::SCALAR, 1, 1, arrays.size(), 1};
+      if (signal.type == VCDVarType::VCD_VAR_REAL || signal.type == VCDVarType::VCD_VAR_REALTIME) {
+        exported.kind = Kind::REAL;
+      } else if (signal.size > 1) {
+        exported.kind = Kind::VECTOR;
+        exported.width = static_cast<std::size_t>(signal.size);
+        exported.words = (exported.width + 63) / 64;
+      }
+
+      if (grid == VCDExportGrid::CHANGES) {
+        arrays.push_back(times_array(rows));
+        arrays.back().name = name + ".times";
+        exported.array_count++;
+      }
+      const char* descr = exported.kind == Kind::REAL ? "f8" : exported.kind == Kind::VECTOR ? "u8" : "u1";
+      arrays.push_back({name + ".values", native(descr), rows, exported.words, 0});
+      if (exported.kind == Kind::VECTOR) {
+        arrays.push_back({name + ".unknown", native("u8"), rows, exported.words, 0});
+        exported.array_count++;
+      }
+      signals.push_back(exported);
+    }
+    return true;
+  }
+
+  //! Export every signal on the worker threads.
+  template <typename Function>
+  void run(const VCDFile& file, Function export_signal) {
+    unsigned workers = threads == 0 ? std::thread::hardware_concurrency() : threads;
+    workers = static_cast<unsigned>(std::min<std::size_t>(std::max(workers, 1u), std::max<std::size_t>(signals.size(), 1)));
+
+    std::atomic<std::size_t> next{0};
+    VCDFileParser::run_workers(workers, [&](unsigned) {
+      for (std::size_t s = next++; s < signals.size(); s = next++) {
+        if (file.timelines_compressed()) {
+          export_signal(signals[s], file.copy_signal_values(signals[s].index));
+        } else {
+          export_signal(signals[s], file.get_signal_values(signals[s].index));
+        }
+      }
+    });
+  }
+
+  //! Write array number a of a signal, its times, values or unknown plane.
+  template <typename Stream>
+  void write_array(Stream& out, const Signal& signal, const VCDTimeline& timeline, std::size_t a) {
+    if (grid == VCDExportGrid::CHANGES && a == 0) {
+      const VCDArrayView<VCDTime> times = timeline.times();
+      write_block(out, times.data(), times.size());
+      return;
+    }
+    const bool unknown = a == signal.array_count - 1 && signal.kind == Kind::VECTOR;
+    const std::size_t rows = grid == VCDExportGrid::CHANGES ? timeline.size() : grid_times.size();
+
+    // Index of the value at each row, npos before the first value.
+    std::vector<std::size_t> indices(std::min(rows, block_rows));
+    std::vector<uint64_t> words(indices.size() * signal.words);
+    std::vector<double> reals(signal.kind == Kind::REAL ? indices.size() : 0);
+    std::vector<uint8_t> bits(signal.kind == Kind::SCALAR ? indices.size() : 0);
+    std::size_t position = 0;
+
+    for (std::size_t first = 0; first < rows; first += block_rows) {
+      const std::size_t count = std::min(block_rows, rows - first);
+      for (std::size_t r = 0; r < count; ++r) {
+        if (grid == VCDExportGrid::CHANGES) {
+          indices[r] = first + r;
+          continue;
+        }
+        // The grid is sorted, so the value in effect only moves forward.
+        const VCDTime t = grid_times[first + r];
+        while (position < timeline.size() && timeline.time_at(position) <= t) {
+          position++;
+        }
+        indices[r] = position == 0 ? VCDTimeline::npos : position - 1;
+      }
+
+      switch (signal.kind) {
+        case Kind::SCALAR:
+          for (std::size_t r = 0; r < count; ++r) {
+            bits[r] = static_cast<uint8_t>(scalar_of(timeline, indices[r]));
+          }
+          write_block(out, bits.data(), count);
+          break;
+        case Kind::REAL:
+          for (std::size_t r = 0; r < count; ++r) {
+            reals[r] = real_of(timeline, indices[r]);
+          }
+          write_block(out, reals.data(), count);
+          break;
+        case Kind::VECTOR:
+          for (std::size_t r = 0; r < count; ++r) {
+            vector_of(timeline, indices[r], signal, unknown, words.data() + r * signal.words);
+          }
+          write_block(out, words.data(), count * signal.words);
+          break;
+      }
+    }
+  }
+
+  //! Scalar value at index i, x before the first value.
+  static VCDBit scalar_of(const VCDTimeline& timeline, std::size_t i) {
+    if (i == VCDTimeline::npos) {
+      return VCDBit::VCD_X;
+    }
+    if (timeline.column_type() == VCDColumnType::SCALAR) {
+      return timeline.scalar_at(i);
+    }
+    const VCDValue value = timeline.value_at(i);
+    switch (value.get_type()) {
+      case VCDValueType::SCALAR:
+        return value.get_value_bit();
+      case VCDValueType::VECTOR:
+        return value.get_value_packed().width() > 0 ? value.get_value_packed().get(0) : VCDBit::VCD_X;
+      default:
+        return VCDBit::VCD_X;
+    }
+  }
+
+  //! Real value at index i, NaN before the first value.
+  static double real_of(const VCDTimeline& timeline, std::size_t i) {
+    if (i == VCDTimeline::npos) {
+      return std::numeric_limits<double>::quiet_NaN();
+    }
+    if (timeline.column_type() == VCDColumnType::REAL) {
+      return timeline.real_at(i);
+    }
+    const VCDValue value = timeline.value_at(i);
+    return value.get_type() == VCDValueType::REAL ? value.get_value_real() : std::numeric_limits<double>::quiet_NaN();
+  }
+
+  //! Fill the words of the value or unknown plane of the vector at index i.
+  static void vector_of(const VCDTimeline& timeline, std::size_t i, const Signal& signal, bool unknown, uint64_t* out) {
+    std::fill_n(out, signal.words, 0);
+    if (i != VCDTimeline::npos && timeline.column_type() == VCDColumnType::VECTOR) {
+      const uint64_t* planes = timeline.vector_words_at(i) + (unknown ? timeline.vector_words() : 0);
+      std::copy_n(planes, std::min(signal.words, timeline.vector_words()), out);
+    } else if (i != VCDTimeline::npos) {
+      const VCDValue value = timeline.value_at(i);
+      if (value.get_type() == VCDValueType::VECTOR) {
+        const VCDPackedVector& vec = value.get_value_packed();
+        std::copy_n(unknown ? vec.unknown_words() : vec.value_words(), std::min(signal.words, vec.words()), out);
+      } else if (value.get_type() == VCDValueType::SCALAR) {
+        out[0] = (static_cast<uint64_t>(value.get_value_bit()) >> (unknown ? 1 : 0)) & 1;
+      } else if (unknown) {
+        std::fill_n(out, signal.words, ~uint64_t(0));
+      }
+    } else if (unknown) {
+      std::fill_n(out, signal.words, ~uint64_t(0));
+    }
+    if (signal.width % 64 != 0) {
+      out[signal.words - 1] &= (uint64_t(1) << (signal.width % 64)) - 1;
+    }
+  }
+
+  //! Number of values of a signal.
+  static std::size_t signal_size(const VCDFile& file, VCDSignalIndex index) {
+    return file.timelines_compressed() ? file.get_compressed_values(index).size() : file.get_signal_values(index).size();
+  }
+
+  //! The array of the times of the shared grid.
+  static Array times_array(std::size_t rows) {
+    return {"times", native("i8"), rows, 1, 0};
+  }
+
+  //! NumPy type of a native endian type, e.g. "<u8" for "u8".
+  static std::string native(const char* type) {
+    if (type[1] == '1') {
+      return std::string("|") + type;
+    }
+    const uint16_t probe = 1;
+    unsigned char first;
+    std::memcpy(&first, &probe, 1);
+    return std::string(first == 1 ? "<" : ">") + type;
+  }
+
+  //! File name of an array written by write_npy().
+  static std::string file_name(std::string name) {
+    for (char& c : name) {
+      if (std::strchr("<>:\"/\\|?*", c) != nullptr) {
+        c = '_';
+      }
+    }
+    return name + ".npy";
+  }
+
+  static std::size_t element_size(const std::string& descr) {
+    return static_cast<std::size_t>(descr.back() - '0');
+  }
+
+  static std::size_t align(std::size_t offset) {
+    return (offset + 63) / 64 * 64;
+  }
+
+  //! Size of the file of write_columns().
+  [[nodiscard]] std::size_t total_size() const {
+    std::size_t size = align(16 + header_size);
+    if (grid != VCDExportGrid::CHANGES) {
+      size = align(size + grid_times.size() * sizeof(VCDTime));
+    }
+    if (!arrays.empty()) {
+      const Array& last = arrays.back();
+      size = align(last.offset + last.rows * last.columns * element_size(last.descr));
+    }
+    return size;
+  }
+
+  //! Write a .npy version 1.0 header, padded to 64 bytes.
+  static void write_npy_header(std::ostream& out, const Array& array) {
+    std::string dict = "{'descr': '" + array.descr + "', 'fortran_order': False, 'shape': (" +
+                       std::to_string(array.rows) + (array.columns > 1 ? ", " + std::to_string(array.columns) : ",") +
+                       "), }";
+    dict.append(align(10 + dict.size() + 1) - 10 - dict.size() - 1, ' ');
+    dict += '\n';
+    const char magic[8] = {'\x93', 'N', 'U', 'M', 'P', 'Y', 1, 0};
+    out.write(magic, 8);
+    const char length[2] = {static_cast<char>(dict.size() & 0xff), static_cast<char>(dict.size() >> 8)};
+    out.write(length, 2);
+    out << dict;
+  }
+
+  template <typename Stream, typename T>
+  static void write_block(Stream& out, const T* data, std::size_t count) {
+    out.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(count * sizeof(T)));
+  }
+
+  //! The exported signals, in declaration order.
+  std::vector<Signal> signals;
+
+  //! The arrays of the exported signals.
+  std::vector<Array> arrays;
+
+  //! The shared grid.
+  std::vector<VCDTime> grid_times;
+
+  //! Size of the header of write_columns().
+  std::size_t header_size = 0;
+};
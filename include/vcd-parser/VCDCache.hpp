@@ -0,0 +1,437 @@
+#pragma once
+
+#include <vcd-parser/VCDFile.hpp>
+#include <vcd-parser/VCDMappedFile.hpp>
+#include <vcd-parser/VCDPackedVector.hpp>
+#include <vcd-parser/VCDTimeline.hpp>
+#include <vcd-parser/VCDTypes.hpp>
+#include <vcd-parser/VCDValue.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+/*!
+@file VCDCache.hpp
+@brief Binary cache files holding a parsed VCDFile.
+*/
+
+/*!
+@brief Writes a VCDFile to a compact binary file and reads it back.
+@details The cache stores the header, the scope tree, the signals, the
+timestamps and every timeline column as raw arrays aligned to 8 bytes,
+in host byte order. Loading maps the cache and copies the columns in
+bulk, no text is parsed. The size and modification time of the source
+VCD are recorded, so a stale cache can be detected. Saving replaces the
+cache by renaming a new file over it, so processes that have the old
+cache mapped keep reading it intact.
+*/
+class VCDCache {
+
+public:
+  //! Version of the cache layout, bumped on every change.
+  static constexpr uint32_t format_version = 2;
+
+  //! Return the default cache path of a VCD file.
+  static std::string cache_path(const std::string& vcd_path) {
+    return vcd_path + ".cache";
+  }
+
+  /*!
+  @brief Return the size and modification time of a file.
+  @returns false if the file does not exist.
+  */
+  static bool source_stamp(const std::string& path, uint64_t& size, int64_t& mtime) {
+    std::error_code error;
+    size = std::filesystem::file_size(path, error);
+    if (error) {
+      return false;
+    }
+    auto time = std::filesystem::last_write_time(path, error);
+    if (error) {
+      return false;
+    }
+    mtime = static_cast<int64_t>(time.time_since_epoch().count());
+    return true;
+  }
+
+  /*!
+  @brief Write a file to a cache.
+  @param file in - The parsed file.
+  @param path in - The cache file to write.
+  @param source in - The VCD file the cache stands for, to record its stamp.
+  @returns false if the cache cannot be written.
+  */
+  static bool save(const VCDFile& file, const std::string& path, const std::string& source = std::string()) {
+    uint64_t source_size = 0;
+    int64_t source_mtime = 0;
+    if (!source.empty() && !source_stamp(source, source_size, source_mtime)) {
+      return false;
+    }
+
+    // Write next to the cache, rewriting a mapped cache in place would break its readers.
+    const std::string temporary = path + ".tmp" + std::to_string(std::random_device{}());
+    bool written = false;
+    {
+      std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+      if (out) {
+        write(file, out, source_size, source_mtime);
+        out.close();
+        written = !out.fail();
+      }
+    }
+
+    std::error_code error;
+    if (written) {
+      std::filesystem::rename(temporary, path, error);
+    }
+    if (!written || error) {
+      std::filesystem::remove(temporary, error);
+      return false;
+    }
+    return true;
+  }
+
+  /*!
+  @brief Read a file from a cache.
+  @param path in - The cache file.
+  @param source in - If not empty, the VCD file the cache must stand for.
+  @returns The file, or nullptr if the cache is missing, damaged, of
+  another version or stale. Enums and column lengths are checked, so a
+  damaged cache is rejected rather than read out of bounds.
+  */
+  static std::shared_ptr<VCDFile> load(const std::string& path, const std::string& source = std::string()) {
+    VCDMappedFile input;
+    if (!input.open(path)) {
+      return nullptr;
+    }
+    Reader r{input.data(), input.data() + input.size()};
+
+    char header[sizeof(magic)] = {};
+    r.bytes(header, sizeof(header));
+    if (!r.ok || std::memcmp(header, magic, sizeof(magic)) != 0 ||
+        r.value<uint32_t>() != format_version || r.value<uint32_t>() != byte_order) {
+      return nullptr;
+    }
+
+    const auto source_size = r.value<uint64_t>();
+    const auto source_mtime = r.value<int64_t>();
+    if (!source.empty()) {
+      uint64_t size = 0;
+      int64_t mtime = 0;
+      if (!source_stamp(source, size, mtime) || size != source_size || mtime != source_mtime) {
+        return nullptr;
+      }
+    }
+
+    auto file = std::make_shared<VCDFile>();
+    file->date = r.string();
+    file->version = r.string();
+    file->comment = r.string();
+    file->time_resolution = static_cast<VCDTimeRes>(r.value<int64_t>());
+    const auto time_units = r.value<uint32_t>();
+    if (time_units > static_cast<uint32_t>(VCDTimeUnit::TIME_PS)) {
+      return nullptr;
+    }
+    file->time_units = static_cast<VCDTimeUnit>(time_units);
+
+    std::vector<VCDScope*> scopes;
+    const auto scope_count = r.value<uint64_t>();
+    for (uint64_t i = 0; i < scope_count && r.ok; ++i) {
+      VCDScope scope;
+      scope.name = r.string();
+      const auto type = r.value<uint32_t>();
+      if (type > static_cast<uint32_t>(VCDScopeType::VCD_SCOPE_ROOT)) {
+        return nullptr;
+      }
+      scope.type = static_cast<VCDScopeType>(type);
+      const auto parent = r.value<uint32_t>();
+      scope.parent = parent < scopes.size() ? scopes[parent] : nullptr;
+
+      VCDScope* added = file->add_scope(scope);
+      if (added->parent != nullptr) {
+        added->parent->children.push_back(added);
+      }
+      scopes.push_back(added);
+    }
+    file->root_scope = scopes.empty() ? nullptr : scopes.front();
+
+    const auto signal_count = r.value<uint64_t>();
+    for (uint64_t i = 0; i < signal_count && r.ok; ++i) {
+      VCDSignal signal;
+      signal.hash = r.string();
+      signal.reference = r.string();
+      const auto scope = r.value<uint32_t>();
+      signal.scope = scope < scopes.size() ? scopes[scope] : nullptr;
+      signal.size = static_cast<VCDSignalSize>(r.value<int64_t>());
+      const auto type = r.value<uint32_t>();
+      if (type > static_cast<uint32_t>(VCDVarType::VCD_VAR_WOR)) {
+        return nullptr;
+      }
+      signal.type = static_cast<VCDVarType>(type);
+      signal.lindex = r.value<int32_t>();
+      signal.rindex = r.value<int32_t>();
+
+      VCDSignal* added = file->add_signal(signal);
+      if (added->scope != nullptr) {
+        added->scope->signals.push_back(added);
+      }
+    }
+
+    r.array(file->times);
+
+    const auto timeline_count = r.value<uint64_t>();
+    for (uint64_t i = 0; i < timeline_count && r.ok; ++i) {
+      const VCDSignalIndex index = file->intern_signal(r.string());
+      if (index != i) {
+        return nullptr;
+      }
+      VCDTimeline& timeline = file->timelines[index];
+
+      const auto column = r.value<uint32_t>();
+      const auto width = r.value<uint64_t>();
+      if (column > static_cast<uint32_t>(VCDColumnType::GENERIC) || width > max_width) {
+        return nullptr;
+      }
+      timeline.column = static_cast<VCDColumnType>(column);
+      timeline.width = static_cast<std::size_t>(width);
+      timeline.stride = 2 * ((timeline.width + 63) / 64);
+      r.array(timeline.time_column);
+      r.array(timeline.scalar_column);
+      r.array(timeline.vector_column);
+      r.array(timeline.real_column);
+
+      const auto generic_count = r.value<uint64_t>();
+      timeline.generic_column.clear();
+      for (uint64_t g = 0; g < generic_count && r.ok; ++g) {
+        timeline.generic_column.push_back(r.generic());
+      }
+      if (r.ok && !columns_match(timeline)) {
+        return nullptr;
+      }
+    }
+
+    return r.ok ? file : nullptr;
+  }
+
+protected:
+  //! File magic.
+  static constexpr char magic[8] = {'V', 'C', 'D', 'C', 'A', 'C', 'H', 'E'};
+
+  //! Written in host order, reads differently on a host of other endianness.
+  static constexpr uint32_t byte_order = 0x01020304;
+
+  //! Scope number of a missing parent or scope.
+  static constexpr uint32_t no_scope = 0xffffffff;
+
+  //! Widest vector accepted from a cache, larger widths mark a damaged cache.
+  static constexpr uint64_t max_width = uint64_t(1) << 32;
+
+  //! Append the cache of a file to a stream.
+  static void write(const VCDFile& file, std::ostream& out, uint64_t source_size, int64_t source_mtime) {
+    Writer w{out};
+
+    w.bytes(magic, sizeof(magic));
+    w.value(format_version);
+    w.value(byte_order);
+    w.value(source_size);
+    w.value(source_mtime);
+
+    w.string(file.date);
+    w.string(file.version);
+    w.string(file.comment);
+    w.value(static_cast<int64_t>(file.time_resolution));
+    w.value(static_cast<uint32_t>(file.time_units));
+
+    std::unordered_map<const VCDScope*, uint32_t> scope_numbers;
+    for (const VCDScope& scope : file.scopes) {
+      scope_numbers.emplace(&scope, static_cast<uint32_t>(scope_numbers.size()));
+    }
+
+    w.value(static_cast<uint64_t>(file.scopes.size()));
+    for (const VCDScope& scope : file.scopes) {
+      w.string(scope.name);
+      w.value(static_cast<uint32_t>(scope.type));
+      w.value(scope.parent == nullptr ? no_scope : scope_numbers.at(scope.parent));
+    }
+
+    w.value(static_cast<uint64_t>(file.signals.size()));
+    for (const VCDSignal& signal : file.signals) {
+      w.string(signal.hash);
+      w.string(signal.reference);
+      w.value(signal.scope == nullptr ? no_scope : scope_numbers.at(signal.scope));
+      w.value(static_cast<int64_t>(signal.size));
+      w.value(static_cast<uint32_t>(signal.type));
+      w.value(static_cast<int32_t>(signal.lindex));
+      w.value(static_cast<int32_t>(signal.rindex));
+    }
+
+    w.array(file.times);
+
+    w.value(static_cast<uint64_t>(file.timelines.size()));
+    for (VCDSignalIndex index = 0; index < file.timelines.size(); ++index) {
+      VCDTimeline decompressed;
+      if (file.compressed) {
+        decompressed = file.copy_signal_values(index);
+      }
+      const VCDTimeline& timeline = file.compressed ? decompressed : file.timelines[index];
+      w.string(file.id_codes.code(index));
+      w.value(static_cast<uint32_t>(timeline.column));
+      w.value(static_cast<uint64_t>(timeline.width));
+      w.array(timeline.time_column);
+      w.array(timeline.scalar_column);
+      w.array(timeline.vector_column);
+      w.array(timeline.real_column);
+      w.value(static_cast<uint64_t>(timeline.generic_column.size()));
+      for (const VCDValue& value : timeline.generic_column) {
+        w.generic(value);
+      }
+    }
+  }
+
+  //! Do the column lengths of a loaded timeline match its number of values?
+  static bool columns_match(const VCDTimeline& timeline) {
+    const std::size_t count = timeline.time_column.size();
+    const auto holds = [&](VCDColumnType column, std::size_t size, std::size_t expected) {
+      return size == (timeline.column == column ? expected : 0);
+    };
+    const bool vector_fits = timeline.stride == 0 || count <= timeline.vector_column.size() / timeline.stride;
+    return vector_fits && holds(VCDColumnType::SCALAR, timeline.scalar_column.size(), (count + 31) / 32) &&
+           holds(VCDColumnType::VECTOR, timeline.vector_column.size(), count * timeline.stride) &&
+           holds(VCDColumnType::REAL, timeline.real_column.size(), count) &&
+           holds(VCDColumnType::GENERIC, timeline.generic_column.size(), count);
+  }
+
+  //! Appends values to a stream, padding arrays to 8 bytes.
+  struct Writer {
+    std::ostream& out;
+    uint64_t offset = 0;
+
+    void bytes(const void* data, std::size_t size) {
+      out.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+      offset += size;
+    }
+
+    template <typename T>
+    void value(const T& v) {
+      bytes(&v, sizeof(T));
+    }
+
+    void string(const std::string& text) {
+      value(static_cast<uint64_t>(text.size()));
+      bytes(text.data(), text.size());
+    }
+
+    template <typename Array>
+    void array(const Array& values) {
+      value(static_cast<uint64_t>(values.size()));
+      static const char padding[8] = {};
+      bytes(padding, (8 - offset % 8) % 8);
+      bytes(values.data(), values.size() * sizeof(typename Array::value_type));
+    }
+
+    void generic(const VCDValue& v) {
+      value(static_cast<uint32_t>(v.get_type()));
+      switch (v.get_type()) {
+        case VCDValueType::SCALAR:
+          value(static_cast<uint32_t>(v.get_value_bit()));
+          break;
+        case VCDValueType::VECTOR: {
+          const VCDPackedVector& vec = v.get_value_packed();
+          value(static_cast<uint64_t>(vec.width()));
+          bytes(vec.value_words(), vec.words() * sizeof(uint64_t));
+          bytes(vec.unknown_words(), vec.words() * sizeof(uint64_t));
+          break;
+        }
+        case VCDValueType::REAL:
+          value(v.get_value_real());
+          break;
+        case VCDValueType::EMPTY:
+          break;
+      }
+    }
+  };
+
+  //! Reads values written by Writer from memory, ok turns false on overrun.
+  struct Reader {
+    const char* begin;
+    const char* end;
+    const char* pos = begin;
+    bool ok = true;
+
+    void bytes(void* data, std::size_t size) {
+      if (size == 0) {
+        return;
+      }
+      if (static_cast<std::size_t>(end - pos) < size) {
+        ok = false;
+        pos = end;
+        return;
+      }
+      std::memcpy(data, pos, size);
+      pos += size;
+    }
+
+    template <typename T>
+    T value() {
+      T v{};
+      bytes(&v, sizeof(T));
+      return v;
+    }
+
+    std::string string() {
+      const auto size = value<uint64_t>();
+      if (static_cast<uint64_t>(end - pos) < size) {
+        ok = false;
+        return std::string();
+      }
+      std::string text(pos, static_cast<std::size_t>(size));
+      pos += size;
+      return text;
+    }
+
+    template <typename Array>
+    void array(Array& values) {
+      using T = typename Array::value_type;
+      const auto count = value<uint64_t>();
+      pos += std::min<std::size_t>((8 - (pos - begin) % 8) % 8, end - pos);
+      if (static_cast<uint64_t>(end - pos) / sizeof(T) < count) {
+        ok = false;
+        values.clear();
+        return;
+      }
+      values.resize(static_cast<std::size_t>(count));
+      bytes(values.data(), values.size() * sizeof(T));
+    }
+
+    VCDValue generic() {
+      switch (static_cast<VCDValueType>(value<uint32_t>())) {
+        case VCDValueType::SCALAR:
+          return VCDValue(static_cast<VCDBit>(value<uint32_t>() & 3));
+        case VCDValueType::VECTOR: {
+          const auto width = static_cast<std::size_t>(value<uint64_t>());
+          const std::size_t words = (width + 63) / 64;
+          if (static_cast<std::size_t>(end - pos) / (2 * sizeof(uint64_t)) < words) {
+            ok = false;
+            return VCDValue();
+          }
+          std::vector<uint64_t> planes(2 * words);
+          bytes(planes.data(), planes.size() * sizeof(uint64_t));
+          return VCDValue(VCDPackedVector(width, planes.data(), planes.data() + words));
+        }
+        case VCDValueType::REAL:
+          return VCDValue(value<VCDReal>());
+        default:
+          return VCDValue();
+      }
+    }
+  };
+};
@@ -0,0 +1,381 @@
+#pragma once
+
+#include <vcd-parser/VCDPackedVector.hpp>
+#include <vcd-parser/VCDTypes.hpp>
+#include <vcd-parser/VCDValue.hpp>
+#include <vcd-parser/VCDVisitor.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/*!
+@file VCDCheckpointIndex.hpp
+@brief Checkpoints of the signal state of a VCD file, for parsing a time window.
+*/
+
+/*!
+@brief A VCDVisitor remembering the latest value of every signal.
+*/
+class VCDStateTracker : public VCDVisitor {
+
+public:
+  void on_var(const VCDSignal& signal) override {
+    set_hash(signal.index, signal.hash);
+  }
+
+  void on_undeclared(VCDSignalIndex index, std::string_view hash) override {
+    set_hash(index, hash);
+  }
+
+  void on_scalar_change([[maybe_unused]] VCDTime time, VCDSignalIndex index, VCDBit value) override {
+    set_state(index, VCDValue(value));
+  }
+
+  void on_vector_change([[maybe_unused]] VCDTime time, VCDSignalIndex index, std::string_view digits) override {
+    set_state(index, VCDValue(VCDPackedVector::from_ascii(digits.data(), digits.size())));
+  }
+
+  void on_real_change([[maybe_unused]] VCDTime time, VCDSignalIndex index, VCDReal value) override {
+    set_state(index, VCDValue(value));
+  }
+
+  //! Set the value of a signal.
+  void set_state(VCDSignalIndex index, VCDValue value) {
+    if (index >= state.size()) {
+      state.resize(index + 1);
+    }
+    state[index] = std::move(value);
+  }
+
+  //! The id codes and values of all signals which have a value.
+  [[nodiscard]] std::vector<std::pair<VCDSignalHash, VCDValue>> snapshot() const {
+    std::vector<std::pair<VCDSignalHash, VCDValue>> values;
+    for (VCDSignalIndex i = 0; i < state.size(); ++i) {
+      if (state[i].get_type() != VCDValueType::EMPTY && i < hashes.size()) {
+        values.emplace_back(hashes[i], state[i]);
+      }
+    }
+    return values;
+  }
+
+protected:
+  //! Remember the id code of a signal index.
+  void set_hash(VCDSignalIndex index, std::string_view hash) {
+    if (index >= hashes.size()) {
+      hashes.resize(index + 1);
+    }
+    hashes[index] = hash;
+  }
+
+  //! Latest value by signal index, EMPTY if there was none.
+  std::vector<VCDValue> state;
+
+  //! Id code by signal index.
+  std::vector<VCDSignalHash> hashes;
+};
+
+
+/*!
+@brief Forwards a parse to another visitor from a start time on.
+@details Value changes up to the start time are only tracked. At the
+first timestamp after it, the tracked values are reported as changes at
+the start time, so the target sees every signal's value in effect at
+the start of the window. The header is forwarded unchanged.
+*/
+class VCDWindowVisitor : public VCDStateTracker {
+
+public:
+  /*!
+  @param target in - The visitor receiving the window.
+  @param start in - The time the window starts at.
+  */
+  VCDWindowVisitor(VCDVisitor& target, VCDTime start) : target(target), start(start) {}
+
+  void on_date(std::string_view text) override { target.on_date(text); }
+  void on_version(std::string_view text) override { target.on_version(text); }
+  void on_comment(std::string_view text) override { target.on_comment(text); }
+  void on_timescale(VCDTimeRes resolution, VCDTimeUnit units) override { target.on_timescale(resolution, units); }
+  void on_scope(const VCDScope& scope) override { target.on_scope(scope); }
+  void on_upscope() override { target.on_upscope(); }
+  void on_header_done() override { target.on_header_done(); }
+
+  void on_var(const VCDSignal& signal) override {
+    VCDStateTracker::on_var(signal);
+    target.on_var(signal);
+  }
+
+  void on_undeclared(VCDSignalIndex index, std::string_view hash) override {
+    VCDStateTracker::on_undeclared(index, hash);
+    target.on_undeclared(index, hash);
+  }
+
+  void on_timestamp(VCDTime time) override {
+    if (!started) {
+      if (time <= start) {
+        return;
+      }
+      begin_window();
+    }
+    target.on_timestamp(time);
+  }
+
+  void on_scalar_change(VCDTime time, VCDSignalIndex index, VCDBit value) override {
+    if (started) {
+      target.on_scalar_change(time, index, value);
+    } else {
+      VCDStateTracker::on_scalar_change(time, index, value);
+    }
+  }
+
+  void on_vector_change(VCDTime time, VCDSignalIndex index, std::string_view digits) override {
+    if (started) {
+      target.on_vector_change(time, index, digits);
+    } else {
+      VCDStateTracker::on_vector_change(time, index, digits);
+    }
+  }
+
+  void on_real_change(VCDTime time, VCDSignalIndex index, VCDReal value) override {
+    if (started) {
+      target.on_real_change(time, index, value);
+    } else {
+      VCDStateTracker::on_real_change(time, index, value);
+    }
+  }
+
+  void on_finish() override {
+    if (!started) {
+      begin_window();
+    }
+    target.on_finish();
+  }
+
+protected:
+  //! Report the tracked values as changes at the start time.
+  void begin_window() {
+    started = true;
+
+    bool any = false;
+    for (VCDSignalIndex i = 0; i < state.size(); ++i) {
+      const VCDValue& value = state[i];
+      if (value.get_type() == VCDValueType::EMPTY) {
+        continue;
+      }
+      if (!any) {
+        target.on_timestamp(start);
+        any = true;
+      }
+      switch (value.get_type()) {
+        case VCDValueType::SCALAR:
+          target.on_scalar_change(start, i, value.get_value_bit());
+          break;
+        case VCDValueType::VECTOR:
+          target.on_vector_change(start, i, value.get_value_packed().to_string());
+          break;
+        case VCDValueType::REAL:
+          target.on_real_change(start, i, value.get_value_real());
+          break;
+        default:
+          break;
+      }
+    }
+    state.clear();
+  }
+
+  //! Receives the window.
+  VCDVisitor& target;
+
+  //! Time the window starts at.
+  VCDTime start;
+
+  //! Has the window started?
+  bool started = false;
+};
+
+
+/*!
+@brief Byte offsets and signal states at regular points of a VCD file.
+@details Built by VCDFileParser::build_index() and used by
+VCDFileParser::parse_file_window() to start parsing close to the start
+of a time window instead of at the beginning of the file. Each
+checkpoint is the offset of a "#time" line, with the values of all
+signals just before that line.
+*/
+class VCDCheckpointIndex {
+
+public:
+  //! A position in the value change section and the state there.
+  struct Checkpoint {
+    //! Time of the "#time" line at offset.
+    VCDTime time = 0;
+    //! Byte offset of the "#time" line.
+    uint64_t offset = 0;
+    //! Id code and value of every signal with a value before offset.
+    std::vector<std::pair<VCDSignalHash, VCDValue>> state;
+  };
+
+  //! Size of the indexed file, to detect a stale index.
+  uint64_t source_size = 0;
+
+  //! Modification time of the indexed file, see VCDCache::source_stamp().
+  int64_t source_mtime = 0;
+
+  //! Byte offset just after $enddefinitions.
+  uint64_t body_offset = 0;
+
+  //! Checkpoints, sorted by offset and time.
+  std::vector<Checkpoint> checkpoints;
+
+  //! Return the default sidecar path of the index of a VCD file.
+  static std::string sidecar_path(const std::string& vcd_path) {
+    return vcd_path + ".idx";
+  }
+
+  /*!
+  @brief Return the last checkpoint not after a time.
+  @returns The checkpoint or nullptr if all checkpoints are later.
+  */
+  [[nodiscard]] const Checkpoint* find(VCDTime time) const {
+    auto it = std::upper_bound(checkpoints.begin(), checkpoints.end(), time,
+                               [](VCDTime t, const Checkpoint& c) { return t < c.time; });
+    return it == checkpoints.begin() ? nullptr : &*std::prev(it);
+  }
+
+  /*!
+  @brief Write the index to a file.
+  @returns false if the file cannot be written.
+  */
+  bool save(const std::string& path) const {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+      return false;
+    }
+
+    out.write(magic, sizeof(magic));
+    write(out, source_size);
+    write(out, source_mtime);
+    write(out, body_offset);
+    write(out, static_cast<uint64_t>(checkpoints.size()));
+
+    for (const Checkpoint& checkpoint : checkpoints) {
+      write(out, checkpoint.time);
+      write(out, checkpoint.offset);
+      write(out, static_cast<uint64_t>(checkpoint.state.size()));
+      for (const auto& [hash, value] : checkpoint.state) {
+        write_string(out, hash);
+        write(out, static_cast<uint8_t>(value.get_type()));
+        switch (value.get_type()) {
+          case VCDValueType::SCALAR:
+            write(out, static_cast<uint8_t>(value.get_value_bit()));
+            break;
+          case VCDValueType::VECTOR:
+            write_string(out, value.get_value_packed().to_string());
+            break;
+          case VCDValueType::REAL:
+            write(out, value.get_value_real());
+            break;
+          default:
+            break;
+        }
+      }
+    }
+
+    return static_cast<bool>(out);
+  }
+
+  /*!
+  @brief Read an index written by save().
+  @returns false if the file cannot be read or is not an index.
+  */
+  bool load(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    char header[sizeof(magic)];
+    if (!in.read(header, sizeof(header)) || std::memcmp(header, magic, sizeof(magic)) != 0) {
+      return false;
+    }
+
+    uint64_t count = 0;
+    read(in, source_size);
+    read(in, source_mtime);
+    read(in, body_offset);
+    read(in, count);
+
+    checkpoints.clear();
+    for (uint64_t c = 0; c < count && in; ++c) {
+      Checkpoint checkpoint;
+      uint64_t entries = 0;
+      read(in, checkpoint.time);
+      read(in, checkpoint.offset);
+      read(in, entries);
+
+      for (uint64_t e = 0; e < entries && in; ++e) {
+        VCDSignalHash hash = read_string(in);
+        uint8_t type = 0;
+        read(in, type);
+        switch (static_cast<VCDValueType>(type)) {
+          case VCDValueType::SCALAR: {
+            uint8_t bit = 0;
+            read(in, bit);
+            checkpoint.state.emplace_back(hash, VCDValue(static_cast<VCDBit>(bit & 3)));
+            break;
+          }
+          case VCDValueType::VECTOR: {
+            std::string digits = read_string(in);
+            checkpoint.state.emplace_back(hash, VCDValue(VCDPackedVector::from_ascii(digits.data(), digits.size())));
+            break;
+          }
+          case VCDValueType::REAL: {
+            VCDReal real = 0;
+            read(in, real);
+            checkpoint.state.emplace_back(hash, VCDValue(real));
+            break;
+          }
+          default:
+            return false;
+        }
+      }
+      checkpoints.push_back(std::move(checkpoint));
+    }
+
+    return static_cast<bool>(in);
+  }
+
+protected:
+  //! File magic, including the format version.
+  static constexpr char magic[8] = {'V', 'C', 'D', 'I', 'D', 'X', '0', '2'};
+
+  template <typename T>
+  static void write(std::ostream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+
+  static void write_string(std::ostream& out, const std::string& text) {
+    write(out, static_cast<uint32_t>(text.size()));
+    out.write(text.data(), static_cast<std::streamsize>(text.size()));
+  }
+
+  template <typename T>
+  static void read(std::istream& in, T& value) {
+    in.read(reinterpret_cast<char*>(&value), sizeof(T));
+  }
+
+  static std::string read_string(std::istream& in) {
+    uint32_t size = 0;
+    read(in, size);
+    std::string text;
+    if (in && size <= (uint32_t(1) << 30)) {
+      text.resize(size);
+      in.read(text.data(), size);
+    } else {
+      in.setstate(std::ios::failbit);
+    }
+    return text;
+  }
+};
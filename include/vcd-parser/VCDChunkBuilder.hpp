@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vcd-parser/VCDFile.hpp>
+#include <vcd-parser/VCDTimeline.hpp>
+#include <vcd-parser/VCDVisitor.hpp>
+
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/*!
+@file VCDChunkBuilder.hpp
+@brief A VCDVisitor collecting the values of one part of the value change section.
+*/
+
+/*!
+@brief Collects timestamps and partial timelines of one chunk of a file.
+@details Used by the parallel parse: each chunk of the value change
+section is parsed into its own VCDChunkBuilder, and the chunks are then
+appended to the file in order.
+*/
+class VCDChunkBuilder : public VCDVisitor {
+
+public:
+  /*!
+  @brief Create an empty chunk for a file whose header has been parsed.
+  @param header in - The file, to copy the column layout of each signal.
+  */
+  explicit VCDChunkBuilder(const VCDFile& header) {
+    timelines.reserve(header.get_signal_index_count());
+    for (VCDSignalIndex i = 0; i < header.get_signal_index_count(); ++i) {
+      timelines.push_back(header.get_signal_values(i));
+    }
+  }
+
+  void on_undeclared(VCDSignalIndex index, std::string_view hash) override {
+    if (index >= timelines.size()) {
+      timelines.resize(index + 1);
+    }
+    undeclared.emplace_back(index, VCDSignalHash(hash));
+  }
+
+  void on_timestamp(VCDTime time) override {
+    timestamps.push_back(time);
+  }
+
+  void on_scalar_change(VCDTime time, VCDSignalIndex index, VCDBit value) override {
+    timelines[index].push_back(time, value);
+  }
+
+  void on_vector_change(VCDTime time, VCDSignalIndex index, std::string_view digits) override {
+    timelines[index].push_back_ascii(time, digits.data(), digits.size());
+  }
+
+  void on_real_change(VCDTime time, VCDSignalIndex index, VCDReal value) override {
+    timelines[index].push_back(time, value);
+  }
+
+  //! Timestamps of the chunk.
+  std::vector<VCDTime> timestamps;
+
+  //! Values of the chunk, by the signal index of the parser of the chunk.
+  std::vector<VCDSignalValues> timelines;
+
+  //! Id codes first seen in the chunk, which the file has to intern.
+  std::vector<std::pair<VCDSignalIndex, VCDSignalHash>> undeclared;
+};
@@ -1,9 +1,10 @@
 #pragma once
 
 #include <algorithm>
-#include <vcd-parser/VCDTypes.hpp>
+#include <cmath>
 #include <vcd-parser/VCDTypes.hpp>
 #include <vcd-parser/VCDTimedValue.hpp>
+#include <vcd-parser/VCDTimeline.hpp>
 #include <vcd-parser/VCDFile.hpp>
 
 /*!
@@ -67,19 +68,24 @@ inline bool operator==(const VCDScope &a, const VCDScope &b) {
   return false;
 }
 
+//! Compare reals, taking two NaNs as equal so a file holding a NaN equals itself.
+inline bool vcd_same_real(VCDReal a, VCDReal b) {
+  return a == b || (std::isnan(a) && std::isnan(b));
+}
+
 inline bool operator==(const VCDValue& a, const VCDValue& b) {
   if (a.get_type() != b.get_type()) {
     return false;
   }
 
   if (a.get_type() == VCDValueType::REAL) {
-    return a.get_value_real() == b.get_value_real();
+    return vcd_same_real(a.get_value_real(), b.get_value_real());
   }
   else if (a.get_type() == VCDValueType::SCALAR) {
     return a.get_value_bit() == b.get_value_bit();
   }
   else if (a.get_type() == VCDValueType::VECTOR) {
-    return a.get_value_vector() == b.get_value_vector();
+    return a.get_value_packed() == b.get_value_packed();
   }
   // VCDValueType::EMPTY
   return true;
@@ -92,6 +98,31 @@ inline bool operator==(const VCDTimedValue& a, const VCDTimedValue& b) {
   return false;
 }
 
+inline bool operator==(const VCDTimeline& a, const VCDTimeline& b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+
+  if (!std::equal(a.times().begin(), a.times().end(), b.times().begin())) {
+    return false;
+  }
+
+  if (a.column_type() == VCDColumnType::REAL && b.column_type() == VCDColumnType::REAL) {
+    return std::equal(a.reals().begin(), a.reals().end(), b.reals().begin(), vcd_same_real);
+  }
+
+  for (std::size_t i = 0; i < a.size(); ++i) {
+    if (!(a.value_at(i) == b.value_at(i))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+inline bool operator!=(const VCDTimeline& a, const VCDTimeline& b) {
+  return !(a == b);
+}
+
 /*!
 @brief Compares two VCDFile objects.
 */
@@ -132,5 +163,23 @@ inline bool operator==(const VCDFile &a, const VCDFile &b) {
     return false;
   }
 
-  return a.val_map == b.val_map;
+  if (a.timelines.size() != b.timelines.size()) {
+    return false;
+  }
+
+  for (VCDSignalIndex index = 0; index < a.timelines.size(); ++index) {
+    VCDSignalIndex other = b.id_codes.find(a.id_codes.code(index));
+    if (other == VCD_SIGNAL_NONE) {
+      return false;
+    }
+    if (a.compressed || b.compressed) {
+      if (a.copy_signal_values(index) != b.copy_signal_values(other)) {
+        return false;
+      }
+    } else if (a.timelines[index] != b.timelines[other]) {
+      return false;
+    }
+  }
+
+  return true;
 }
\ No newline at end of file
@@ -0,0 +1,475 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(VCD_PARSER_WITH_ZLIB)
+#include <zlib.h>
+#endif
+
+#if defined(VCD_PARSER_WITH_ZSTD)
+#include <zstd.h>
+#endif
+
+#if defined(VCD_PARSER_WITH_LZMA)
+#include <lzma.h>
+#endif
+
+/*!
+@file VCDCompressedInput.hpp
+@brief Decompression of gzip, zstd and xz compressed VCD files.
+*/
+
+//! Compression formats of an input file.
+enum class VCDCompression {
+    NONE, //!< Plain text
+    GZIP, //!< gzip, decoded with zlib
+    ZSTD, //!< Zstandard
+    XZ    //!< xz, decoded with liblzma
+};
+
+/*!
+@brief Return the compression format of data starting with the given bytes.
+@param magic in - The first bytes of the data.
+@param size in - Number of bytes at magic.
+*/
+inline VCDCompression vcd_detect_compression(const unsigned char* magic, std::size_t size) {
+  if (size >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+    return VCDCompression::GZIP;
+  }
+  if (size >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) {
+    return VCDCompression::ZSTD;
+  }
+  if (size >= 6 && std::memcmp(magic, "\xfd" "7zXZ\0", 6) == 0) {
+    return VCDCompression::XZ;
+  }
+  return VCDCompression::NONE;
+}
+
+//! Return the compression format of a file, NONE if it cannot be read.
+inline VCDCompression vcd_file_compression(const std::string& path) {
+  FILE* file = std::fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    return VCDCompression::NONE;
+  }
+  unsigned char magic[6] = {};
+  const std::size_t size = std::fread(magic, 1, sizeof(magic), file);
+  std::fclose(file);
+  return vcd_detect_compression(magic, size);
+}
+
+//! Return true if this build can decompress a format.
+inline bool vcd_compression_supported(VCDCompression compression) {
+  switch (compression) {
+    case VCDCompression::NONE:
+      return true;
+#if defined(VCD_PARSER_WITH_ZLIB)
+    case VCDCompression::GZIP:
+      return true;
+#endif
+#if defined(VCD_PARSER_WITH_ZSTD)
+    case VCDCompression::ZSTD:
+      return true;
+#endif
+#if defined(VCD_PARSER_WITH_LZMA)
+    case VCDCompression::XZ:
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+
+/*!
+@brief Reads a compressed file, decompressing it on a thread of its own.
+@details The thread decompresses into a ring of blocks, which read()
+hands out in order. Decompression thus overlaps with scanning, and stalls
+while all blocks are waiting to be read. Decoding errors end the data
+early and set failed().
+*/
+class VCDCompressedInput {
+
+public:
+  //! Bytes of decompressed data per block.
+  static constexpr std::size_t block_size = std::size_t(1) << 20;
+
+  //! Number of blocks in the ring.
+  static constexpr std::size_t block_count = 4;
+
+  VCDCompressedInput() = default;
+
+  VCDCompressedInput(const VCDCompressedInput&) = delete;
+  VCDCompressedInput& operator=(const VCDCompressedInput&) = delete;
+
+  ~VCDCompressedInput() {
+    close();
+  }
+
+  /*!
+  @brief Open a compressed file and start decompressing it.
+  @returns false if the file cannot be opened or the format is not
+  supported, error_message() tells why.
+  */
+  bool open(const std::string& path, VCDCompression compression) {
+    close();
+
+    if (compression == VCDCompression::NONE || !vcd_compression_supported(compression)) {
+      error = "compression format not supported by this build";
+      return false;
+    }
+
+    input = std::fopen(path.c_str(), "rb");
+    if (input == nullptr) {
+      error = std::strerror(errno);
+      return false;
+    }
+
+    for (Block& block : blocks) {
+      block.data.resize(block_size);
+    }
+    worker = std::thread([this, compression] { run(compression); });
+    return true;
+  }
+
+  /*!
+  @brief Copy up to size decompressed bytes to buffer, waiting for them.
+  @returns The number of bytes copied, 0 at the end of the data.
+  */
+  std::size_t read(char* buffer, std::size_t size) {
+    std::unique_lock<std::mutex> lock(mutex);
+    block_ready.wait(lock, [this] { return filled > 0 || finished; });
+    if (filled == 0) {
+      return 0;
+    }
+
+    // The producer does not touch a filled block, so copy it unlocked.
+    const Block& block = blocks[head];
+    lock.unlock();
+    const std::size_t count = std::min(size, block.size - read_offset);
+    std::memcpy(buffer, block.data.data() + read_offset, count);
+    read_offset += count;
+
+    if (read_offset == block.size) {
+      lock.lock();
+      read_offset = 0;
+      head = (head + 1) % block_count;
+      filled--;
+      block_free.notify_one();
+    }
+    return count;
+  }
+
+  //! Did decompression fail before the end of the data?
+  [[nodiscard]] bool failed() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return !error.empty();
+  }
+
+  //! Why open() or decompression failed.
+  [[nodiscard]] std::string error_message() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return error;
+  }
+
+  //! Stop decompressing and close the file.
+  void close() {
+    if (worker.joinable()) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+      }
+      block_free.notify_one();
+      worker.join();
+    }
+    if (input != nullptr) {
+      std::fclose(input);
+      input = nullptr;
+    }
+
+    head = tail = filled = read_offset = 0;
+    finished = stopping = false;
+    error.clear();
+  }
+
+protected:
+  //! Result of one decoding step.
+  enum class Step {
+    MORE,  //!< Call again
+    END,   //!< The compressed data ended
+    ERROR  //!< The data is damaged, error is set
+  };
+
+  //! Decompressed bytes and the number of valid ones.
+  struct Block {
+    std::vector<char> data;
+    std::size_t size = 0;
+  };
+
+  //! Thread body, decompress the file with the decoder of a format.
+  void run(VCDCompression compression) {
+    switch (compression) {
+#if defined(VCD_PARSER_WITH_ZLIB)
+      case VCDCompression::GZIP:
+        decode_gzip();
+        break;
+#endif
+#if defined(VCD_PARSER_WITH_ZSTD)
+      case VCDCompression::ZSTD:
+        decode_zstd();
+        break;
+#endif
+#if defined(VCD_PARSER_WITH_LZMA)
+      case VCDCompression::XZ:
+        decode_xz();
+        break;
+#endif
+      default:
+        finish("compression format not supported by this build");
+        break;
+    }
+  }
+
+  /*!
+  @brief Feed the file through a decoding step until the data ends.
+  @details step(in, in_size, at_eof, out, out_size) decodes some of the
+  in_size bytes at in into the out_size bytes at out, advancing both.
+  */
+  template <typename StepFunction>
+  void decode(StepFunction step) {
+    std::vector<unsigned char> compressed(block_size);
+    const unsigned char* in = compressed.data();
+    std::size_t in_size = 0;
+    bool at_eof = false;
+
+    char* out = acquire();
+    std::size_t out_size = block_size;
+
+    while (out != nullptr) {
+      if (in_size == 0 && !at_eof) {
+        in = compressed.data();
+        in_size = std::fread(compressed.data(), 1, compressed.size(), input);
+        if (in_size == 0) {
+          if (std::ferror(input)) {
+            finish("read error");
+            return;
+          }
+          at_eof = true;
+        }
+      }
+
+      const Step result = step(in, in_size, at_eof, out, out_size);
+      if (result == Step::ERROR) {
+        return;
+      }
+
+      if (out_size == 0 || result == Step::END) {
+        commit(block_size - out_size);
+        if (result == Step::END) {
+          break;
+        }
+        out = acquire();
+        out_size = block_size;
+      }
+    }
+
+    finish(std::string());
+  }
+
+#if defined(VCD_PARSER_WITH_ZLIB)
+  //! Decompress gzip data, including concatenated members.
+  void decode_gzip() {
+    z_stream stream{};
+    if (inflateInit2(&stream, 15 + 32) != Z_OK) {
+      finish("cannot initialize zlib");
+      return;
+    }
+
+    bool member_end = false;
+    decode([&](const unsigned char*& in, std::size_t& in_size, bool at_eof, char*& out, std::size_t& out_size) {
+      if (in_size == 0 && at_eof && member_end) {
+        return Step::END;
+      }
+
+      stream.next_in = const_cast<Bytef*>(in);
+      stream.avail_in = static_cast<uInt>(in_size);
+      stream.next_out = reinterpret_cast<Bytef*>(out);
+      stream.avail_out = static_cast<uInt>(out_size);
+
+      const int status = inflate(&stream, Z_NO_FLUSH);
+      const std::size_t consumed = in_size - stream.avail_in;
+      member_end = status == Z_STREAM_END || (member_end && consumed == 0);
+
+      in += consumed;
+      in_size = stream.avail_in;
+      const std::size_t produced = out_size - stream.avail_out;
+      out += produced;
+      out_size = stream.avail_out;
+
+      if (at_eof && consumed == 0 && produced == 0 && status != Z_STREAM_END) {
+        return fail("truncated gzip data");
+      }
+      if (status == Z_STREAM_END) {
+        inflateReset(&stream);
+      } else if (status != Z_OK && status != Z_BUF_ERROR) {
+        return fail(stream.msg != nullptr ? stream.msg : "damaged gzip data");
+      }
+      return Step::MORE;
+    });
+
+    inflateEnd(&stream);
+  }
+#endif
+
+#if defined(VCD_PARSER_WITH_ZSTD)
+  //! Decompress zstd data, including concatenated frames.
+  void decode_zstd() {
+    ZSTD_DCtx* context = ZSTD_createDCtx();
+    if (context == nullptr) {
+      finish("cannot initialize zstd");
+      return;
+    }
+
+    bool frame_end = false;
+    decode([&](const unsigned char*& in, std::size_t& in_size, bool at_eof, char*& out, std::size_t& out_size) {
+      if (in_size == 0 && at_eof && frame_end) {
+        return Step::END;
+      }
+
+      ZSTD_inBuffer source{in, in_size, 0};
+      ZSTD_outBuffer target{out, out_size, 0};
+      const std::size_t status = ZSTD_decompressStream(context, &target, &source);
+      if (ZSTD_isError(status)) {
+        return fail(ZSTD_getErrorName(status));
+      }
+      if (at_eof && source.pos == 0 && target.pos == 0 && status != 0) {
+        return fail("truncated zstd data");
+      }
+      frame_end = status == 0;
+
+      in += source.pos;
+      in_size -= source.pos;
+      out += target.pos;
+      out_size -= target.pos;
+      return Step::MORE;
+    });
+
+    ZSTD_freeDCtx(context);
+  }
+#endif
+
+#if defined(VCD_PARSER_WITH_LZMA)
+  //! Decompress xz data, including concatenated streams.
+  void decode_xz() {
+    lzma_stream stream = LZMA_STREAM_INIT;
+    if (lzma_stream_decoder(&stream, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK) {
+      finish("cannot initialize liblzma");
+      return;
+    }
+
+    decode([&](const unsigned char*& in, std::size_t& in_size, bool at_eof, char*& out, std::size_t& out_size) {
+      stream.next_in = in;
+      stream.avail_in = in_size;
+      stream.next_out = reinterpret_cast<uint8_t*>(out);
+      stream.avail_out = out_size;
+
+      const lzma_ret status = lzma_code(&stream, at_eof ? LZMA_FINISH : LZMA_RUN);
+
+      in += in_size - stream.avail_in;
+      in_size = stream.avail_in;
+      out += out_size - stream.avail_out;
+      out_size = stream.avail_out;
+
+      if (status == LZMA_STREAM_END) {
+        return Step::END;
+      }
+      if (status != LZMA_OK && !(status == LZMA_BUF_ERROR && !at_eof)) {
+        return fail(status == LZMA_BUF_ERROR ? "truncated xz data" : "damaged xz data");
+      }
+      return Step::MORE;
+    });
+
+    lzma_end(&stream);
+  }
+#endif
+
+  //! Wait for a free block and return its data, nullptr when stopping.
+  char* acquire() {
+    std::unique_lock<std::mutex> lock(mutex);
+    block_free.wait(lock, [this] { return filled < block_count || stopping; });
+    return stopping ? nullptr : blocks[tail].data.data();
+  }
+
+  //! Hand the block returned by acquire() to the reader.
+  void commit(std::size_t size) {
+    if (size == 0) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    blocks[tail].size = size;
+    tail = (tail + 1) % block_count;
+    filled++;
+    block_ready.notify_one();
+  }
+
+  //! End the data, with an error message if decoding failed.
+  void finish(const std::string& message) {
+    std::lock_guard<std::mutex> lock(mutex);
+    error = message;
+    finished = true;
+    block_ready.notify_one();
+  }
+
+  //! End the data because decoding failed.
+  Step fail(const std::string& message) {
+    finish(message);
+    return Step::ERROR;
+  }
+
+  //! The compressed file.
+  FILE* input = nullptr;
+
+  //! Decompresses the file into blocks.
+  std::thread worker;
+
+  //! Guards all members below.
+  std::mutex mutex;
+
+  //! Signalled when a block was filled or the data ended.
+  std::condition_variable block_ready;
+
+  //! Signalled when a block was read or decompression should stop.
+  std::condition_variable block_free;
+
+  //! The ring of blocks.
+  std::array<Block, block_count> blocks;
+
+  //! Next block to read.
+  std::size_t head = 0;
+
+  //! Next block to fill.
+  std::size_t tail = 0;
+
+  //! Number of filled blocks.
+  std::size_t filled = 0;
+
+  //! Bytes of the head block already read.
+  std::size_t read_offset = 0;
+
+  //! Has the decompressor thread ended the data?
+  bool finished = false;
+
+  //! Should the decompressor thread stop?
+  bool stopping = false;
+
+  //! Why decompression failed, empty if it did not.
+  std::string error;
+};
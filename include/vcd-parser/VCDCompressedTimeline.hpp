@@ -0,0 +1,523 @@
+#pragma once
+
+#include <vcd-parser/VCDPackedVector.hpp>
+#include <vcd-parser/VCDTimedValue.hpp>
+#include <vcd-parser/VCDTimeline.hpp>
+#include <vcd-parser/VCDTypes.hpp>
+#include <vcd-parser/VCDValue.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/*!
+@file VCDCompressedTimeline.hpp
+@brief Read-only, compressed copy of a VCDTimeline.
+*/
+
+/*!
+@brief The values of one signal, compressed in blocks of block_size values.
+@details Each block header holds the time of its first value and the
+offsets of its data, so a point query binary searches the headers and
+decodes a single block. Within a block, times are stored as varint deltas
+and values as runs of codes. The code of a scalar is the VCDBit itself.
+Vectors, reals and generic values are replaced by their index in a
+dictionary of distinct values; if most values are distinct, they are
+kept in order instead and no runs are stored. Iteration decodes one
+block at a time.
+*/
+class VCDCompressedTimeline {
+
+public:
+  //! Number of values per block.
+  static constexpr std::size_t block_size = 128;
+
+  //! Returned by find() if no value exists at the requested time.
+  static constexpr std::size_t npos = VCDTimeline::npos;
+
+  //! Times and codes of one decoded block.
+  struct DecodedBlock {
+    std::size_t block = npos;
+    std::size_t count = 0;
+    VCDTime times[block_size];
+    std::size_t codes[block_size];
+  };
+
+  /*!
+  @brief Forward iterator over the elements, decoding a block at a time.
+  @details Copies share the decoded block until one of them moves to
+  another block.
+  */
+  class const_iterator {
+
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = VCDTimedValue;
+    using difference_type = std::ptrdiff_t;
+    using reference = VCDTimedValue;
+    using pointer = VCDTimeline::const_iterator::pointer;
+
+    const_iterator() = default;
+
+    const_iterator(const VCDCompressedTimeline* timeline, std::size_t index) : owner(timeline), pos(index) {}
+
+    reference operator*() const {
+      const DecodedBlock& decoded = load();
+      return {decoded.times[pos % block_size], owner->dictionary_value(decoded.codes[pos % block_size])};
+    }
+
+    pointer operator->() const { return {**this}; }
+
+    const_iterator& operator++() { ++pos; return *this; }
+    const_iterator operator++(int) { auto old = *this; ++pos; return old; }
+
+    friend bool operator==(const const_iterator& a, const const_iterator& b) { return a.pos == b.pos; }
+    friend bool operator!=(const const_iterator& a, const const_iterator& b) { return a.pos != b.pos; }
+
+    //! Time of the element, without building its value.
+    [[nodiscard]] VCDTime time() const {
+      return load().times[pos % block_size];
+    }
+
+    //! Index of the element in the timeline.
+    [[nodiscard]] std::size_t index() const { return pos; }
+
+  protected:
+    //! Decode the block holding pos, unless it is decoded already.
+    const DecodedBlock& load() const {
+      const std::size_t block = pos / block_size;
+      if (!decoded || decoded->block != block) {
+        if (!decoded || decoded.use_count() > 1) {
+          decoded = std::make_shared<DecodedBlock>();
+        }
+        owner->decode(block, *decoded);
+      }
+      return *decoded;
+    }
+
+    const VCDCompressedTimeline* owner = nullptr;
+    std::size_t pos = 0;
+    mutable std::shared_ptr<DecodedBlock> decoded;
+  };
+
+  using iterator = const_iterator;
+  using value_type = VCDTimedValue;
+  using size_type = std::size_t;
+
+  VCDCompressedTimeline() = default;
+
+  //! Compress the values of a timeline.
+  explicit VCDCompressedTimeline(const VCDTimeline& timeline)
+      : column(timeline.column_type()),
+        width(timeline.vector_width()),
+        stride(2 * timeline.vector_words()),
+        count(timeline.size()) {
+    const std::vector<std::size_t> codes = build_dictionary(timeline);
+
+    blocks.reserve((count + block_size - 1) / block_size);
+    for (std::size_t first = 0; first < count; first += block_size) {
+      const std::size_t last = std::min(count, first + block_size);
+      blocks.push_back({timeline.time_at(first), time_bytes.size(), value_bytes.size()});
+
+      for (std::size_t i = first + 1; i < last; ++i) {
+        const uint64_t delta = static_cast<uint64_t>(timeline.time_at(i)) - static_cast<uint64_t>(timeline.time_at(i - 1));
+        write_varint(time_bytes, zigzag(static_cast<int64_t>(delta)));
+      }
+
+      // Runs end at the block boundary, so every block decodes on its own.
+      for (std::size_t i = first; i < last && !literal;) {
+        std::size_t j = i + 1;
+        while (j < last && codes[j] == codes[i]) {
+          j++;
+        }
+        write_varint(value_bytes, codes[i]);
+        write_varint(value_bytes, j - i - 1);
+        i = j;
+      }
+    }
+
+    time_bytes.shrink_to_fit();
+    value_bytes.shrink_to_fit();
+  }
+
+  //! Return a timeline holding the same values.
+  [[nodiscard]] VCDTimeline decompress() const {
+    VCDTimeline timeline;
+    timeline.column = column;
+    if (column == VCDColumnType::VECTOR) {
+      timeline.set_width(width);
+    }
+    timeline.reserve(count);
+    for (const VCDTimedValue& element : *this) {
+      timeline.push_back(element);
+    }
+    return timeline;
+  }
+
+  //! How the values were stored before compression.
+  [[nodiscard]] VCDColumnType column_type() const {
+    return column;
+  }
+
+  //! Width in bits of the values of a VECTOR column.
+  [[nodiscard]] std::size_t vector_width() const {
+    return width;
+  }
+
+  //! Number of values.
+  [[nodiscard]] std::size_t size() const {
+    return count;
+  }
+
+  //! Is the timeline empty?
+  [[nodiscard]] bool empty() const {
+    return count == 0;
+  }
+
+  //! Estimate the heap bytes held by the timeline, including unused capacity.
+  [[nodiscard]] std::size_t memory_usage() const {
+    std::size_t bytes = blocks.capacity() * sizeof(Block) + time_bytes.capacity() + value_bytes.capacity() +
+                        dictionary_words.capacity() * sizeof(uint64_t) + dictionary_reals.capacity() * sizeof(VCDReal) +
+                        dictionary_values.capacity() * sizeof(VCDValue);
+    for (const VCDValue& value : dictionary_values) {
+      if (value.get_type() == VCDValueType::VECTOR && value.get_value_packed().width() > VCDPackedVector::inline_bits) {
+        bytes += 2 * value.get_value_packed().words() * sizeof(uint64_t);
+      }
+    }
+    return bytes;
+  }
+
+  //! Time of the value at index i, decodes the deltas before it in its block.
+  [[nodiscard]] VCDTime time_at(std::size_t i) const {
+    const Block& header = blocks[i / block_size];
+    const uint8_t* t = time_bytes.data() + header.time_offset;
+    uint64_t time = static_cast<uint64_t>(header.first_time);
+    for (std::size_t k = i % block_size; k > 0; --k) {
+      time += static_cast<uint64_t>(unzigzag(read_varint(t)));
+    }
+    return static_cast<VCDTime>(time);
+  }
+
+  //! Value at index i, decodes the runs before it in its block.
+  [[nodiscard]] VCDValue value_at(std::size_t i) const {
+    if (literal) {
+      return dictionary_value(i);
+    }
+    const uint8_t* v = value_bytes.data() + blocks[i / block_size].value_offset;
+    for (std::size_t k = i % block_size;;) {
+      const auto code = static_cast<std::size_t>(read_varint(v));
+      const auto run = static_cast<std::size_t>(read_varint(v)) + 1;
+      if (k < run) {
+        return dictionary_value(code);
+      }
+      k -= run;
+    }
+  }
+
+  //! Time and value at index i, decodes one block.
+  VCDTimedValue operator[](std::size_t i) const {
+    return *const_iterator(this, i);
+  }
+
+  //! First time and value.
+  [[nodiscard]] VCDTimedValue front() const {
+    return (*this)[0];
+  }
+
+  //! Last time and value.
+  [[nodiscard]] VCDTimedValue back() const {
+    return (*this)[count - 1];
+  }
+
+  [[nodiscard]] const_iterator begin() const {
+    return {this, 0};
+  }
+
+  [[nodiscard]] const_iterator end() const {
+    return {this, count};
+  }
+
+  /*!
+  @brief Return the index of the value in effect at a time.
+  @details Binary search of the block headers, then a scan of one block.
+  @returns The index, or npos if t is before the first value.
+  */
+  [[nodiscard]] std::size_t find(VCDTime t) const {
+    const std::size_t n = upper_index(t);
+    return n == 0 ? npos : n - 1;
+  }
+
+  /*!
+  @brief Return the values with first <= time < last.
+  */
+  [[nodiscard]] std::pair<const_iterator, const_iterator> range(VCDTime first, VCDTime last) const {
+    const std::size_t lo = lower_index(first);
+    return {{this, lo}, {this, std::max(lo, lower_index(last))}};
+  }
+
+  //! Decode the times and codes of a block.
+  void decode(std::size_t block, DecodedBlock& decoded) const {
+    const Block& header = blocks[block];
+    decoded.block = block;
+    decoded.count = std::min(block_size, count - block * block_size);
+
+    const uint8_t* t = time_bytes.data() + header.time_offset;
+    uint64_t time = static_cast<uint64_t>(header.first_time);
+    decoded.times[0] = header.first_time;
+    for (std::size_t i = 1; i < decoded.count; ++i) {
+      time += static_cast<uint64_t>(unzigzag(read_varint(t)));
+      decoded.times[i] = static_cast<VCDTime>(time);
+    }
+
+    if (literal) {
+      for (std::size_t i = 0; i < decoded.count; ++i) {
+        decoded.codes[i] = block * block_size + i;
+      }
+      return;
+    }
+
+    const uint8_t* v = value_bytes.data() + header.value_offset;
+    for (std::size_t i = 0; i < decoded.count;) {
+      const auto code = static_cast<std::size_t>(read_varint(v));
+      const auto run = static_cast<std::size_t>(read_varint(v)) + 1;
+      std::fill_n(decoded.codes + i, std::min(run, decoded.count - i), code);
+      i += run;
+    }
+  }
+
+  //! Value of a code of a decoded block.
+  [[nodiscard]] VCDValue dictionary_value(std::size_t code) const {
+    switch (column) {
+      case VCDColumnType::SCALAR:
+        return VCDValue(static_cast<VCDBit>(code));
+      case VCDColumnType::VECTOR: {
+        const uint64_t* planes = dictionary_words.data() + code * stride;
+        return VCDValue(VCDPackedVector(width, planes, planes + stride / 2));
+      }
+      case VCDColumnType::REAL:
+        return VCDValue(dictionary_reals[code]);
+      case VCDColumnType::GENERIC:
+      default:
+        return dictionary_values[code];
+    }
+  }
+
+protected:
+  //! Skip header of a block.
+  struct Block {
+    VCDTime first_time;
+    uint64_t time_offset;
+    uint64_t value_offset;
+  };
+
+  static uint64_t zigzag(int64_t v) {
+    return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+  }
+
+  static int64_t unzigzag(uint64_t v) {
+    return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+  }
+
+  static void write_varint(std::vector<uint8_t>& out, uint64_t v) {
+    while (v >= 0x80) {
+      out.push_back(static_cast<uint8_t>(v | 0x80));
+      v >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(v));
+  }
+
+  static uint64_t read_varint(const uint8_t*& in) {
+    uint64_t v = 0;
+    for (unsigned shift = 0;; shift += 7) {
+      const uint8_t byte = *in++;
+      v |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if (byte < 0x80) {
+        return v;
+      }
+    }
+  }
+
+  //! Are a and b the same value? VCDComparisons.hpp depends on this header.
+  static bool same_value(const VCDValue& a, const VCDValue& b) {
+    if (a.get_type() != b.get_type()) {
+      return false;
+    }
+    switch (a.get_type()) {
+      case VCDValueType::SCALAR:
+        return a.get_value_bit() == b.get_value_bit();
+      case VCDValueType::VECTOR:
+        return a.get_value_packed() == b.get_value_packed();
+      case VCDValueType::REAL:
+        return a.get_value_real() == b.get_value_real();
+      case VCDValueType::EMPTY:
+      default:
+        return true;
+    }
+  }
+
+  /*!
+  @brief Fill the dictionary of a timeline.
+  @returns The code of every value.
+  */
+  std::vector<std::size_t> build_dictionary(const VCDTimeline& timeline) {
+    std::vector<std::size_t> codes(count);
+    std::size_t distinct = 0;
+
+    switch (column) {
+      case VCDColumnType::SCALAR:
+        for (std::size_t i = 0; i < count; ++i) {
+          codes[i] = static_cast<std::size_t>(timeline.scalar_at(i));
+        }
+        return codes;
+      case VCDColumnType::VECTOR: {
+        std::unordered_map<std::string, std::size_t> seen;
+        for (std::size_t i = 0; i < count; ++i) {
+          const uint64_t* planes = timeline.vector_words_at(i);
+          const auto [it, added] = seen.emplace(
+              std::string(reinterpret_cast<const char*>(planes), stride * sizeof(uint64_t)), seen.size());
+          if (added) {
+            dictionary_words.insert(dictionary_words.end(), planes, planes + stride);
+          }
+          codes[i] = it->second;
+        }
+        distinct = seen.size();
+        break;
+      }
+      case VCDColumnType::REAL: {
+        std::unordered_map<uint64_t, std::size_t> seen;
+        for (std::size_t i = 0; i < count; ++i) {
+          const VCDReal real = timeline.real_at(i);
+          uint64_t bits = 0;
+          std::memcpy(&bits, &real, sizeof(bits));
+          const auto [it, added] = seen.emplace(bits, seen.size());
+          if (added) {
+            dictionary_reals.push_back(real);
+          }
+          codes[i] = it->second;
+        }
+        distinct = seen.size();
+        break;
+      }
+      case VCDColumnType::GENERIC:
+        // VCDValue has no hash, so only repeated values share an entry.
+        for (std::size_t i = 0; i < count; ++i) {
+          VCDValue value = timeline.value_at(i);
+          if (dictionary_values.empty() || !same_value(dictionary_values.back(), value)) {
+            dictionary_values.push_back(std::move(value));
+          }
+          codes[i] = dictionary_values.size() - 1;
+        }
+        distinct = dictionary_values.size();
+        break;
+    }
+
+    if (2 * distinct > count) {
+      // Codes and runs would cost more than they save.
+      literal = true;
+      dictionary_words.clear();
+      dictionary_reals.clear();
+      dictionary_values.clear();
+      for (std::size_t i = 0; i < count; ++i) {
+        switch (column) {
+          case VCDColumnType::VECTOR:
+            dictionary_words.insert(dictionary_words.end(), timeline.vector_words_at(i), timeline.vector_words_at(i) + stride);
+            break;
+          case VCDColumnType::REAL:
+            dictionary_reals.push_back(timeline.real_at(i));
+            break;
+          default:
+            dictionary_values.push_back(timeline.value_at(i));
+            break;
+        }
+      }
+    }
+
+    dictionary_words.shrink_to_fit();
+    dictionary_reals.shrink_to_fit();
+    dictionary_values.shrink_to_fit();
+    return codes;
+  }
+
+  /*!
+  @brief Count the values of a block until one fails a predicate on its time.
+  @returns The index after the last value passing, in the whole timeline.
+  */
+  template <typename Predicate>
+  [[nodiscard]] std::size_t scan_block(std::size_t block, Predicate passes) const {
+    const Block& header = blocks[block];
+    const std::size_t first = block * block_size;
+    const std::size_t n = std::min(block_size, count - first);
+
+    const uint8_t* t = time_bytes.data() + header.time_offset;
+    uint64_t time = static_cast<uint64_t>(header.first_time);
+    for (std::size_t i = 0; i < n; ++i) {
+      if (i > 0) {
+        time += static_cast<uint64_t>(unzigzag(read_varint(t)));
+      }
+      if (!passes(static_cast<VCDTime>(time))) {
+        return first + i;
+      }
+    }
+    return first + n;
+  }
+
+  //! Number of values with a time not after t.
+  [[nodiscard]] std::size_t upper_index(VCDTime t) const {
+    const auto it = std::upper_bound(blocks.begin(), blocks.end(), t,
+                                     [](VCDTime time, const Block& b) { return time < b.first_time; });
+    if (it == blocks.begin()) {
+      return 0;
+    }
+    return scan_block(static_cast<std::size_t>(it - blocks.begin()) - 1, [t](VCDTime time) { return time <= t; });
+  }
+
+  //! Number of values with a time before t.
+  [[nodiscard]] std::size_t lower_index(VCDTime t) const {
+    const auto it = std::lower_bound(blocks.begin(), blocks.end(), t,
+                                     [](const Block& b, VCDTime time) { return b.first_time < time; });
+    if (it == blocks.begin()) {
+      return 0;
+    }
+    return scan_block(static_cast<std::size_t>(it - blocks.begin()) - 1, [t](VCDTime time) { return time < t; });
+  }
+
+  //! How the values were stored before compression.
+  VCDColumnType column = VCDColumnType::GENERIC;
+
+  //! Width of the values of a VECTOR column.
+  std::size_t width = 0;
+
+  //! Words per value of a VECTOR column, both planes.
+  std::size_t stride = 0;
+
+  //! Number of values.
+  std::size_t count = 0;
+
+  //! Values are stored in order, the code of a value is its index.
+  bool literal = false;
+
+  //! Skip headers, one per block.
+  std::vector<Block> blocks;
+
+  //! Varint time deltas of all blocks.
+  std::vector<uint8_t> time_bytes;
+
+  //! Varint code and run length pairs of all blocks.
+  std::vector<uint8_t> value_bytes;
+
+  //! Distinct values of a VECTOR column, stride words each.
+  std::vector<uint64_t> dictionary_words;
+
+  //! Distinct values of a REAL column.
+  std::vector<VCDReal> dictionary_reals;
+
+  //! Distinct values of a GENERIC column.
+  std::vector<VCDValue> dictionary_values;
+};
@@ -0,0 +1,504 @@
+#pragma once
+
+#include <vcd-parser/VCDComparisons.hpp>
+#include <vcd-parser/VCDCompressedInput.hpp>
+#include <vcd-parser/VCDFile.hpp>
+#include <vcd-parser/VCDFileBuilder.hpp>
+#include <vcd-parser/VCDFileParser.hpp>
+#include <vcd-parser/VCDMappedFile.hpp>
+#include <vcd-parser/VCDTimeline.hpp>
+#include <vcd-parser/VCDTypes.hpp>
+#include <vcd-parser/VCDValue.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*!
+@file VCDDiff.hpp
+@brief Comparison of the signal values of two VCD files.
+*/
+
+//! A time at which the values of a signal in two files start to differ.
+struct VCDDivergence {
+  VCDTime time;    //!< Start of the difference
+  VCDValue left;   //!< Value in the left file, EMPTY if the signal has none yet
+  VCDValue right;  //!< Value in the right file, EMPTY if the signal has none yet
+};
+
+//! The differences of a signal declared in both files.
+struct VCDSignalDiff {
+  std::string path;                        //!< Hierarchical path, e.g. "testbench.uut.clk"
+  std::vector<VCDDivergence> divergences;  //!< In time order, only the first unless VCDDiff::all_divergences
+};
+
+//! Everything VCDDiff::compare() found.
+struct VCDDiffResult {
+  //! Paths of the signals only declared in the left file.
+  std::vector<std::string> only_left;
+
+  //! Paths of the signals only declared in the right file.
+  std::vector<std::string> only_right;
+
+  //! Signals declared in both files whose values differ, sorted by path.
+  std::vector<VCDSignalDiff> signals;
+
+  //! Do the $timescale sections differ? Times are compared as they are.
+  bool timescales_differ = false;
+
+  //! Did compare() stop early, see VCDDiff::early_exit?
+  bool stopped_early = false;
+
+  //! Are the files equal in everything compared?
+  [[nodiscard]] bool identical() const {
+    return only_left.empty() && only_right.empty() && signals.empty() && !timescales_differ;
+  }
+};
+
+/*!
+@brief Compares the values of the signals of two files, matched by hierarchical path.
+@details Both files are parsed in steps of about step bytes, the file
+whose last parsed time is behind first. After each step, the values of
+all matched signals up to the time both files reached are compared, one
+signal per task on threads threads, and then dropped. The threads are
+started once per compare() and wait for the next step in between. Only a step of
+each file is held in memory. Values are compared as functions of time,
+so repeated assignments of the same value make no difference. Files
+which cannot be memory mapped, such as compressed ones, are parsed as a
+whole first.
+*/
+class VCDDiff {
+
+public:
+  /*!
+  @brief Create a diff engine.
+  @param settings in - A parser whose settings, including the selection, are used for both files.
+  */
+  explicit VCDDiff(const VCDFileParser& settings = VCDFileParser()) {
+    parser_settings.copy_settings(settings);
+  }
+
+  /*!
+  @brief Compare two files.
+  @param left in - The reference, e.g. the golden trace.
+  @param right in - The file compared against it.
+  @param result out - The differences.
+  @returns false if a file cannot be parsed.
+  */
+  bool compare(const std::string& left, const std::string& right, VCDDiffResult& result) {
+    result = VCDDiffResult();
+    Input a;
+    Input b;
+    if (!open(a, left) || !open(b, right)) {
+      return false;
+    }
+
+    const VCDFile& file_a = *a.builder.get_file();
+    const VCDFile& file_b = *b.builder.get_file();
+    result.timescales_differ = file_a.time_units != file_b.time_units || file_a.time_resolution != file_b.time_resolution;
+
+    std::vector<Pair> pairs = match(file_a, file_b, result);
+
+    unsigned workers = threads == 0 ? std::thread::hardware_concurrency() : threads;
+    workers = static_cast<unsigned>(
+        std::min<std::size_t>(std::max(workers, 1u), std::max<std::size_t>(pairs.size(), 1)));
+    WorkerPool pool(workers);
+
+    VCDTime from = std::numeric_limits<VCDTime>::min();
+    bool found = false;
+    while (true) {
+      const bool last = a.finished && b.finished;
+      const VCDTime to = std::min(a.horizon(), b.horizon());
+      if (to > from || last) {
+        found = compare_step(pool, pairs, a, b, from, to, last) || found;
+        a.builder.trim(to);
+        b.builder.trim(to);
+        from = to;
+      }
+      if (last) {
+        break;
+      }
+      if (found && early_exit) {
+        result.stopped_early = true;
+        break;
+      }
+      Input& behind = b.finished || (!a.finished && a.horizon() <= b.horizon()) ? a : b;
+      if (!advance(behind)) {
+        return false;
+      }
+    }
+
+    for (Pair& pair : pairs) {
+      if (!pair.diff.divergences.empty()) {
+        result.signals.push_back(std::move(pair.diff));
+      }
+    }
+    return true;
+  }
+
+  //! Report every time the values of a signal start to differ, not only the first.
+  bool all_divergences = false;
+
+  //! Stop after the first step in which any signal differs.
+  bool early_exit = false;
+
+  //! Real values differing by at most this much are equal.
+  VCDReal real_tolerance = 0;
+
+  //! Threads comparing signals, 0 for one per core.
+  unsigned threads = 0;
+
+  //! Bytes of each file parsed per step.
+  std::size_t step = std::size_t(4) << 20;
+
+protected:
+  //! Threads kept for all steps of a compare(), the calling thread works along.
+  class WorkerPool {
+
+  public:
+    //! Start count - 1 threads waiting for a task.
+    explicit WorkerPool(unsigned count) {
+      for (unsigned w = 1; w < count; ++w) {
+        pool.emplace_back([this] { work(); });
+      }
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    ~WorkerPool() {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+      }
+      task_ready.notify_all();
+      for (std::thread& t : pool) {
+        t.join();
+      }
+    }
+
+    //! Run task on every thread and the calling one, returning when all have finished it.
+    void run(const std::function<void()>& task) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        current = &task;
+        busy = pool.size();
+        generation++;
+      }
+      task_ready.notify_all();
+      task();
+
+      std::unique_lock<std::mutex> lock(mutex);
+      task_done.wait(lock, [this] { return busy == 0; });
+      current = nullptr;
+    }
+
+  protected:
+    //! Run each new task until the pool is destroyed.
+    void work() {
+      uint64_t seen = 0;
+      for (;;) {
+        const std::function<void()>* task = nullptr;
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          task_ready.wait(lock, [&] { return stopping || generation != seen; });
+          if (stopping) {
+            return;
+          }
+          seen = generation;
+          task = current;
+        }
+        (*task)();
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--busy == 0) {
+          task_done.notify_one();
+        }
+      }
+    }
+
+    //! The threads besides the calling one.
+    std::vector<std::thread> pool;
+    //! Guards the members below.
+    std::mutex mutex;
+    //! Signalled when a task is handed out or the pool stops.
+    std::condition_variable task_ready;
+    //! Signalled when the last thread finishes the current task.
+    std::condition_variable task_done;
+    //! The task of the current step, set while run() waits.
+    const std::function<void()>* current = nullptr;
+    //! Number of tasks handed out, tells the threads a new one is ready.
+    uint64_t generation = 0;
+    //! Threads still running the current task.
+    std::size_t busy = 0;
+    //! Set by the destructor to end the threads.
+    bool stopping = false;
+  };
+
+  //! Builds the header of a file, keeping the values of one step in timelines.
+  class StepBuilder : public VCDFileBuilder {
+
+  public:
+    void on_header_done() override {
+      timelines.reserve(fh->get_signal_index_count());
+      for (VCDSignalIndex i = 0; i < fh->get_signal_index_count(); ++i) {
+        timelines.push_back(fh->get_signal_values(i));
+      }
+    }
+
+    void on_undeclared(VCDSignalIndex index, std::string_view hash) override {
+      VCDFileBuilder::on_undeclared(index, hash);
+      if (index >= timelines.size()) {
+        timelines.resize(index + 1);
+      }
+    }
+
+    void on_timestamp(VCDTime time) override {
+      last_time = time;
+    }
+
+    void on_scalar_change(VCDTime time, VCDSignalIndex index, VCDBit value) override {
+      timelines[index].push_back(time, value);
+    }
+
+    void on_vector_change(VCDTime time, VCDSignalIndex index, std::string_view digits) override {
+      timelines[index].push_back_ascii(time, digits.data(), digits.size());
+    }
+
+    void on_real_change(VCDTime time, VCDSignalIndex index, VCDReal value) override {
+      timelines[index].push_back(time, value);
+    }
+
+    //! Drop the values before time, except the one in effect at time.
+    void trim(VCDTime time) {
+      for (VCDTimeline& timeline : timelines) {
+        const std::size_t before = timeline.range(time, time).first.index();
+        if (before > 1) {
+          timeline.erase_front(before - 1);
+        }
+      }
+    }
+
+    //! Values of the signals not compared yet, and the value in effect before them.
+    std::vector<VCDTimeline> timelines;
+
+    //! The last #time parsed.
+    VCDTime last_time = std::numeric_limits<VCDTime>::min();
+  };
+
+  //! A file being parsed step by step.
+  struct Input {
+    VCDFileParser parser;
+    StepBuilder builder;
+    VCDMappedFile mapped;
+    std::vector<char> buffer;
+
+    //! Offsets of the steps of the value change section.
+    std::vector<std::size_t> bounds;
+
+    //! Index in bounds of the next step.
+    std::size_t next = 0;
+
+    //! Has the whole file been parsed?
+    bool finished = false;
+
+    //! Values before this time are complete.
+    [[nodiscard]] VCDTime horizon() const {
+      // The next step may continue the last #time, if it is repeated.
+      return finished ? std::numeric_limits<VCDTime>::max() : builder.last_time;
+    }
+  };
+
+  //! A signal declared in both files.
+  struct Pair {
+    VCDSignalIndex left;
+    VCDSignalIndex right;
+    VCDSignalDiff diff;
+
+    //! Were the values equal after the last change compared?
+    bool equal = true;
+
+    //! Is nothing left to find for this signal?
+    bool done = false;
+  };
+
+  //! Parse the header of a file and prepare its steps, or parse it entirely.
+  bool open(Input& input, const std::string& path) {
+    input.parser.copy_settings(parser_settings);
+    input.parser.threads = 1;
+    input.parser.use_cache = false;
+    input.parser.filepath = path;
+
+    const bool mapped = parser_settings.memory_map && input.mapped.open(path) &&
+        vcd_detect_compression(reinterpret_cast<const unsigned char*>(input.mapped.data()), input.mapped.size()) ==
+            VCDCompression::NONE;
+    if (!mapped) {
+      input.finished = true;
+      return input.parser.parse_file(path, input.builder);
+    }
+
+    const char* data = input.mapped.data();
+    const std::size_t body = VCDFileParser::header_size(data, input.mapped.size());
+    if (body == 0) {
+      input.parser.error("No $enddefinitions in " + path);
+      return false;
+    }
+
+    input.parser.reset(input.builder);
+    if (!input.parser.parse_buffer(data, body, input.buffer)) {
+      return false;
+    }
+
+    const std::size_t steps = std::max<std::size_t>((input.mapped.size() - body) / std::max<std::size_t>(step, 1), 1);
+    input.bounds = VCDFileParser::chunk_bounds(data, body, input.mapped.size(), steps);
+    input.finished = input.bounds.size() < 2;
+    return true;
+  }
+
+  //! Parse the next step of a file.
+  static bool advance(Input& input) {
+    const std::size_t k = input.next++;
+    // The driver state carries over, so each step continues the previous one.
+    if (!input.parser.parse_buffer(input.mapped.data() + input.bounds[k], input.bounds[k + 1] - input.bounds[k],
+                                   input.buffer)) {
+      return false;
+    }
+    input.finished = input.next + 1 >= input.bounds.size();
+    return true;
+  }
+
+  //! Match the signals of two files by path, listing those declared in one file only.
+  static std::vector<Pair> match(const VCDFile& a, const VCDFile& b, VCDDiffResult& result) {
+    std::map<std::string, VCDSignalIndex> left;
+    for (const VCDSignal& signal : a.get_signals()) {
+      left.emplace(a.get_signal_path(signal), signal.index);
+    }
+    std::map<std::string, VCDSignalIndex> right;
+    for (const VCDSignal& signal : b.get_signals()) {
+      right.emplace(b.get_signal_path(signal), signal.index);
+    }
+
+    std::vector<Pair> pairs;
+    for (const auto& [path, index] : left) {
+      auto other = right.find(path);
+      if (other == right.end()) {
+        result.only_left.push_back(path);
+      } else {
+        Pair pair{index, other->second, {path, {}}};
+        pairs.push_back(std::move(pair));
+      }
+    }
+    for (const auto& [path, index] : right) {
+      if (left.count(path) == 0) {
+        result.only_right.push_back(path);
+      }
+    }
+    return pairs;
+  }
+
+  /*!
+  @brief Compare the values of all pairs with from <= time < to.
+  @param last in - Compare all remaining values, both files are parsed.
+  @returns true if any signal was found to differ.
+  */
+  bool compare_step(WorkerPool& pool, std::vector<Pair>& pairs, const Input& a, const Input& b, VCDTime from,
+                    VCDTime to, bool last) {
+    std::atomic<bool> found{false};
+    const std::function<void()> compare_all = [&]() {
+      for (std::size_t i = next_pair++; i < pairs.size(); i = next_pair++) {
+        if (compare_signal(pairs[i], a.builder.timelines[pairs[i].left], b.builder.timelines[pairs[i].right], from, to,
+                           last)) {
+          found = true;
+        }
+      }
+    };
+
+    next_pair = 0;
+    pool.run(compare_all);
+    return found;
+  }
+
+  /*!
+  @brief Compare the values of one signal with from <= time < to.
+  @returns true if the values differ from a time in the range on.
+  */
+  bool compare_signal(Pair& pair, const VCDTimeline& x, const VCDTimeline& y, VCDTime from, VCDTime to,
+                      bool last) const {
+    if (pair.done) {
+      return false;
+    }
+
+    const auto [x_lo, x_hi] = x.range(from, to);
+    const auto [y_lo, y_hi] = y.range(from, to);
+    std::size_t i = x_lo.index();
+    std::size_t j = y_lo.index();
+    const std::size_t i_end = last ? x.size() : x_hi.index();
+    const std::size_t j_end = last ? y.size() : y_hi.index();
+    std::size_t x_current = i == 0 ? VCDTimeline::npos : i - 1;
+    std::size_t y_current = j == 0 ? VCDTimeline::npos : j - 1;
+
+    bool found = false;
+    while (i < i_end || j < j_end) {
+      const VCDTime t = std::min(i < i_end ? x.time_at(i) : std::numeric_limits<VCDTime>::max(),
+                                 j < j_end ? y.time_at(j) : std::numeric_limits<VCDTime>::max());
+      for (; i < i_end && x.time_at(i) == t; ++i) {
+        x_current = i;
+      }
+      for (; j < j_end && y.time_at(j) == t; ++j) {
+        y_current = j;
+      }
+
+      const bool equal = same(x, x_current, y, y_current);
+      if (!equal && pair.equal) {
+        pair.diff.divergences.push_back({t, value_or_empty(x, x_current), value_or_empty(y, y_current)});
+        found = true;
+        if (!all_divergences) {
+          pair.done = true;
+          return true;
+        }
+      }
+      pair.equal = equal;
+    }
+    return found;
+  }
+
+  //! Are the values at index i of x and j of y equal, npos meaning no value yet?
+  [[nodiscard]] bool same(const VCDTimeline& x, std::size_t i, const VCDTimeline& y, std::size_t j) const {
+    if (i == VCDTimeline::npos || j == VCDTimeline::npos) {
+      return i == j;
+    }
+    if (x.column_type() == VCDColumnType::SCALAR && y.column_type() == VCDColumnType::SCALAR) {
+      return x.scalar_at(i) == y.scalar_at(j);
+    }
+
+    const VCDValue a = x.value_at(i);
+    const VCDValue b = y.value_at(j);
+    if (a.get_type() == VCDValueType::REAL && b.get_type() == VCDValueType::REAL) {
+      const VCDReal u = a.get_value_real();
+      const VCDReal v = b.get_value_real();
+      return u == v || std::fabs(u - v) <= real_tolerance || (std::isnan(u) && std::isnan(v));
+    }
+    return a == b;
+  }
+
+  //! The value at index i, EMPTY for npos.
+  static VCDValue value_or_empty(const VCDTimeline& x, std::size_t i) {
+    return i == VCDTimeline::npos ? VCDValue() : x.value_at(i);
+  }
+
+  //! Settings of the parsers of both files.
+  VCDFileParser parser_settings;
+
+  //! Next pair to compare by a worker of compare_step().
+  std::atomic<std::size_t> next_pair{0};
+};
@@ -1,14 +1,22 @@
 #pragma once
 
+#include <vcd-parser/VCDCompressedTimeline.hpp>
+#include <vcd-parser/VCDIdCode.hpp>
+#include <vcd-parser/VCDPathIndex.hpp>
+#include <vcd-parser/VCDSignalCursor.hpp>
 #include <vcd-parser/VCDTypes.hpp>
 #include <vcd-parser/VCDValue.hpp>
 #include <vcd-parser/VCDTimedValue.hpp>
+#include <vcd-parser/VCDTimeline.hpp>
 
 #include <algorithm>
 #include <stdexcept>
 #include <unordered_map>
+#include <utility>
 #include <memory>
+#include <memory_resource>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #if !defined(VCD_PARSER_EXPORT)
@@ -17,10 +25,59 @@
 
 /*!
 @brief Top level object to represent a single VCD file.
+@details The timelines of the signals are allocated from a
+std::pmr::memory_resource, the default resource unless one is passed on
+construction. Values allocated from an arena owned by the file are
+released at once when the file is destroyed. Only the timelines use the
+resource: scopes, signals, names and id codes stay on the heap.
 */
 class VCDFile {
 
 public:
+  //! Create an empty file, allocating values from the default resource.
+  VCDFile() = default;
+
+  //! Create an empty file, allocating values from resource, which must outlive the file.
+  explicit VCDFile(std::pmr::memory_resource* resource) : resource(resource) {}
+
+  //! Create an empty file, allocating values from an arena owned by the file.
+  explicit VCDFile(std::shared_ptr<std::pmr::memory_resource> arena)
+      : arena(std::move(arena)), resource(this->arena.get()) {}
+
+  /*!
+  @brief Copy a file, the scopes and signals of the copy point at each other, not into other.
+  @details Like copies of timelines, the copy allocates from the default
+  resource, it neither shares the arena nor the resource of other.
+  */
+  VCDFile(const VCDFile& other)
+      : time_units(other.time_units), time_resolution(other.time_resolution), date(other.date),
+        version(other.version), comment(other.comment), root_scope(nullptr), signals(other.signals), scopes(other.scopes), times(other.times),
+        id_codes(other.id_codes), timelines(other.timelines), compressed_timelines(other.compressed_timelines),
+        compressed(other.compressed) {
+    relink(other);
+  }
+
+  VCDFile& operator=(const VCDFile& other) {
+    if (this != &other) {
+      *this = VCDFile(other);
+    }
+    return *this;
+  }
+
+  // Deques keep the addresses of their elements when moved.
+  VCDFile(VCDFile&&) = default;
+  VCDFile& operator=(VCDFile&&) = default;
+
+  //! Create an empty file with its own monotonic arena, see VCDFileParser::use_arena.
+  static std::shared_ptr<VCDFile> with_arena() {
+    return std::make_shared<VCDFile>(
+        std::shared_ptr<std::pmr::memory_resource>(std::make_shared<std::pmr::monotonic_buffer_resource>()));
+  }
+
+  //! The resource the values of the file are allocated from.
+  [[nodiscard]] std::pmr::memory_resource* get_memory_resource() const {
+    return resource;
+  }
 
   //! Timescale of the VCD file.
   VCDTimeUnit time_units;
@@ -43,24 +100,55 @@ public:
   /*!
   @brief Add a new scope object to the VCD file
   @param s in - The VCDScope object to add to the VCD file.
+  @returns The added scope, whose address stays valid.
   */
-  void add_scope(const VCDScope& s) {
-    scopes.emplace_back(s);
+  VCDScope* add_scope(const VCDScope& s) {
+    VCDScope* added = &scopes.emplace_back(s);
+    paths.add_scope(added);
+    return added;
   }
 
   /*!
   @brief Add a new signal to the VCD file
+  @details Interns the signal hash, the index is stored in the added signal.
   @param s in - The VCDSignal object to add to the VCD file.
+  @returns The added signal, whose address stays valid.
   */
-  void add_signal(const VCDSignal& s) {
+  VCDSignal* add_signal(const VCDSignal& s) {
     signals.emplace_back(s);
 
-    // Add a timestream entry
-    if (val_map.find(s.hash) == val_map.end())
-    {
+    VCDSignalIndex index = id_codes.intern(s.hash);
+    if (index == timelines.size()) {
+      // Values will be populated later, in a column matching the declaration.
+      timelines.emplace_back(s.type, s.size, resource);
+    }
+    signals.back().index = index;
+    paths.add_signal(&signals.back());
+    return &signals.back();
+  }
+
+
+  /*!
+  @brief Return the dense index of a signal hash, adding it if it is new.
+  @param hash in - The VCD hash value representing the signal.
+  */
+  VCDSignalIndex intern_signal(std::string_view hash) {
+    VCDSignalIndex index = id_codes.intern(hash);
+    if (index == timelines.size()) {
       // Values will be populated later.
-      val_map[s.hash] = VCDSignalValues();
+      timelines.emplace_back(resource);
     }
+    return index;
+  }
+
+
+  /*!
+  @brief Return the dense index of a signal hash.
+  @param hash in - The VCD hash value representing the signal.
+  @returns The index, or VCD_SIGNAL_NONE if there is no such signal.
+  */
+  [[nodiscard]] VCDSignalIndex get_signal_index(std::string_view hash) const {
+    return id_codes.find(hash);
   }
 
 
@@ -77,10 +165,17 @@ public:
 
   /*!
   @brief Return the scope object in the VCD file with this name
-  @param name in - The name of the scope to get and return.
+  @details A hierarchical path, e.g. "testbench.uut", is looked up in
+  O(path length), other names by a linear search for the first scope
+  with that short name.
+  @param name in - The path or name of the scope to get and return.
   */
   VCD_PARSER_EXPORT
   [[nodiscard]] const VCDScope& get_scope(const VCDScopeName& name) const {
+    if (const VCDScope* scope = paths.find_scope(name)) {
+      return *scope;
+    }
+
     auto element = std::find_if(scopes.begin(), scopes.end(), [&name](const auto& scope){ return scope.name == name; });
 
     if (element == scopes.end()) {
@@ -91,67 +186,183 @@ public:
   }
 
 
+  /*!
+  @brief Find a scope by hierarchical path, e.g. "testbench.uut".
+  @returns The scope, or nullptr if there is none.
+  */
+  [[nodiscard]] const VCDScope* find_scope(std::string_view path) const {
+    return paths.find_scope(path);
+  }
+
+
+  /*!
+  @brief Find a signal by hierarchical path, e.g. "testbench.uut.pc[31:0]".
+  @details The index range is optional, see VCDPathIndex::find_signal().
+  @returns The signal, or nullptr if there is none.
+  */
+  [[nodiscard]] const VCDSignal* find_signal(std::string_view path) const {
+    return paths.find_signal(path);
+  }
+
+
+  /*!
+  @brief Return the hierarchical path of a signal of the file.
+  */
+  [[nodiscard]] std::string get_signal_path(const VCDSignal& signal) const {
+    return paths.signal_path(signal);
+  }
+
+
+  /*!
+  @brief Return the index of the paths of all scopes and signals.
+  */
+  [[nodiscard]] const VCDPathIndex& get_path_index() const {
+    return paths;
+  }
+
+
   /*!
   @brief Add a new signal value to the VCD file, tagged by time.
   @param time_val in - A signal value, tagged by the time it occurs.
   @param hash in - The VCD hash value representing the signal.
   */
   void add_signal_value(const VCDTimedValue& time_val, const VCDSignalHash& hash) {
-    val_map[hash].emplace_back(time_val);
+    add_signal_value(time_val, intern_signal(hash));
+  }
+
+
+  /*!
+  @brief Add a new signal value to the VCD file, tagged by time.
+  @param time_val in - A signal value, tagged by the time it occurs.
+  @param index in - The dense index of the signal, see intern_signal().
+  */
+  void add_signal_value(const VCDTimedValue& time_val, VCDSignalIndex index) {
+    timelines[index].push_back(time_val);
+  }
+
+
+  /*!
+  @brief Add a new scalar value to the VCD file.
+  @param index in - The dense index of the signal, see intern_signal().
+  @param time in - The time the value occurs.
+  @param bit in - The new value.
+  */
+  void add_scalar_value(VCDSignalIndex index, VCDTime time, VCDBit bit) {
+    timelines[index].push_back(time, bit);
+  }
+
+
+  /*!
+  @brief Add a new vector value to the VCD file.
+  @param index in - The dense index of the signal, see intern_signal().
+  @param time in - The time the value occurs.
+  @param text in - The binary digits, most significant first, without the 'b'.
+  */
+  void add_vector_value(VCDSignalIndex index, VCDTime time, std::string_view text) {
+    timelines[index].push_back_ascii(time, text.data(), text.size());
+  }
+
+
+  /*!
+  @brief Append values parsed separately to the values of a signal.
+  @param index in - The dense index of the signal, see intern_signal().
+  @param values in - Values, none before the last value of the signal.
+  */
+  void append_signal_values(VCDSignalIndex index, const VCDSignalValues& values) {
+    timelines[index].append(values);
+  }
+
+
+  /*!
+  @brief Add a new real value to the VCD file.
+  @param index in - The dense index of the signal, see intern_signal().
+  @param time in - The time the value occurs.
+  @param real in - The new value.
+  */
+  void add_real_value(VCDSignalIndex index, VCDTime time, VCDReal real) {
+    timelines[index].push_back(time, real);
   }
 
 
   /*!
   @brief Get the value of a particular signal at a specified time.
   @note The supplied time value does not need to exist in the
-  vector returned by get_timestamps().
+  vector returned by get_timestamps(). Takes O(log n) time in the number
+  of values of the signal. Use a VCDSignalCursor to walk a signal in
+  time order.
   @param hash in - The hashcode for the signal to identify it.
   @param time in - The time at which we want the value of the signal.
-  @param erase_prior in - Erase signals prior to this time. Avoids O(n^2) searching times when scanning large .vcd files sequentially.
-  @returns A pointer to the value at the supplie time, or nullptr if
-  no such record can be found.
+  @returns The value at the supplied time.
+  @throws std::runtime_error if no such record can be found.
   */
-  const VCDValue& get_signal_value_at(const VCDSignalHash& hash, VCDTime time, bool erase_prior = false) {
-    auto find = val_map.find(hash);
-    if (find == val_map.end())
+  [[nodiscard]] VCDValue get_signal_value_at(const VCDSignalHash& hash, VCDTime time) const {
+    VCDSignalIndex index = id_codes.find(hash);
+    if (index == VCD_SIGNAL_NONE)
     {
       throw std::runtime_error("Signal not found");
     }
 
-    auto& vals = find->second;
+    return get_signal_value_at(index, time);
+  }
 
-    if (vals.empty())
-    {
-      throw std::runtime_error("Empty signal");
+  /*!
+  @brief Get the value of a particular signal at a specified time.
+  @param index in - The dense index of the signal.
+  @param time in - The time at which we want the value of the signal.
+  @returns The value at the supplied time.
+  @throws std::runtime_error if no such record can be found.
+  */
+  [[nodiscard]] VCDValue get_signal_value_at(VCDSignalIndex index, VCDTime time) const {
+    if (compressed) {
+      return get_compressed_value_at(compressed_timelines.at(index), time);
     }
 
-    auto erase_until = vals.begin();
-    bool found = false;
+    const auto& vals = timelines.at(index);
 
-    for (auto it = vals.begin(); it != vals.end(); ++it)
+    if (vals.empty())
     {
-      if (it->time <= time)
-      {
-        erase_until = it;
-        found = true;
-      }
-      else
-      {
-        break;
-      }
+      throw std::runtime_error("Empty signal");
     }
 
-    if (!found) {
+    std::size_t found = vals.find(time);
+    if (found == VCDTimeline::npos) {
       throw std::runtime_error("Element not found");
     }
 
+    return vals.value_at(found);
+  }
+
+  /*!
+  @brief Get the value of a signal at a time, optionally erasing older values.
+  @param erase_prior in - Erase signals prior to this time.
+  */
+  [[deprecated("point queries are O(log n), use VCDSignalCursor for sequential scans")]]
+  VCDValue get_signal_value_at(const VCDSignalHash& hash, VCDTime time, bool erase_prior) {
+    VCDValue value = std::as_const(*this).get_signal_value_at(hash, time);
+
     if (erase_prior)
     {
-      // avoid O(n^2) performance for large sequential scans
-      vals.erase(vals.begin(), erase_until);
+      auto& vals = timelines[id_codes.find(hash)];
+      vals.erase_front(vals.find(time));
     }
 
-    return erase_until->value;
+    return value;
+  }
+
+  /*!
+  @brief Return a cursor over the values of a signal.
+  @param hash in - The hashcode for the signal to identify it.
+  */
+  [[nodiscard]] VCDSignalCursor get_signal_cursor(const VCDSignalHash& hash) const {
+    return VCDSignalCursor(get_signal_values(hash));
+  }
+
+  /*!
+  @brief Return a cursor over the values of a signal.
+  @param index in - The dense index of the signal.
+  */
+  [[nodiscard]] VCDSignalCursor get_signal_cursor(VCDSignalIndex index) const {
+    return VCDSignalCursor(get_signal_values(index));
   }
 
   /*!
@@ -160,7 +371,101 @@ public:
   @returns A pointer to the vector of time values, or nullptr if hash not found
   */
   [[nodiscard]] const VCDSignalValues& get_signal_values(const VCDSignalHash& hash) const {
-    return val_map.at(hash);
+    VCDSignalIndex index = id_codes.find(hash);
+    if (index == VCD_SIGNAL_NONE) {
+      throw std::out_of_range("Signal not found");
+    }
+    return get_signal_values(index);
+  }
+
+  /*!
+  @brief Get the values of a signal by its dense index.
+  @param index in - The dense index of the signal.
+  @throws std::logic_error if the timelines are compressed.
+  */
+  [[nodiscard]] const VCDSignalValues& get_signal_values(VCDSignalIndex index) const {
+    if (compressed) {
+      throw std::logic_error("Timelines are compressed, use get_compressed_values()");
+    }
+    return timelines.at(index);
+  }
+
+  /*!
+  @brief Return a copy of the values of a signal, decompressed if needed.
+  @param index in - The dense index of the signal.
+  */
+  [[nodiscard]] VCDSignalValues copy_signal_values(VCDSignalIndex index) const {
+    return compressed ? compressed_timelines.at(index).decompress() : timelines.at(index);
+  }
+
+  /*!
+  @brief Replace every timeline by a VCDCompressedTimeline.
+  @details Frees the uncompressed timelines one by one, so the peak
+  memory is a single timeline above the final size. Point queries through
+  get_signal_value_at() keep working, get_signal_values(),
+  get_signal_cursor() and adding values need decompress_timelines() first.
+  A monotonic arena only releases the uncompressed timelines with the file.
+  */
+  void compress_timelines() {
+    if (compressed) {
+      return;
+    }
+    compressed_timelines.reserve(timelines.size());
+    for (VCDTimeline& timeline : timelines) {
+      compressed_timelines.emplace_back(timeline);
+      timeline = VCDTimeline(resource);
+    }
+    compressed = true;
+  }
+
+  //! Undo compress_timelines().
+  void decompress_timelines() {
+    if (!compressed) {
+      return;
+    }
+    for (VCDSignalIndex index = 0; index < compressed_timelines.size(); ++index) {
+      timelines[index] = compressed_timelines[index].decompress();
+      compressed_timelines[index] = VCDCompressedTimeline();
+    }
+    compressed_timelines.clear();
+    compressed_timelines.shrink_to_fit();
+    compressed = false;
+  }
+
+  //! Have the timelines been compressed by compress_timelines()?
+  [[nodiscard]] bool timelines_compressed() const {
+    return compressed;
+  }
+
+  /*!
+  @brief Get the compressed values of a signal by its dense index.
+  @param index in - The dense index of the signal.
+  @throws std::logic_error if the timelines are not compressed.
+  */
+  [[nodiscard]] const VCDCompressedTimeline& get_compressed_values(VCDSignalIndex index) const {
+    if (!compressed) {
+      throw std::logic_error("Timelines are not compressed, use get_signal_values()");
+    }
+    return compressed_timelines.at(index);
+  }
+
+  //! Estimate the heap bytes held by the values of all signals.
+  [[nodiscard]] std::size_t values_memory_usage() const {
+    std::size_t bytes = 0;
+    for (const VCDTimeline& timeline : timelines) {
+      bytes += timeline.memory_usage();
+    }
+    for (const VCDCompressedTimeline& timeline : compressed_timelines) {
+      bytes += timeline.memory_usage();
+    }
+    return bytes;
+  }
+
+  /*!
+  @brief Return the number of distinct signal hashes in the file.
+  */
+  [[nodiscard]] std::size_t get_signal_index_count() const {
+    return timelines.size();
   }
 
   /*!
@@ -188,6 +493,12 @@ public:
   }
 
 protected:
+  //! Arena owned by the file, declared first so it outlives the timelines.
+  std::shared_ptr<std::pmr::memory_resource> arena;
+
+  //! Allocates the timelines.
+  std::pmr::memory_resource* resource = std::pmr::get_default_resource();
+
   //! Flat vector of all signals in the file.
   std::deque<VCDSignal> signals;
 
@@ -197,8 +508,67 @@ protected:
   //! Vector of time values present in the VCD file - sorted, asc
   std::vector<VCDTime> times;
 
-  //! Map of hashes onto vectors of times and signal values.
-  std::unordered_map<VCDSignalHash, VCDSignalValues> val_map;
+  //! Map of hashes onto dense signal indices.
+  VCDIdCodeMap id_codes;
+
+  //! Hierarchical paths of the scopes and signals.
+  VCDPathIndex paths;
+
+  //! Times and signal values, indexed by dense signal index.
+  std::vector<VCDSignalValues> timelines;
+
+  //! Replace timelines after compress_timelines().
+  std::vector<VCDCompressedTimeline> compressed_timelines;
+
+  //! Set by compress_timelines().
+  bool compressed = false;
+
+  //! Value of a compressed timeline at a time, see get_signal_value_at().
+  static VCDValue get_compressed_value_at(const VCDCompressedTimeline& vals, VCDTime time) {
+    if (vals.empty()) {
+      throw std::runtime_error("Empty signal");
+    }
+
+    std::size_t found = vals.find(time);
+    if (found == VCDCompressedTimeline::npos) {
+      throw std::runtime_error("Element not found");
+    }
+
+    return vals.value_at(found);
+  }
+
+  //! Point the scopes and signals copied from other, and the paths, at the copies.
+  void relink(const VCDFile& other) {
+    std::unordered_map<const VCDScope*, VCDScope*> scope_copies;
+    for (std::size_t i = 0; i < scopes.size(); ++i) {
+      scope_copies.emplace(&other.scopes[i], &scopes[i]);
+    }
+    std::unordered_map<const VCDSignal*, VCDSignal*> signal_copies;
+    for (std::size_t i = 0; i < signals.size(); ++i) {
+      signal_copies.emplace(&other.signals[i], &signals[i]);
+    }
+    const auto scope_copy = [&](const VCDScope* scope) {
+      const auto found = scope_copies.find(scope);
+      return found == scope_copies.end() ? nullptr : found->second;
+    };
+
+    root_scope = scope_copy(other.root_scope);
+    for (VCDScope& scope : scopes) {
+      scope.parent = scope_copy(scope.parent);
+      for (VCDScope*& child : scope.children) {
+        child = scope_copy(child);
+      }
+      for (VCDSignal*& signal : scope.signals) {
+        const auto found = signal_copies.find(signal);
+        signal = found == signal_copies.end() ? nullptr : found->second;
+      }
+    }
+    for (VCDSignal& signal : signals) {
+      signal.scope = scope_copy(signal.scope);
+    }
+    paths = VCDPathIndex(other.paths, scope_copies, signal_copies);
+  }
 
   friend bool operator==(const VCDFile&, const VCDFile&);
+  friend class VCDCache;
 };
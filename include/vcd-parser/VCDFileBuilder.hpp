@@ -0,0 +1,111 @@
+#pragma once
+
+#include <vcd-parser/VCDFile.hpp>
+#include <vcd-parser/VCDVisitor.hpp>
+
+#include <memory>
+#include <stack>
+#include <string>
+#include <utility>
+
+/*!
+@file VCDFileBuilder.hpp
+@brief A VCDVisitor building a VCDFile in memory.
+*/
+
+/*!
+@brief Builds a VCDFile from the callbacks of a parse.
+@details The file interns hashes in the same order as the parser, so the
+signal indices passed to the callbacks are the indices of the file.
+*/
+class VCDFileBuilder : public VCDVisitor {
+
+public:
+  //! Create a builder with an empty file holding only the root scope.
+  VCDFileBuilder() : VCDFileBuilder(std::make_shared<VCDFile>()) {}
+
+  //! Create a builder adding the root scope to an empty file.
+  explicit VCDFileBuilder(std::shared_ptr<VCDFile> file) : fh(std::move(file)) {
+    VCDScope vcd_scope_root;
+    vcd_scope_root.name = "$root";
+    vcd_scope_root.type = VCDScopeType::VCD_SCOPE_ROOT;
+    vcd_scope_root.parent = nullptr;
+    fh->root_scope = fh->add_scope(vcd_scope_root);
+
+    scopes.push(fh->root_scope);
+  }
+
+  //! The file built so far.
+  [[nodiscard]] const std::shared_ptr<VCDFile>& get_file() const {
+    return fh;
+  }
+
+  void on_date(std::string_view text) override {
+    fh->date = text;
+  }
+
+  void on_version(std::string_view text) override {
+    fh->version = text;
+  }
+
+  void on_comment(std::string_view text) override {
+    fh->comment = text;
+  }
+
+  void on_timescale(VCDTimeRes resolution, VCDTimeUnit units) override {
+    fh->time_resolution = resolution;
+    fh->time_units = units;
+  }
+
+  void on_scope(const VCDScope& scope) override {
+    VCDScope new_scope;
+    new_scope.name = scope.name;
+    new_scope.type = scope.type;
+    new_scope.parent = scopes.top();
+
+    VCDScope* scope_pointer = fh->add_scope(new_scope);
+    scopes.top()->children.push_back(scope_pointer);
+    scopes.push(scope_pointer);
+  }
+
+  void on_upscope() override {
+    if (scopes.size() > 1) {
+      scopes.pop();
+    }
+  }
+
+  void on_var(const VCDSignal& signal) override {
+    VCDSignal new_signal = signal;
+    new_signal.scope = scopes.top();
+
+    VCDSignal* signal_pointer = fh->add_signal(new_signal);
+    new_signal.scope->signals.push_back(signal_pointer);
+  }
+
+  void on_undeclared([[maybe_unused]] VCDSignalIndex index, std::string_view hash) override {
+    fh->intern_signal(hash);
+  }
+
+  void on_timestamp(VCDTime time) override {
+    fh->add_timestamp(time);
+  }
+
+  void on_scalar_change(VCDTime time, VCDSignalIndex index, VCDBit value) override {
+    fh->add_scalar_value(index, time, value);
+  }
+
+  void on_vector_change(VCDTime time, VCDSignalIndex index, std::string_view digits) override {
+    fh->add_vector_value(index, time, digits);
+  }
+
+  void on_real_change(VCDTime time, VCDSignalIndex index, VCDReal value) override {
+    fh->add_real_value(index, time, value);
+  }
+
+protected:
+  //! The file being built.
+  std::shared_ptr<VCDFile> fh;
+
+  //! Currently open scopes of the file being built.
+  std::stack<VCDScope*> scopes;
+};
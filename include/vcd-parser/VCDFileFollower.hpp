@@ -0,0 +1,298 @@
+#pragma once
+
+#include <vcd-parser/VCDFile.hpp>
+#include <vcd-parser/VCDFileBuilder.hpp>
+#include <vcd-parser/VCDFileParser.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+/*!
+@file VCDFileFollower.hpp
+@brief Incremental parsing of a VCD file that is still being written.
+*/
+
+/*!
+@brief Parses a growing VCD file, each update() only the data appended since the last.
+@details The parser state carries over between updates, as with the
+steps of VCDFileParser::build_index(). Only complete lines are parsed,
+and the value change section is only cut outside of $dumpvars,
+$dumpall, $dumpon, $dumpoff and $comment blocks, so a partial line or
+block waits for the next update. Nothing is parsed until the header is
+complete. The file returned by get_file() is modified by update(), so
+it must not be read by other threads meanwhile.
+*/
+class VCDFileFollower {
+
+public:
+  /*!
+  @brief Follow a file, which does not need to exist yet.
+  @param path in - The file to follow.
+  @param settings in - A parser whose settings are used, threads and use_cache are ignored.
+  */
+  explicit VCDFileFollower(std::string path, const VCDFileParser& settings = VCDFileParser()) : filepath(std::move(path)) {
+    parser.copy_settings(settings);
+    parser.threads = 1;
+    parser.use_cache = false;
+    parser.filepath = filepath;
+    restart();
+  }
+
+  VCDFileFollower(const VCDFileFollower&) = delete;
+  VCDFileFollower& operator=(const VCDFileFollower&) = delete;
+
+  ~VCDFileFollower() {
+    close_watch();
+  }
+
+  /*!
+  @brief Parse the data appended to the file since the last update.
+  @details If the file shrank, it is taken to be rewritten, and parsing
+  restarts with a new VCDFile.
+  @returns false if the file cannot be read or the new data does not
+  parse. After a parse error, every update fails until restart().
+  */
+  bool update() {
+    if (failed) {
+      return false;
+    }
+
+    std::error_code error;
+    const auto size = static_cast<std::size_t>(std::filesystem::file_size(filepath, error));
+    if (error) {
+      return error == std::errc::no_such_file_or_directory;
+    }
+    if (size < read_offset) {
+      restart();
+    }
+    if (size == read_offset) {
+      return true;
+    }
+
+    std::ifstream in(filepath, std::ios::binary);
+    in.seekg(static_cast<std::streamoff>(read_offset));
+    const std::size_t old_size = pending.size();
+    pending.resize(old_size + (size - read_offset));
+    in.read(pending.data() + old_size, static_cast<std::streamsize>(size - read_offset));
+    const auto read = static_cast<std::size_t>(std::max<std::streamsize>(in.gcount(), 0));
+    pending.resize(old_size + read);
+    read_offset += read;
+
+    std::size_t used = 0;
+    if (!header_done) {
+      used = VCDFileParser::header_size(pending.data(), pending.size());
+      if (used == 0) {
+        return true;
+      }
+      if (!parser.parse_buffer(pending.data(), used, buffer)) {
+        return fail();
+      }
+      header_done = true;
+    }
+
+    const std::size_t end = used + complete_length(pending.data() + used, pending.size() - used);
+    if (end > used && !parser.parse_buffer(pending.data() + used, end - used, buffer)) {
+      return fail();
+    }
+    pending.erase(pending.begin(), pending.begin() + static_cast<std::ptrdiff_t>(end));
+    return true;
+  }
+
+  /*!
+  @brief Wait until the file is written to, at most timeout.
+  @details Uses inotify on Linux, and polls the size of the file
+  elsewhere or if the file cannot be watched.
+  @returns true if the file may have new data for update().
+  */
+  bool wait(std::chrono::milliseconds timeout) {
+    if (grown()) {
+      return true;
+    }
+#if defined(__linux__)
+    if (open_watch()) {
+      pollfd fd{watch_fd, POLLIN, 0};
+      if (poll(&fd, 1, static_cast<int>(timeout.count())) > 0) {
+        alignas(inotify_event) char events[4096];
+        bool replaced = false;
+        for (ssize_t n; (n = ::read(watch_fd, events, sizeof(events))) > 0;) {
+          for (ssize_t i = 0; i < n;) {
+            const auto* event = reinterpret_cast<const inotify_event*>(events + i);
+            replaced = replaced || (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) != 0;
+            i += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+          }
+        }
+        if (replaced) {
+          // The watch follows the old file, watch the new one next time.
+          close_watch();
+        }
+      }
+      return grown();
+    }
+#endif
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(
+          poll_interval, deadline - std::chrono::steady_clock::now()));
+      if (grown()) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  //! Forget everything parsed and start again at the beginning of the file.
+  void restart() {
+    builder = std::make_unique<VCDFileBuilder>(parser.new_file());
+    parser.reset(*builder);
+    parser.stats.clear();
+    read_offset = 0;
+    pending.clear();
+    header_done = false;
+    failed = false;
+  }
+
+  //! The file parsed so far.
+  [[nodiscard]] const std::shared_ptr<VCDFile>& get_file() const {
+    return builder->get_file();
+  }
+
+  //! Number of bytes of the file parsed so far.
+  [[nodiscard]] std::size_t parsed_bytes() const {
+    return read_offset - pending.size();
+  }
+
+  //! Has the header been parsed?
+  [[nodiscard]] bool header_parsed() const {
+    return header_done;
+  }
+
+  //! The parser, whose stats cover everything parsed since the last restart().
+  [[nodiscard]] const VCDFileParser& get_parser() const {
+    return parser;
+  }
+
+  //! Interval at which wait() checks the size of a file it cannot watch.
+  std::chrono::milliseconds poll_interval{50};
+
+protected:
+  /*!
+  @brief Return the length of the complete lines at data which end outside of a block.
+  @details Only keywords opening a block of value changes or a comment
+  and $end are recognized, which is all that matters between commands.
+  */
+  static std::size_t complete_length(const char* data, std::size_t size) {
+    std::size_t length = 0;
+    bool in_block = false;
+    for (std::size_t i = 0; i < size;) {
+      const char c = data[i];
+      if (c == '\n') {
+        if (!in_block) {
+          length = i + 1;
+        }
+        i++;
+        continue;
+      }
+      if (c == ' ' || c == '\t' || c == '\r') {
+        i++;
+        continue;
+      }
+
+      std::size_t j = i;
+      while (j < size && data[j] != ' ' && data[j] != '\t' && data[j] != '\r' && data[j] != '\n') {
+        j++;
+      }
+      const std::string_view token(data + i, j - i);
+      if (token == "$end") {
+        in_block = false;
+      } else if (token == "$dumpvars" || token == "$dumpall" || token == "$dumpon" || token == "$dumpoff" ||
+                 token == "$comment") {
+        in_block = true;
+      }
+      i = j;
+    }
+    return length;
+  }
+
+  //! Has the file changed size since it was last read?
+  [[nodiscard]] bool grown() const {
+    std::error_code error;
+    const auto size = std::filesystem::file_size(filepath, error);
+    return !error && static_cast<std::size_t>(size) != read_offset;
+  }
+
+  //! Give up after a parse error.
+  bool fail() {
+    failed = true;
+    return false;
+  }
+
+#if defined(__linux__)
+  //! Watch the file with inotify, returns false if it cannot be watched.
+  bool open_watch() {
+    if (watch_fd >= 0) {
+      return true;
+    }
+    watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch_fd < 0) {
+      return false;
+    }
+    if (inotify_add_watch(watch_fd, filepath.c_str(), IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF) < 0) {
+      close_watch();
+      return false;
+    }
+    return true;
+  }
+
+  //! inotify descriptor of the file, -1 if not watched.
+  int watch_fd = -1;
+#endif
+
+  //! Stop watching the file.
+  void close_watch() {
+#if defined(__linux__)
+    if (watch_fd >= 0) {
+      close(watch_fd);
+      watch_fd = -1;
+    }
+#endif
+  }
+
+  //! The followed file.
+  std::string filepath;
+
+  //! Parser whose driver state carries over between updates.
+  VCDFileParser parser;
+
+  //! Builds the file, is the visitor of parser.
+  std::unique_ptr<VCDFileBuilder> builder;
+
+  //! Bytes of the file read so far.
+  std::size_t read_offset = 0;
+
+  //! Bytes read but not parsed yet, the end of read_offset.
+  std::vector<char> pending;
+
+  //! Storage of parser.parse_buffer().
+  std::vector<char> buffer;
+
+  //! Has the header been parsed?
+  bool header_done = false;
+
+  //! Did parsing fail?
+  bool failed = false;
+};
@@ -5,23 +5,46 @@
 
 #pragma once
 
+#include <vcd-parser/VCDCache.hpp>
+#include <vcd-parser/VCDCheckpointIndex.hpp>
+#include <vcd-parser/VCDChunkBuilder.hpp>
+#include <vcd-parser/VCDCompressedInput.hpp>
 #include <vcd-parser/VCDFile.hpp>
+#include <vcd-parser/VCDFileBuilder.hpp>
+#include <vcd-parser/VCDIdCode.hpp>
+#include <vcd-parser/VCDMappedFile.hpp>
+#include <vcd-parser/VCDParseStats.hpp>
+#include <vcd-parser/VCDSignalSelection.hpp>
 #include <vcd-parser/VCDTypes.hpp>
+#include <vcd-parser/VCDVisitor.hpp>
 
 #include <VCDParser.hpp>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <deque>
 #include <limits>
 #include <map>
 #include <memory>
+#include <memory_resource>
+#include <mutex>
 #include <set>
-#include <stack>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 
 #if !defined(VCD_PARSER_EXPORT)
 #define VCD_PARSER_EXPORT
 #endif
 
-#define YY_DECL VCDParser::parser::symbol_type yylex([[maybe_unused]] VCDFileParser &driver, yyscan_t yyscanner)
+#define YY_DECL VCDParser::parser::symbol_type vcd_scan_token([[maybe_unused]] VCDFileParser &driver, yyscan_t yyscanner)
 YY_DECL;
 
 /*!
@@ -38,50 +61,370 @@ public:
 
     trace_scanning = debug;
     trace_parsing = debug;
+
+    memory_map = true;
   }
 
   /*!
   @brief Parse the suppled file.
+  @details With threads other than 1, memory mapped files are parsed in
+  parallel, see parse_file_parallel(). With use_cache, a whole file is
+  read from its cache if the cache is up to date, and a cache is written
+  after parsing otherwise.
   @returns A handle to the parsed VCDFile object or nullptr if parsing
   fails.
   */
   VCD_PARSER_EXPORT
   std::shared_ptr<VCDFile> parse_file(const std::string &f) {
+    const bool cached = use_cache && !f.empty() && f != "-" && selection.empty() &&
+                        start_time == -std::numeric_limits<VCDTime>::max() &&
+                        end_time == std::numeric_limits<VCDTime>::max();
+    if (cached) {
+      if (auto file = VCDCache::load(VCDCache::cache_path(f), f)) {
+        stats.clear();
+        if (collect_stats) {
+          record_memory(*file);
+        }
+        return file;
+      }
+    }
+
+    VCDFileBuilder builder(new_file());
+
+    const bool parsed = threads != 1 && memory_map && !f.empty() && f != "-"
+                            ? parse_file_parallel(f, builder)
+                            : parse_file(f, builder);
+    if (!parsed)
+    {
+      return nullptr;
+    }
+
+    if (collect_stats) {
+      record_memory(*builder.get_file());
+    }
+
+    if (cached) {
+      VCDCache::save(*builder.get_file(), VCDCache::cache_path(f), f);
+    }
+
+    return builder.get_file();
+  }
+
+  /*!
+  @brief Parse the supplied file, reporting its contents to a visitor.
+  @details Nothing but the scope stack and the id code map is kept, so
+  memory use does not depend on the length of the trace.
+  @returns true if parsing succeeded.
+  */
+  VCD_PARSER_EXPORT
+  bool parse_file(const std::string &f, VCDVisitor &v) {
 
     filepath = f;
+    reset(v);
+    stats.clear();
 
-    yyscan_t scanner = scan_begin();
+    bool result = run_parser(scan_begin());
 
-    fh = std::make_shared<VCDFile>();
+    if (result)
+    {
+      visitor->on_finish();
+    }
+    visitor = nullptr;
 
-    VCDScope vcd_scope_root;
-    vcd_scope_root.name = "$root";
-    vcd_scope_root.type = VCDScopeType::VCD_SCOPE_ROOT;
-    vcd_scope_root.parent = nullptr;
-    fh->add_scope(vcd_scope_root);
-    auto* scope_pointer_root = const_cast<VCDScope*>(&fh->get_scopes().back());
-    fh->root_scope = scope_pointer_root;
+    return result;
+  }
 
-    scopes.push(scope_pointer_root);
+  /*!
+  @brief Parse the supplied file using several threads.
+  @details The header is parsed first. The value change section is then
+  split into chunks starting at "#time" lines, which worker threads
+  parse into partial timelines. These are appended to the file in order,
+  again one thread per group of signals. Falls back to a sequential parse
+  if the file cannot be mapped, is compressed or has no $enddefinitions.
+  @returns true if parsing succeeded.
+  */
+  VCD_PARSER_EXPORT
+  bool parse_file_parallel(const std::string &f, VCDFileBuilder &builder) {
+    VCDMappedFile input;
+    if (!input.open(f))
+    {
+      return parse_file(f, builder);
+    }
 
-    VCDParser::parser parser(*this, scanner);
+    const char* data = input.data();
+    const auto magic = reinterpret_cast<const unsigned char*>(data);
+    const std::size_t body = vcd_detect_compression(magic, input.size()) == VCDCompression::NONE
+                                 ? header_size(data, input.size())
+                                 : 0;
+    if (body == 0)
+    {
+      return parse_file(f, builder);
+    }
 
-    parser.set_debug_level(trace_parsing);
+    filepath = f;
+    reset(builder);
+    stats.clear();
 
-    int result = parser.parse();
+    std::vector<char> buffer;
+    if (!parse_buffer(data, body, buffer))
+    {
+      visitor = nullptr;
+      return false;
+    }
+    visitor = nullptr;
+
+    unsigned workers = threads == 0 ? std::thread::hardware_concurrency() : threads;
+    workers = std::max(workers, 1u);
+
+    const std::size_t chunk_count = std::max<std::size_t>(
+        4 * workers, (input.size() - body + VCD_CHUNK_SIZE - 1) / VCD_CHUNK_SIZE);
+    const std::vector<std::size_t> bounds = chunk_bounds(data, body, input.size(), chunk_count);
+
+    VCDFile& file = *builder.get_file();
+    std::vector<std::unique_ptr<VCDChunkBuilder>> chunks(bounds.size() - 1);
+    std::atomic<std::size_t> next_chunk{0};
+    std::atomic<bool> failed{false};
+    std::mutex stats_mutex;
+
+    run_workers(workers, [&](unsigned) {
+      VCDFileParser worker;
+      worker.copy_settings(*this);
+      worker.filepath = filepath;
+
+      std::vector<char> chunk_buffer;
+      for (std::size_t c = next_chunk++; c < chunks.size() && !failed; c = next_chunk++) {
+        auto chunk = std::make_unique<VCDChunkBuilder>(file);
+
+        worker.reset(*chunk);
+        worker.id_codes = id_codes;
+        worker.selecting = selecting;
+        worker.selected = selected;
+
+        if (!worker.parse_buffer(data + bounds[c], bounds[c + 1] - bounds[c], chunk_buffer)) {
+          failed = true;
+        }
+        worker.visitor = nullptr;
+        chunks[c] = std::move(chunk);
+      }
+
+      if (collect_stats) {
+        // Chunk-local indices of undeclared id codes differ between chunks.
+        worker.stats.signal_changes.resize(std::min(worker.stats.signal_changes.size(), id_codes.size()));
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        stats.merge(worker.stats);
+      }
+    });
+
+    if (failed)
+    {
+      return false;
+    }
 
-    scopes.pop();
+    for (const auto& chunk : chunks) {
+      for (VCDTime time : chunk->timestamps) {
+        file.add_timestamp(time);
+      }
+    }
 
-    scan_end(scanner);
+    // Other resources than the default, such as an arena, need not be thread safe.
+    const unsigned appenders = file.get_memory_resource() == std::pmr::get_default_resource() ? workers : 1;
+    const auto declared = static_cast<VCDSignalIndex>(file.get_signal_index_count());
+    run_workers(appenders, [&](unsigned w) {
+      for (VCDSignalIndex i = w; i < declared; i += appenders) {
+        for (const auto& chunk : chunks) {
+          file.append_signal_values(i, chunk->timelines[i]);
+        }
+      }
+    });
+
+    // Id codes no $var declared, in the order a sequential parse sees them.
+    for (const auto& chunk : chunks) {
+      for (const auto& [local, hash] : chunk->undeclared) {
+        file.append_signal_values(file.intern_signal(hash), chunk->timelines[local]);
+      }
+    }
+
+    builder.on_finish();
+    return true;
+  }
+
+  /*!
+  @brief Parse many files concurrently, one file per thread at a time.
+  @details Every file is parsed by its own VCDFileParser with the
+  settings of this one, each file sequentially.
+  @param paths in - The files to parse.
+  @param thread_count in - Number of threads, 0 for one per core.
+  @returns The parsed files in the order of paths, nullptr for those
+  which failed to parse.
+  */
+  VCD_PARSER_EXPORT
+  std::vector<std::shared_ptr<VCDFile>> parse_files(const std::vector<std::string>& paths, unsigned thread_count = 0) {
+    std::vector<std::shared_ptr<VCDFile>> files(paths.size());
+
+    unsigned workers = thread_count == 0 ? std::thread::hardware_concurrency() : thread_count;
+    workers = static_cast<unsigned>(std::min<std::size_t>(std::max(workers, 1u), paths.size()));
+
+    std::atomic<std::size_t> next_file{0};
+    run_workers(workers, [&](unsigned) {
+      VCDFileParser worker;
+      worker.copy_settings(*this);
+      worker.threads = 1;
+
+      for (std::size_t i = next_file++; i < paths.size(); i = next_file++) {
+        files[i] = worker.parse_file(paths[i]);
+      }
+    });
+
+    return files;
+  }
+
+  /*!
+  @brief Record checkpoints of a mapped file for parse_file_window().
+  @details The value change section is parsed in steps of about interval
+  bytes. Before each step, the offset of its "#time" line and the values
+  of all signals are recorded. Save the index with
+  VCDCheckpointIndex::save(), next to the file by default.
+  @param f in - The file to index.
+  @param index out - The checkpoints.
+  @param interval in - Bytes between checkpoints.
+  @returns true if the file was parsed successfully.
+  */
+  VCD_PARSER_EXPORT
+  bool build_index(const std::string &f, VCDCheckpointIndex &index, std::size_t interval = VCD_CHUNK_SIZE) {
+    // Stamp before mapping, a file changed meanwhile leaves a stale stamp instead of a wrong index.
+    uint64_t source_size = 0;
+    int64_t source_mtime = 0;
+    VCDMappedFile input;
+    if (!VCDCache::source_stamp(f, source_size, source_mtime) || !input.open(f))
+    {
+      error("Cannot open " + f);
+      return false;
+    }
+
+    const char* data = input.data();
+    if (vcd_detect_compression(reinterpret_cast<const unsigned char*>(data), input.size()) != VCDCompression::NONE)
+    {
+      error("Cannot index compressed file " + f);
+      return false;
+    }
 
-    if (result == 0)
+    const std::size_t body = header_size(data, input.size());
+    if (body == 0)
     {
-      return fh;
+      error("No $enddefinitions in " + f);
+      return false;
+    }
+
+    VCDFileParser indexer;
+    indexer.copy_settings(*this);
+    indexer.filepath = f;
+    indexer.selection.clear();
+    indexer.start_time = -std::numeric_limits<VCDTime>::max();
+    indexer.end_time = std::numeric_limits<VCDTime>::max();
+
+    VCDStateTracker tracker;
+    indexer.reset(tracker);
+
+    std::vector<char> buffer;
+    if (!indexer.parse_buffer(data, body, buffer))
+    {
+      return false;
+    }
+
+    index = VCDCheckpointIndex();
+    index.source_size = input.size();
+    index.source_mtime = source_mtime;
+    index.body_offset = body;
+
+    const std::size_t steps = std::max<std::size_t>((input.size() - body) / std::max<std::size_t>(interval, 1), 1);
+    const std::vector<std::size_t> bounds = chunk_bounds(data, body, input.size(), steps);
+
+    for (std::size_t k = 0; k + 1 < bounds.size(); ++k) {
+      VCDTime time = 0;
+      const char* digits = data + bounds[k] + 1;
+      if (k > 0 && std::from_chars(digits, data + bounds[k + 1], time).ec == std::errc()) {
+        VCDCheckpointIndex::Checkpoint checkpoint;
+        checkpoint.time = time;
+        checkpoint.offset = bounds[k];
+        checkpoint.state = tracker.snapshot();
+        index.checkpoints.push_back(std::move(checkpoint));
+      }
+
+      // The driver state carries over, so each step continues the previous one.
+      if (!indexer.parse_buffer(data + bounds[k], bounds[k + 1] - bounds[k], buffer))
+      {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  /*!
+  @brief Parse the window [start_time, end_time] of a file, starting at a checkpoint.
+  @details The header is parsed, then parsing continues at the last
+  checkpoint before start_time instead of the start of the value change
+  section. The file holds a timestamp at start_time with the value of
+  every signal at that time, followed by the changes after start_time.
+  An index not matching the size and modification time of the file is
+  ignored, and the whole file is parsed.
+  @returns A handle to the parsed VCDFile object or nullptr if parsing
+  fails.
+  */
+  VCD_PARSER_EXPORT
+  std::shared_ptr<VCDFile> parse_file_window(const std::string &f, const VCDCheckpointIndex &index) {
+    VCDFileBuilder builder(new_file());
+    VCDWindowVisitor window(builder, start_time);
+
+    uint64_t source_size = 0;
+    int64_t source_mtime = 0;
+    const bool usable = VCDCache::source_stamp(f, source_size, source_mtime) && source_size == index.source_size &&
+                        source_mtime == index.source_mtime;
+    if (!usable)
+    {
+      error("Index does not match " + f + ", parsing the whole file");
+    }
+
+    const VCDTime window_start = start_time;
+    filepath = f;
+    reset(window);
+    stats.clear();
+    start_time = -std::numeric_limits<VCDTime>::max();
+
+    bool result;
+    if (usable)
+    {
+      header_only = true;
+      result = run_parser(scan_begin());
+      header_only = false;
+
+      const VCDCheckpointIndex::Checkpoint* checkpoint = index.find(window_start);
+      if (result && checkpoint != nullptr)
+      {
+        for (const auto& [hash, value] : checkpoint->state) {
+          window.set_state(signal_index(hash), value);
+        }
+        current_time = checkpoint->time;
+      }
+
+      result = result && run_parser(scan_begin(checkpoint != nullptr ? checkpoint->offset : index.body_offset));
     }
     else
     {
+      result = run_parser(scan_begin());
+    }
+
+    start_time = window_start;
+
+    if (!result)
+    {
+      visitor = nullptr;
       return nullptr;
     }
+
+    window.on_finish();
+    visitor = nullptr;
+    return builder.get_file();
   }
 
   //! The current file being parsed.
@@ -93,12 +436,43 @@ public:
   //! Should we debug parsing of tokens?
   bool trace_parsing;
 
+  //! Map regular files into memory and tokenize them without copying.
+  bool memory_map;
+
+  //! Largest segment of a mapped file handed to flex at once, which counts bytes in an int.
+  std::size_t scan_segment_size = std::size_t(1) << 30;
+
+  //! Threads used by parse_file() for mapped files, 0 for one per core.
+  unsigned threads = 1;
+
+  //! Read and write VCDCache files next to parsed files, see parse_file().
+  bool use_cache = false;
+
   //! Ignore anything before this timepoint
   VCDTime start_time;
 
   //! Ignore anything after this timepoint
   VCDTime end_time;
 
+  //! Only value changes of these signals are parsed, all if empty.
+  VCDSignalSelection selection;
+
+  /*!
+  @brief Allocate the values of parsed files from this resource, from the heap if nullptr.
+  @details It must outlive the files, and be thread safe if used by
+  parse_files(). Scopes, signals and names are allocated from the heap.
+  */
+  std::pmr::memory_resource* memory_resource = nullptr;
+
+  //! Allocate the values of each parsed file from its own monotonic arena, released at once with the file.
+  bool use_arena = false;
+
+  //! Collect counters and timers of each parse in stats.
+  bool collect_stats = false;
+
+  //! Statistics of the last parse, if collect_stats is set.
+  VCDParseStats stats;
+
   //! Reports errors to stderr.
   void error(const VCDParser::location& l, const std::string& m) {
     std::cerr << "line " << l.begin.line << std::endl;
@@ -110,16 +484,485 @@ public:
     std::cerr << " : " << m << std::endl;
   }
 
-  //! Current file being parsed and constructed.
-  std::shared_ptr<VCDFile> fh;
+  //! Receives the contents of the file being parsed.
+  VCDVisitor* visitor = nullptr;
+
+  //! Time of the last #time line.
+  VCDTime current_time = 0;
+
+  //! Location of the scanner in the current file.
+  VCDParser::location scan_location;
+
+  /*!
+  @brief Handle $enddefinitions.
+  @returns false if parsing should stop after the header.
+  */
+  bool end_definitions() {
+    if (collect_stats) {
+      header_end = std::chrono::steady_clock::now();
+    }
+    visitor->on_header_done();
+    return !header_only;
+  }
+
+  //! Handle the opening of a scope.
+  void declare_scope(VCDScopeType type, std::string_view name) {
+    VCDScope new_scope;
+    new_scope.name = name;
+    new_scope.type = type;
+    new_scope.parent = &scope_stack.back();
 
-  //! Current stack of scopes being parsed.
-  std::stack<VCDScope*> scopes;
+    scope_stack.push_back(new_scope);
+    visitor->on_scope(scope_stack.back());
+  }
+
+  //! Handle the closing of the innermost scope.
+  void upscope() {
+    if (scope_stack.size() > 1) {
+      scope_stack.pop_back();
+    }
+    visitor->on_upscope();
+  }
+
+  //! Handle a var declaration in the innermost scope.
+  void declare_var(VCDSignal& signal) {
+    signal.scope = &scope_stack.back();
+    signal.index = id_codes.intern(signal.hash);
+
+    if (selecting) {
+      if (signal.index >= selected.size()) {
+        selected.resize(signal.index + 1, false);
+      }
+      if (!selected[signal.index]) {
+        selected[signal.index] = selection.selects(signal, signal_path(signal));
+      }
+    }
+
+    visitor->on_var(signal);
+  }
+
+  //! Return the hierarchical path of a signal declared in the innermost scope.
+  std::string signal_path(const VCDSignal& signal) const {
+    std::string path;
+    for (std::size_t i = 1; i < scope_stack.size(); ++i) {
+      path += scope_stack[i].name;
+      path += '.';
+    }
+    path += signal.reference;
+    return path;
+  }
+
+  //! Is a selection applied, so the scanner has to look at the id code of each value change?
+  [[nodiscard]] bool selecting_changes() const {
+    return selecting;
+  }
+
+  /*!
+  @brief Return true if changes of an id code should be parsed.
+  @details Called by the scanner before it creates any token for a
+  value change, so unselected changes cost a table lookup.
+  */
+  bool change_selected(std::string_view hash) const {
+    if (!selecting) {
+      return true;
+    }
+    VCDSignalIndex index = id_codes.find(hash);
+    if (index == VCD_SIGNAL_NONE) {
+      return selection.selects_id_code(hash);
+    }
+    return index < selected.size() && selected[index];
+  }
+
+  /*!
+  @brief Handle a #time line.
+  @returns false if the time is past end_time and parsing should stop.
+  */
+  bool timestamp(VCDTime time) {
+    if (time > end_time) {
+      return false;
+    }
+    if (time > start_time) {
+      if (collect_stats) {
+        stats.timestamps++;
+      }
+      visitor->on_timestamp(time);
+    }
+    return true;
+  }
+
+  //! Handle a scalar value change.
+  void scalar_change(VCDTime time, std::string_view hash, VCDBit value) {
+    if (time > start_time) {
+      const VCDSignalIndex index = signal_index(hash);
+      if (collect_stats) {
+        stats.scalar_changes++;
+        store_timed(index, [&] { visitor->on_scalar_change(time, index, value); });
+      } else {
+        visitor->on_scalar_change(time, index, value);
+      }
+    }
+  }
+
+  //! Handle a vector value change, digits without the leading 'b'.
+  void vector_change(VCDTime time, std::string_view hash, std::string_view digits) {
+    if (time > start_time) {
+      const VCDSignalIndex index = signal_index(hash);
+      if (collect_stats) {
+        stats.vector_changes++;
+        store_timed(index, [&] { visitor->on_vector_change(time, index, digits); });
+      } else {
+        visitor->on_vector_change(time, index, digits);
+      }
+    }
+  }
+
+  //! Handle a real value change.
+  void real_change(VCDTime time, std::string_view hash, VCDReal value) {
+    if (time > start_time) {
+      const VCDSignalIndex index = signal_index(hash);
+      if (collect_stats) {
+        stats.real_changes++;
+        store_timed(index, [&] { visitor->on_real_change(time, index, value); });
+      } else {
+        visitor->on_real_change(time, index, value);
+      }
+    }
+  }
+
+  //! Return the index of an id code, reporting codes no $var declared.
+  VCDSignalIndex signal_index(std::string_view hash) {
+    VCDSignalIndex index = id_codes.find(hash);
+    if (index == VCD_SIGNAL_NONE) {
+      index = id_codes.intern(hash);
+      visitor->on_undeclared(index, hash);
+    }
+    return index;
+  }
+
+  /*!
+  @brief Return stable text for the token the scanner just matched.
+  @details Mapped input and the chunks of a parallel parse are returned
+  as a view into their buffer. Buffered
+  input is copied into a small ring of reused strings, since flex may move
+  its buffer before the parser has consumed the token.
+  */
+  std::string_view token_text(const char* text, std::size_t length) {
+    if (tokens_in_place) {
+      return {text, length};
+    }
+    std::string& slot = token_storage[token_slot++ % token_storage.size()];
+    slot.assign(text, length);
+    return slot;
+  }
+
+  /*!
+  @brief Hand the next segment of the mapped file to the scanner.
+  @returns false if the whole file has been scanned.
+  */
+  bool scan_segment(yyscan_t scanner);
+
+  /*!
+  @brief Read the next bytes of buffered input for the scanner.
+  @details Compressed files are read from their decompressor, others from file.
+  @returns The number of bytes read, 0 at the end of the input.
+  */
+  std::size_t read_input(char* buffer, std::size_t size, FILE* file);
+
+  //! Count a token returned by the scanner, if collect_stats is set.
+  void count_token(VCDParser::parser::symbol_kind_type kind) {
+    if (collect_stats && kind >= 0 && kind < VCDParser::parser::YYNTOKENS) {
+      token_counts[kind]++;
+    }
+  }
 
 protected:
-  //! Utility function for starting parsing.
-  yyscan_t scan_begin();
+  //! Bytes of the value change section each parallel chunk holds at most.
+  static constexpr std::size_t VCD_CHUNK_SIZE = std::size_t(64) << 20;
+
+  //! Reset the parse state before parsing into a visitor.
+  void reset(VCDVisitor& v) {
+    visitor = &v;
+    current_time = 0;
+    scan_location.initialize();
+
+    id_codes = VCDIdCodeMap();
+    scope_stack.clear();
+    selected.clear();
+    selecting = !selection.empty();
+
+    VCDScope vcd_scope_root;
+    vcd_scope_root.name = "$root";
+    vcd_scope_root.type = VCDScopeType::VCD_SCOPE_ROOT;
+    vcd_scope_root.parent = nullptr;
+    scope_stack.push_back(vcd_scope_root);
+  }
+
+  //! Take over the user settings of another parser.
+  void copy_settings(const VCDFileParser& other) {
+    trace_scanning = other.trace_scanning;
+    trace_parsing = other.trace_parsing;
+    memory_map = other.memory_map;
+    scan_segment_size = other.scan_segment_size;
+    threads = other.threads;
+    use_cache = other.use_cache;
+    collect_stats = other.collect_stats;
+    start_time = other.start_time;
+    end_time = other.end_time;
+    selection = other.selection;
+    memory_resource = other.memory_resource;
+    use_arena = other.use_arena;
+  }
+
+  //! Create an empty file allocating its values as set by memory_resource and use_arena.
+  [[nodiscard]] std::shared_ptr<VCDFile> new_file() const {
+    if (use_arena) {
+      return VCDFile::with_arena();
+    }
+    return memory_resource != nullptr ? std::make_shared<VCDFile>(memory_resource) : std::make_shared<VCDFile>();
+  }
+
+  //! Run the grammar on a scanner, destroying the scanner afterwards.
+  bool run_parser(yyscan_t scanner) {
+    if (scanner == nullptr) {
+      return false;
+    }
+
+    VCDParser::parser parser(*this, scanner);
+
+    parser.set_debug_level(trace_parsing);
+
+    const auto start = std::chrono::steady_clock::now();
+    header_end = {};
+
+    int result = parser.parse();
+
+    if (collect_stats)
+    {
+      record_phases(start);
+    }
+
+    if (compressed_input != nullptr && compressed_input->failed())
+    {
+      error("Cannot decompress " + filepath + ": " + compressed_input->error_message());
+      result = 1;
+    }
+
+    scan_end(scanner);
+
+    return result == 0;
+  }
+
+  //! Pass a value change to the visitor, timing one in VCDParseStats::storage_sample.
+  template <typename Store>
+  void store_timed(VCDSignalIndex index, Store store) {
+    stats.count_change(index);
+    if (storage_counter++ % VCDParseStats::storage_sample != 0) {
+      store();
+      return;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    store();
+    const auto stop = std::chrono::steady_clock::now();
+    stats.storage_seconds += VCDParseStats::storage_sample * std::chrono::duration<double>(stop - start).count();
+  }
+
+  //! Add the phase times and token counts of a run of the parser to stats.
+  void record_phases(std::chrono::steady_clock::time_point start) {
+    const auto stop = std::chrono::steady_clock::now();
+    if (header_end == std::chrono::steady_clock::time_point{}) {
+      // A chunk or window of the value change section.
+      stats.body_seconds += std::chrono::duration<double>(stop - start).count();
+    } else {
+      stats.header_seconds += std::chrono::duration<double>(header_end - start).count();
+      stats.body_seconds += std::chrono::duration<double>(stop - header_end).count();
+    }
+
+    for (int kind = 0; kind < VCDParser::parser::YYNTOKENS; ++kind) {
+      if (token_counts[kind] > 0) {
+        stats.tokens[VCDParser::parser::symbol_name(static_cast<VCDParser::parser::symbol_kind_type>(kind))] +=
+            token_counts[kind];
+        token_counts[kind] = 0;
+      }
+    }
+  }
+
+  //! Record the bytes held by each timeline of a parsed file in stats.
+  void record_memory(const VCDFile& file) {
+    stats.signal_bytes.resize(file.get_signal_index_count());
+    for (VCDSignalIndex i = 0; i < file.get_signal_index_count(); ++i) {
+      stats.signal_bytes[i] = file.get_signal_values(i).memory_usage();
+    }
+  }
+
+  //! Parse a copy of size bytes at data, using buffer as storage.
+  bool parse_buffer(const char* data, std::size_t size, std::vector<char>& buffer) {
+    buffer.resize(size + 2);
+    std::copy_n(data, size, buffer.data());
+    buffer[size] = buffer[size + 1] = '\0';
+    return run_parser(scan_begin_buffer(buffer.data(), buffer.size()));
+  }
+
+  /*!
+  @brief Return the offset just after the "$end" closing a comment at pos.
+  @details Like the scanner, the comment ends at the first "$end".
+  @returns The size of text if the comment is not closed.
+  */
+  static std::size_t comment_end(std::string_view text, std::size_t pos) {
+    const std::size_t end = text.find("$end", pos + 8);
+    return end == std::string_view::npos ? text.size() : end + 4;
+  }
+
+  //! Return the offset just after "$enddefinitions $end" outside comments, 0 if there is none.
+  static std::size_t header_size(const char* data, std::size_t size) {
+    const std::string_view text(data, size);
+    const std::string_view keyword = "$enddefinitions";
+    std::size_t pos = text.find(keyword);
+    std::size_t comment = text.find("$comment");
+    while (comment < pos) {
+      const std::size_t end = comment_end(text, comment);
+      if (end > pos) {
+        pos = text.find(keyword, end);
+      }
+      comment = text.find("$comment", end);
+    }
+    if (pos == std::string_view::npos) {
+      return 0;
+    }
+    pos = text.find("$end", pos + keyword.size());
+    return pos == std::string_view::npos ? 0 : pos + 4;
+  }
+
+  /*!
+  @brief Split [begin, end) into about count chunks starting at "#time" lines.
+  @details Lines of a $comment starting with "#" are no time.
+  @returns The chunk boundaries, begin first and end last.
+  */
+  static std::vector<std::size_t> chunk_bounds(const char* data, std::size_t begin, std::size_t end, std::size_t count) {
+    const std::string_view text(data, end);
+    std::vector<std::size_t> bounds{begin};
+    const std::size_t step = std::max<std::size_t>((end - begin) / count, 1);
+    std::size_t comment = text.find("$comment", begin);
+
+    for (std::size_t k = 1; k < count; ++k) {
+      std::size_t pos = std::max(begin + k * step, bounds.back());
+      while (pos < end) {
+        const void* newline = std::memchr(data + pos, '\n', end - pos);
+        if (newline == nullptr) {
+          pos = end;
+          break;
+        }
+        pos = static_cast<const char*>(newline) - data + 1;
+        bool in_comment = false;
+        while (comment < pos) {
+          const std::size_t comment_close = comment_end(text, comment);
+          if (comment_close > pos) {
+            pos = comment_close;
+            in_comment = true;
+          }
+          comment = text.find("$comment", comment_close);
+        }
+        if (!in_comment && pos < end && data[pos] == '#') {
+          break;
+        }
+      }
+      if (pos >= end) {
+        break;
+      }
+      if (pos > bounds.back()) {
+        bounds.push_back(pos);
+      }
+    }
+
+    bounds.push_back(end);
+    return bounds;
+  }
+
+  //! Run a function on count threads, passing each its number.
+  template <typename Function>
+  static void run_workers(unsigned count, Function function) {
+    std::vector<std::thread> pool;
+    pool.reserve(count);
+    for (unsigned w = 0; w < count; ++w) {
+      pool.emplace_back(function, w);
+    }
+    for (std::thread& t : pool) {
+      t.join();
+    }
+  }
+
+  /*!
+  @brief Utility function for starting parsing.
+  @param offset in - Byte offset in the file to start scanning at.
+  @returns The scanner, nullptr if the file cannot be opened.
+  */
+  yyscan_t scan_begin(std::size_t offset = 0);
+
+  //! Start scanning a buffer ending in two NUL bytes, size includes them.
+  yyscan_t scan_begin_buffer(char* base, std::size_t size);
 
   //! Utility function for stopping parsing.
   void scan_end(yyscan_t scanner);
-};
\ No newline at end of file
+
+  //! Dense indices of the id codes declared so far.
+  VCDIdCodeMap id_codes;
+
+  //! Currently open scopes, the root scope first.
+  std::deque<VCDScope> scope_stack;
+
+  //! Stop parsing at $enddefinitions?
+  bool header_only = false;
+
+  //! Is a selection being applied to the current parse?
+  bool selecting = false;
+
+  //! Signal index to whether any of its declarations is selected.
+  std::vector<bool> selected;
+
+  //! The current file, if it is memory mapped.
+  VCDMappedFile mapped_file;
+
+  //! Does the scanner read a buffer that outlives the parse, so tokens need no copy?
+  bool tokens_in_place = false;
+
+  //! Offset of the first byte of mapped_file not yet handed to the scanner.
+  std::size_t mapped_offset = 0;
+
+  //! Bytes overwritten by the end of buffer marker of the current segment.
+  std::array<char, 2> segment_saved{};
+
+  //! Does the current segment end inside the mapping?
+  bool segment_split = false;
+
+  //! The current file, if it is read through stdio.
+  FILE* input_file = nullptr;
+
+  //! The current file, if it is compressed.
+  std::unique_ptr<VCDCompressedInput> compressed_input;
+
+  //! Token texts handed out in buffered mode, reused round robin.
+  std::array<std::string, 8> token_storage;
+
+  //! Next slot of token_storage to hand out.
+  std::size_t token_slot = 0;
+
+  //! Tokens returned by the scanner by kind, since the last record_phases().
+  std::array<uint64_t, VCDParser::parser::YYNTOKENS> token_counts{};
+
+  //! When $enddefinitions was parsed in the current run of the parser.
+  std::chrono::steady_clock::time_point header_end;
+
+  //! Value changes passed to the visitor, selects those store_timed() times.
+  uint64_t storage_counter = 0;
+
+  friend class VCDFileFollower;
+  friend class VCDDiff;
+  friend class VCDArrayExporter;
+  friend class VCDLazyFile;
+};
+
+//! Scan the next token, counting it for VCDParseStats.
+inline VCDParser::parser::symbol_type yylex(VCDFileParser &driver, yyscan_t yyscanner) {
+  VCDParser::parser::symbol_type token = vcd_scan_token(driver, yyscanner);
+  driver.count_token(token.kind());
+  return token;
+}
\ No newline at end of file
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <vcd-parser/VCDTypes.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/*!
+@file VCDIdCode.hpp
+@brief Conversion of VCD identifier codes into dense signal indices.
+*/
+
+//! Index returned for identifier codes which have not been interned.
+constexpr VCDSignalIndex VCD_SIGNAL_NONE = std::numeric_limits<VCDSignalIndex>::max();
+
+/*!
+@brief Decode an identifier code as a bijective base-94 number.
+@details Identifier codes consist of the printable characters '!' to '~'.
+The first character is the least significant digit, which is how
+simulators usually count them up. Digits run from 1 to 94, so codes of
+different lengths never decode to the same value.
+@param code in - The identifier code.
+@param value out - The decoded number.
+@returns false if the code is empty, too long or not printable.
+*/
+inline bool vcd_decode_id_code(std::string_view code, uint64_t& value) {
+  if (code.empty() || code.size() > 9) {
+    return false;
+  }
+
+  value = 0;
+  uint64_t weight = 1;
+  for (char c : code) {
+    if (c < '!' || c > '~') {
+      return false;
+    }
+    value += static_cast<uint64_t>(c - '!' + 1) * weight;
+    weight *= 94;
+  }
+  return true;
+}
+
+/*!
+@brief Encode a number as identifier code, the inverse of vcd_decode_id_code().
+@param value in - The number to encode, must be at least 1.
+*/
+inline std::string vcd_encode_id_code(uint64_t value) {
+  std::string code;
+  while (value > 0) {
+    value -= 1;
+    code.push_back(static_cast<char>('!' + value % 94));
+    value /= 94;
+  }
+  return code;
+}
+
+/*!
+@brief Assigns dense indices to identifier codes, in order of interning.
+@details Codes which decode to small numbers are looked up in a flat
+table, anything else falls back to a hash map keyed by views of the
+interned codes, so lookups do not allocate.
+*/
+class VCDIdCodeMap {
+
+public:
+  //! Largest decoded code kept in the flat table.
+  static constexpr uint64_t max_dense_code = uint64_t(1) << 20;
+
+  VCDIdCodeMap() = default;
+
+  //! Copy a map, the keys of the copy point into its own codes.
+  VCDIdCodeMap(const VCDIdCodeMap& other) : dense(other.dense), codes(other.codes) {
+    for (std::size_t index = 0; index < codes.size(); ++index) {
+      uint64_t value;
+      if (!vcd_decode_id_code(codes[index], value) || value >= max_dense_code) {
+        sparse.emplace(codes[index], static_cast<VCDSignalIndex>(index));
+      }
+    }
+  }
+
+  VCDIdCodeMap& operator=(const VCDIdCodeMap& other) {
+    if (this != &other) {
+      *this = VCDIdCodeMap(other);
+    }
+    return *this;
+  }
+
+  // Deques keep the addresses of their elements when moved.
+  VCDIdCodeMap(VCDIdCodeMap&&) = default;
+  VCDIdCodeMap& operator=(VCDIdCodeMap&&) = default;
+
+  /*!
+  @brief Return the index of a code, assigning the next free one if needed.
+  */
+  VCDSignalIndex intern(std::string_view code) {
+    VCDSignalIndex index = find(code);
+    if (index != VCD_SIGNAL_NONE) {
+      return index;
+    }
+
+    index = static_cast<VCDSignalIndex>(codes.size());
+    codes.emplace_back(code);
+
+    uint64_t value;
+    if (vcd_decode_id_code(code, value) && value < max_dense_code) {
+      if (value >= dense.size()) {
+        dense.resize(std::max<uint64_t>(value + 1, dense.size() * 2), VCD_SIGNAL_NONE);
+      }
+      dense[value] = index;
+    } else {
+      // Deque elements do not move, so the key stays valid.
+      sparse.emplace(codes.back(), index);
+    }
+    return index;
+  }
+
+  /*!
+  @brief Return the index of a code, or VCD_SIGNAL_NONE if it is unknown.
+  */
+  [[nodiscard]] VCDSignalIndex find(std::string_view code) const {
+    uint64_t value;
+    if (vcd_decode_id_code(code, value) && value < max_dense_code) {
+      return value < dense.size() ? dense[value] : VCD_SIGNAL_NONE;
+    }
+
+    auto it = sparse.find(code);
+    return it == sparse.end() ? VCD_SIGNAL_NONE : it->second;
+  }
+
+  //! Return the code interned under an index.
+  [[nodiscard]] const VCDSignalHash& code(VCDSignalIndex index) const {
+    return codes.at(index);
+  }
+
+  //! Number of interned codes.
+  [[nodiscard]] std::size_t size() const {
+    return codes.size();
+  }
+
+protected:
+  //! Decoded code to index, VCD_SIGNAL_NONE for unused entries.
+  std::vector<VCDSignalIndex> dense;
+
+  //! Codes which do not fit the dense table, viewing into codes.
+  std::unordered_map<std::string_view, VCDSignalIndex> sparse;
+
+  //! Index to code.
+  std::deque<VCDSignalHash> codes;
+};
@@ -0,0 +1,510 @@
+#pragma once
+
+#include <vcd-parser/VCDCompressedInput.hpp>
+#include <vcd-parser/VCDFile.hpp>
+#include <vcd-parser/VCDFileBuilder.hpp>
+#include <vcd-parser/VCDFileParser.hpp>
+#include <vcd-parser/VCDMappedFile.hpp>
+#include <vcd-parser/VCDNumbers.hpp>
+#include <vcd-parser/VCDTimeline.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*!
+@file VCDLazyFile.hpp
+@brief Opening a VCD file without decoding its values, signals are decoded when first read.
+*/
+
+/*!
+@brief A VCD file whose signal values are decoded on first access.
+@details open() parses the header into a VCDFile and makes one pass
+over the value change section without the grammar, recording the offset
+of every "#time" line and, for each signal, the delta encoded numbers of
+the timestamp blocks it changes in. get_signal_values() decodes a signal
+by scanning only those blocks. Decoded values are kept in a cache of at
+most cache_bytes, least recently used first out. Open time is one pass
+over the file and the index takes a few bytes per timestamp and per
+signal change block, so memory depends on the signals read, not on the
+size of the file.
+
+The selection, start_time and end_time of the parser settings apply as
+for VCDFileParser::parse_file(). Invalid values are only found when
+their signal is decoded. Files which cannot be mapped, such as
+compressed ones, are parsed entirely by open() instead.
+*/
+class VCDLazyFile {
+
+public:
+  /*!
+  @brief Create a lazy file, open() reads it.
+  @param settings in - A parser whose settings are used, threads and use_cache are ignored.
+  */
+  explicit VCDLazyFile(const VCDFileParser& settings = VCDFileParser()) {
+    parser.copy_settings(settings);
+    parser.threads = 1;
+    parser.use_cache = false;
+  }
+
+  VCDLazyFile(const VCDLazyFile&) = delete;
+  VCDLazyFile& operator=(const VCDLazyFile&) = delete;
+
+  /*!
+  @brief Parse the header of a file and index its value changes.
+  @returns false if the file cannot be read or does not parse.
+  */
+  bool open(const std::string& path) {
+    close();
+    parser.filepath = path;
+
+    const bool mapped = parser.memory_map && input.open(path) &&
+        vcd_detect_compression(reinterpret_cast<const unsigned char*>(input.data()), input.size()) ==
+            VCDCompression::NONE;
+    if (!mapped) {
+      input.close();
+      file = parser.parse_file(path);
+      if (file == nullptr) {
+        return false;
+      }
+      cache.resize(file->get_signal_index_count());
+      return true;
+    }
+
+    const std::size_t body = VCDFileParser::header_size(input.data(), input.size());
+    if (body == 0) {
+      parser.error("No $enddefinitions in " + path);
+      return fail();
+    }
+
+    VCDFileBuilder builder(std::make_shared<VCDFile>());
+    parser.reset(builder);
+    std::vector<char> buffer;
+    const bool parsed = parser.parse_buffer(input.data(), body, buffer);
+    parser.visitor = nullptr;
+    if (!parsed) {
+      return fail();
+    }
+    file = builder.get_file();
+
+    declarations.assign(file->get_signal_index_count(), nullptr);
+    id_codes.assign(file->get_signal_index_count(), std::string());
+    for (const VCDSignal& signal : file->get_signals()) {
+      if (declarations[signal.index] == nullptr) {
+        declarations[signal.index] = &signal;
+        id_codes[signal.index] = signal.hash;
+      }
+    }
+
+    if (!scan(body)) {
+      return fail();
+    }
+    cache.resize(id_codes.size());
+    lazy = true;
+    return true;
+  }
+
+  //! Forget the open file and its cached values.
+  void close() {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    input.close();
+    file.reset();
+    lazy = false;
+    declarations.clear();
+    id_codes.clear();
+    block_offsets.clear();
+    block_times.clear();
+    changed_blocks.clear();
+    body_end = 0;
+    cache.clear();
+    recent.clear();
+    cached = 0;
+  }
+
+  /*!
+  @brief The header, scopes, signals and timestamps of the file.
+  @details The values of the signals are not stored in this file, use
+  get_signal_values().
+  */
+  [[nodiscard]] const std::shared_ptr<VCDFile>& get_file() const {
+    return file;
+  }
+
+  /*!
+  @brief Return the values of a signal, decoding them unless cached.
+  @details May be called from several threads. The returned values stay
+  valid after they are evicted from the cache.
+  @param index in - The dense index of the signal.
+  @returns The values, or nullptr if there is no such signal or a value
+  does not parse.
+  */
+  std::shared_ptr<const VCDSignalValues> get_signal_values(VCDSignalIndex index) {
+    if (file == nullptr || index >= file->get_signal_index_count()) {
+      return nullptr;
+    }
+    if (!lazy) {
+      // Parsed entirely, the values share ownership of the file.
+      return std::shared_ptr<const VCDSignalValues>(file, &file->get_signal_values(index));
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(cache_mutex);
+      if (cache[index].values != nullptr) {
+        recent.splice(recent.begin(), recent, cache[index].use);
+        evict();
+        return cache[index].values;
+      }
+    }
+
+    std::string message;
+    std::shared_ptr<const VCDSignalValues> values = decode(index, message);
+
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    if (values == nullptr) {
+      // The parser is shared by all threads, report under the lock.
+      parser.error(message);
+      return nullptr;
+    }
+    Entry& entry = cache[index];
+    if (entry.values != nullptr) {
+      // Decoded by another thread meanwhile.
+      recent.splice(recent.begin(), recent, entry.use);
+      evict();
+      return entry.values;
+    }
+    entry.values = values;
+    entry.bytes = values->memory_usage();
+    entry.use = recent.insert(recent.begin(), index);
+    cached += entry.bytes;
+    evict();
+    return values;
+  }
+
+  /*!
+  @brief Return the values of a signal by its hash, decoding them unless cached.
+  @returns The values, or nullptr if there is no such signal or a value
+  does not parse.
+  */
+  std::shared_ptr<const VCDSignalValues> get_signal_values(std::string_view hash) {
+    return file == nullptr ? nullptr : get_signal_values(file->get_signal_index(hash));
+  }
+
+  //! Are values decoded on demand, rather than parsed by open()?
+  [[nodiscard]] bool is_lazy() const {
+    return lazy;
+  }
+
+  //! Bytes of decoded values in the cache.
+  [[nodiscard]] std::size_t cached_bytes() const {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    return cached;
+  }
+
+  //! Estimate the heap bytes held by the index of the value changes.
+  [[nodiscard]] std::size_t index_bytes() const {
+    std::size_t bytes = block_offsets.capacity() * sizeof(std::size_t) + block_times.capacity() * sizeof(VCDTime) +
+                        changed_blocks.capacity() * sizeof(std::vector<uint8_t>);
+    for (const std::vector<uint8_t>& blocks : changed_blocks) {
+      bytes += blocks.capacity();
+    }
+    return bytes;
+  }
+
+  //! Bytes of decoded values kept at most, the values read last are kept even if larger.
+  std::size_t cache_bytes = std::size_t(256) << 20;
+
+protected:
+  //! Decoded values of a signal in the cache.
+  struct Entry {
+    std::shared_ptr<const VCDSignalValues> values;
+    std::size_t bytes = 0;
+    std::list<VCDSignalIndex>::iterator use;
+  };
+
+  //! Give up opening the file.
+  bool fail() {
+    close();
+    return false;
+  }
+
+  //! Return the next whitespace separated token at or after pos, empty at to.
+  std::string_view next_token(std::size_t& pos, std::size_t to) const {
+    const char* data = input.data();
+    while (pos < to && (data[pos] == ' ' || data[pos] == '\t' || data[pos] == '\r' || data[pos] == '\n')) {
+      pos++;
+    }
+    const std::size_t start = pos;
+    while (pos < to && data[pos] != ' ' && data[pos] != '\t' && data[pos] != '\r' && data[pos] != '\n') {
+      pos++;
+    }
+    return {data + start, pos - start};
+  }
+
+  /*!
+  @brief Walk the commands of the value change section between two offsets.
+  @details Calls on_time(time, offset of the '#') for each "#time" line,
+  stopping if it returns false, and on_change(value, id code) for each
+  value change, value including its leading 'b' or 'r'. Comments are
+  skipped, other keywords are ignored. The parser is not touched, so
+  several threads may walk at once.
+  @param message out - Why the walk failed.
+  @returns false if a token is not part of the value change section.
+  */
+  template <typename OnTime, typename OnChange>
+  bool walk(std::size_t from, std::size_t to, OnTime on_time, OnChange on_change, std::string& message) const {
+    std::size_t pos = from;
+    for (;;) {
+      std::string_view token = next_token(pos, to);
+      if (token.empty()) {
+        return true;
+      }
+      const std::size_t offset = pos - token.size();
+      switch (token[0]) {
+        case '#': {
+          std::string_view digits = token.substr(1);
+          if (digits.empty()) {
+            digits = next_token(pos, to);
+          }
+          VCDTime time = 0;
+          if (!vcd_parse_time(digits, time)) {
+            message = "Time out of range: #" + std::string(digits);
+            return false;
+          }
+          if (!on_time(time, offset)) {
+            return true;
+          }
+          break;
+        }
+        case '$':
+          if (token == "$comment") {
+            while (!token.empty() && token != "$end") {
+              token = next_token(pos, to);
+            }
+          }
+          break;
+        case '0':
+        case '1':
+        case 'x':
+        case 'X':
+        case 'z':
+        case 'Z':
+          on_change(token.substr(0, 1), token.size() > 1 ? token.substr(1) : next_token(pos, to));
+          break;
+        case 'b':
+        case 'B':
+        case 'r':
+        case 'R':
+          on_change(token, next_token(pos, to));
+          break;
+        default:
+          message = "Unexpected " + std::string(token) + " in the value change section of " + parser.filepath;
+          return false;
+      }
+    }
+  }
+
+  //! Index the timestamp blocks and the blocks each signal changes in.
+  bool scan(std::size_t body) {
+    // Changes before the first "#time" line are at time 0.
+    block_offsets.assign(1, body);
+    block_times.assign(1, 0);
+    changed_blocks.assign(id_codes.size(), std::vector<uint8_t>());
+    std::vector<std::size_t> last_block(id_codes.size(), std::numeric_limits<std::size_t>::max());
+    body_end = input.size();
+
+    const auto on_time = [&](VCDTime time, std::size_t offset) {
+      if (time > parser.end_time) {
+        body_end = offset;
+        return false;
+      }
+      if (time > parser.start_time) {
+        file->add_timestamp(time);
+      }
+      block_offsets.push_back(offset);
+      block_times.push_back(time);
+      return true;
+    };
+
+    const auto on_change = [&](std::string_view, std::string_view id_code) {
+      const std::size_t block = block_times.size() - 1;
+      if (block_times[block] <= parser.start_time || !parser.change_selected(id_code)) {
+        return;
+      }
+      VCDSignalIndex index = file->get_signal_index(id_code);
+      if (index == VCD_SIGNAL_NONE) {
+        index = file->intern_signal(id_code);
+        declarations.push_back(nullptr);
+        id_codes.emplace_back(id_code);
+        changed_blocks.emplace_back();
+        last_block.push_back(std::numeric_limits<std::size_t>::max());
+      }
+      if (last_block[index] == block) {
+        return;
+      }
+      const std::size_t previous = last_block[index] == std::numeric_limits<std::size_t>::max() ? 0 : last_block[index];
+      put_varint(changed_blocks[index], block - previous);
+      last_block[index] = block;
+    };
+
+    std::string message;
+    if (!walk(body, input.size(), on_time, on_change, message)) {
+      parser.error(message);
+      return false;
+    }
+
+    block_offsets.push_back(body_end);
+    for (std::vector<uint8_t>& blocks : changed_blocks) {
+      blocks.shrink_to_fit();
+    }
+    return true;
+  }
+
+  /*!
+  @brief Decode the values of a signal from the blocks it changes in.
+  @details Runs without cache_mutex, so errors are left to the caller.
+  @param message out - Why the values do not decode.
+  @returns The values, or nullptr if a value does not parse.
+  */
+  std::shared_ptr<const VCDSignalValues> decode(VCDSignalIndex index, std::string& message) const {
+    const VCDSignal* declaration = declarations[index];
+    auto values = declaration != nullptr ? std::make_shared<VCDSignalValues>(declaration->type, declaration->size)
+                                         : std::make_shared<VCDSignalValues>();
+    const std::string_view id_code = id_codes[index];
+
+    bool valid = true;
+    VCDTime time = 0;
+    const auto on_time = [](VCDTime, std::size_t) { return true; };
+    const auto on_change = [&](std::string_view value, std::string_view code) {
+      if (code != id_code || !valid) {
+        return;
+      }
+      switch (value[0]) {
+        case 'b':
+        case 'B':
+          values->push_back_ascii(time, value.data() + 1, value.size() - 1);
+          break;
+        case 'r':
+        case 'R': {
+          VCDReal real = 0;
+          if (!vcd_parse_real(value.substr(1), real)) {
+            message = "Invalid real value: " + std::string(value);
+            valid = false;
+            return;
+          }
+          values->push_back(time, real);
+          break;
+        }
+        default:
+          values->push_back(time, scalar_bit(value[0]));
+          break;
+      }
+    };
+
+    const std::vector<uint8_t>& blocks = changed_blocks[index];
+    std::size_t block = 0;
+    for (std::size_t pos = 0; pos < blocks.size() && valid;) {
+      block += get_varint(blocks, pos);
+      time = block_times[block];
+      if (!walk(block_offsets[block], block_offsets[block + 1], on_time, on_change, message)) {
+        return nullptr;
+      }
+    }
+    return valid ? values : nullptr;
+  }
+
+  //! Return the bit of a scalar value character.
+  static VCDBit scalar_bit(char c) {
+    switch (c) {
+      case '0':
+        return VCDBit::VCD_0;
+      case '1':
+        return VCDBit::VCD_1;
+      case 'z':
+      case 'Z':
+        return VCDBit::VCD_Z;
+      default:
+        return VCDBit::VCD_X;
+    }
+  }
+
+  //! Append an unsigned LEB128 number.
+  static void put_varint(std::vector<uint8_t>& out, std::size_t value) {
+    while (value >= 0x80) {
+      out.push_back(static_cast<uint8_t>(value | 0x80));
+      value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+  }
+
+  //! Read an unsigned LEB128 number at pos, advancing pos.
+  static std::size_t get_varint(const std::vector<uint8_t>& in, std::size_t& pos) {
+    std::size_t value = 0;
+    for (unsigned shift = 0; pos < in.size(); shift += 7) {
+      const uint8_t byte = in[pos++];
+      value |= static_cast<std::size_t>(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0) {
+        break;
+      }
+    }
+    return value;
+  }
+
+  //! Drop the least recently used values until the cache fits cache_bytes, called with cache_mutex held.
+  void evict() {
+    while (cached > cache_bytes && recent.size() > 1) {
+      Entry& victim = cache[recent.back()];
+      cached -= victim.bytes;
+      victim.values.reset();
+      victim.bytes = 0;
+      recent.pop_back();
+    }
+  }
+
+  //! Parses the header, its settings apply to the whole file.
+  VCDFileParser parser;
+
+  //! The mapped file.
+  VCDMappedFile input;
+
+  //! Header, scopes, signals and timestamps.
+  std::shared_ptr<VCDFile> file;
+
+  //! Are values decoded on demand?
+  bool lazy = false;
+
+  //! First declaration of each signal index, nullptr if undeclared.
+  std::vector<const VCDSignal*> declarations;
+
+  //! Id code of each signal index.
+  std::vector<std::string> id_codes;
+
+  //! Offset of each timestamp block, the first holding the changes before any "#time", and the end of the last block.
+  std::vector<std::size_t> block_offsets;
+
+  //! Time of each timestamp block.
+  std::vector<VCDTime> block_times;
+
+  //! Delta encoded numbers of the blocks each signal changes in.
+  std::vector<std::vector<uint8_t>> changed_blocks;
+
+  //! Offset where the value changes within end_time end.
+  std::size_t body_end = 0;
+
+  //! Cached values by signal index.
+  std::vector<Entry> cache;
+
+  //! Signal indices in the cache, most recently used first.
+  std::list<VCDSignalIndex> recent;
+
+  //! Bytes of values in the cache.
+  std::size_t cached = 0;
+
+  //! Guards cache, recent and cached.
+  mutable std::mutex cache_mutex;
+};
@@ -0,0 +1,155 @@
+/*!
+@file
+@brief Contains the read-only memory mapping used as zero-copy scanner input.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*!
+@brief A file mapped into memory, followed by two NUL bytes.
+@details The scanner tokenizes the mapping in place, so the mapping is
+private and writable: flex temporarily NUL-terminates each token, and those
+writes are never seen by the file. The two trailing NUL bytes are the end
+of buffer marker flex requires for yy_scan_buffer().
+On platforms without mmap the file is read into a heap buffer instead.
+*/
+class VCDMappedFile {
+
+public:
+  VCDMappedFile() = default;
+
+  VCDMappedFile(const VCDMappedFile&) = delete;
+  VCDMappedFile& operator=(const VCDMappedFile&) = delete;
+
+  ~VCDMappedFile() {
+    close();
+  }
+
+  /*!
+  @brief Map the file at path, replacing any previous mapping.
+  @returns false if the file cannot be opened or mapped, errno tells why.
+  */
+  bool open(const std::string& path) {
+    close();
+
+#if !defined(_WIN32)
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+
+    struct stat st{};
+    if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+      ::close(fd);
+      return false;
+    }
+
+    const auto page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    length = static_cast<std::size_t>(st.st_size);
+    reserved = ((length + 2 + page - 1) / page) * page;
+
+    // Reserve zeroed memory for file and padding, then map the file over it.
+    void* base = ::mmap(nullptr, reserved, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+      ::close(fd);
+      return false;
+    }
+
+    if (length > 0 &&
+        ::mmap(base, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+      ::munmap(base, reserved);
+      ::close(fd);
+      return false;
+    }
+    ::close(fd);
+
+#if defined(MADV_SEQUENTIAL)
+    ::madvise(base, reserved, MADV_SEQUENTIAL);
+#endif
+
+    mapping = static_cast<char*>(base);
+#else
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+      return false;
+    }
+    std::fseek(file, 0, SEEK_END);
+    length = static_cast<std::size_t>(std::ftell(file));
+    std::fseek(file, 0, SEEK_SET);
+
+    heap_copy = std::make_unique<char[]>(length + 2);
+    if (std::fread(heap_copy.get(), 1, length, file) != length) {
+      std::fclose(file);
+      heap_copy.reset();
+      return false;
+    }
+    std::fclose(file);
+    heap_copy[length] = heap_copy[length + 1] = '\0';
+
+    mapping = heap_copy.get();
+#endif
+    return true;
+  }
+
+  //! Release the mapping.
+  void close() {
+#if !defined(_WIN32)
+    if (mapping != nullptr) {
+      ::munmap(mapping, reserved);
+    }
+#else
+    heap_copy.reset();
+#endif
+    mapping = nullptr;
+    length = 0;
+    reserved = 0;
+  }
+
+  //! Is a file currently mapped?
+  [[nodiscard]] bool is_open() const {
+    return mapping != nullptr;
+  }
+
+  //! First byte of the file contents.
+  [[nodiscard]] const char* data() const {
+    return mapping;
+  }
+
+  //! Writable view of the file contents, as handed to the scanner.
+  char* buffer() {
+    return mapping;
+  }
+
+  //! Size of the file in bytes, without the trailing padding.
+  [[nodiscard]] std::size_t size() const {
+    return length;
+  }
+
+protected:
+  //! Start of the mapping.
+  char* mapping = nullptr;
+
+  //! Number of file bytes in the mapping.
+  std::size_t length = 0;
+
+  //! Number of bytes reserved for file and padding.
+  std::size_t reserved = 0;
+
+#if defined(_WIN32)
+  //! Fallback storage where mmap is not available.
+  std::unique_ptr<char[]> heap_copy;
+#endif
+};
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <vcd-parser/VCDTypes.hpp>
+
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+
+/*!
+@file VCDNumbers.hpp
+@brief Locale independent conversion of the numbers of a VCD file.
+*/
+
+/*!
+@brief Convert a decimal integer.
+@details The whole text must be consumed, so trailing characters and
+values outside the range of T are errors rather than being cut off.
+@returns false if the text is not a number or does not fit into T.
+*/
+template <typename T>
+bool vcd_parse_integer(std::string_view text, T& value) {
+  static_assert(std::is_integral_v<T>, "vcd_parse_integer converts integers");
+  const char* last = text.data() + text.size();
+  const auto result = std::from_chars(text.data(), last, value);
+  return result.ec == std::errc() && result.ptr == last;
+}
+
+/*!
+@brief Convert the digits of a #time line.
+@details Timestamps dominate dense dumps, so up to 18 digits, which can
+not overflow a VCDTime, are converted in one loop without a branch per
+digit. Longer numbers take the range checked std::from_chars path.
+@returns false if the text is empty, not all digits or exceeds VCDTime.
+*/
+inline bool vcd_parse_time(std::string_view text, VCDTime& time) {
+  if (text.empty() || text.size() > 18) {
+    return vcd_parse_integer(text, time);
+  }
+
+  uint64_t value = 0;
+  unsigned invalid = 0;
+  for (const char c : text) {
+    const unsigned digit = static_cast<unsigned char>(c) - unsigned('0');
+    invalid |= digit > 9 ? 1u : 0u;
+    value = value * 10 + digit;
+  }
+  time = static_cast<VCDTime>(value);
+  return invalid == 0;
+}
+
+/*!
+@brief Convert a real value as dumped by $dumpvars and value changes.
+@details Accepts fixed and exponent forms, an optional sign, inf and
+nan, at full double precision. std::from_chars rejects a leading '+',
+so it is skipped here. Standard libraries without floating point
+std::from_chars fall back to std::strtod.
+@returns false if the text is not a complete real number.
+*/
+inline bool vcd_parse_real(std::string_view text, VCDReal& value) {
+  if (text.size() > 1 && text[0] == '+' && text[1] != '-' && text[1] != '+') {
+    text.remove_prefix(1);
+  }
+  if (text.empty()) {
+    return false;
+  }
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+  const char* last = text.data() + text.size();
+  const auto result = std::from_chars(text.data(), last, value);
+  if (result.ptr != last) {
+    return false;
+  }
+  if (result.ec == std::errc::result_out_of_range) {
+    // Underflow and overflow round to zero and infinity, like strtod.
+    const std::string copy(text);
+    value = std::strtod(copy.c_str(), nullptr);
+    return true;
+  }
+  return result.ec == std::errc();
+#else
+  const std::string copy(text);
+  char* end = nullptr;
+  value = std::strtod(copy.c_str(), &end);
+  return end == copy.c_str() + copy.size();
+#endif
+}
@@ -0,0 +1,464 @@
+#pragma once
+
+#include <vcd-parser/VCDTypes.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define VCD_PARSER_SSE2
+#endif
+
+/*!
+@file VCDPackedVector.hpp
+@brief A four-state bit vector storing two bits per VCDBit.
+*/
+
+/*!
+@brief Four-state bit vector, stored as a value plane and an unknown plane.
+@details Bit i of the value plane and bit i of the unknown plane together
+hold the numeric value of the VCDBit at position i: 0 = (0,0), 1 = (1,0),
+X = (0,1) and Z = (1,1). Position 0 is the least significant bit, which is
+the last character of the VCD text. Vectors of up to 64 bits are stored
+inline, wider ones on the heap. Bits above the width are always zero in
+both planes.
+*/
+class VCDPackedVector {
+
+public:
+  //! Widest vector stored without a heap allocation.
+  static constexpr std::size_t inline_bits = 64;
+
+  VCDPackedVector() = default;
+
+  //! Create a vector of the given width with every bit set to fill.
+  explicit VCDPackedVector(std::size_t width, VCDBit fill = VCDBit::VCD_0) {
+    resize(width);
+    const uint64_t value = (static_cast<int>(fill) & 1) ? ~uint64_t(0) : 0;
+    const uint64_t unknown = (static_cast<int>(fill) & 2) ? ~uint64_t(0) : 0;
+    for (std::size_t w = 0; w < words(); ++w) {
+      value_words()[w] = value & word_mask(w);
+      unknown_words()[w] = unknown & word_mask(w);
+    }
+  }
+
+  //! Create a vector from VCDBits, most significant bit first.
+  explicit VCDPackedVector(const VCDBitVector& bits) {
+    resize(bits.size());
+    for (std::size_t i = 0; i < bits.size(); ++i) {
+      set(bits.size() - 1 - i, bits[i]);
+    }
+  }
+
+  /*!
+  @brief Create a vector from its two planes.
+  @param width in - Number of bits.
+  @param value in - (width + 63) / 64 words of the value plane.
+  @param unknown in - (width + 63) / 64 words of the unknown plane.
+  */
+  VCDPackedVector(std::size_t width, const uint64_t* value, const uint64_t* unknown) {
+    resize(width);
+    std::memcpy(value_words(), value, words() * sizeof(uint64_t));
+    std::memcpy(unknown_words(), unknown, words() * sizeof(uint64_t));
+  }
+
+  VCDPackedVector(const VCDPackedVector& other) {
+    *this = other;
+  }
+
+  VCDPackedVector(VCDPackedVector&& other) noexcept {
+    *this = std::move(other);
+  }
+
+  VCDPackedVector& operator=(const VCDPackedVector& other) {
+    if (this != &other) {
+      resize(other.width());
+      std::memcpy(data(), other.data(), 2 * words() * sizeof(uint64_t));
+    }
+    return *this;
+  }
+
+  VCDPackedVector& operator=(VCDPackedVector&& other) noexcept {
+    if (this != &other) {
+      release();
+      bits = other.bits;
+      if (bits > inline_bits) {
+        heap = other.heap;
+      } else {
+        local[0] = other.local[0];
+        local[1] = other.local[1];
+      }
+      other.bits = 0;
+      other.local[0] = other.local[1] = 0;
+    }
+    return *this;
+  }
+
+  ~VCDPackedVector() {
+    release();
+  }
+
+  /*!
+  @brief Convert VCD binary text into a vector.
+  @param text in - Characters 0, 1, x, X, z or Z, most significant bit
+  first, without the leading 'b'. Anything else is read as X.
+  @param length in - Number of characters, which becomes the width.
+  */
+  static VCDPackedVector from_ascii(const char* text, std::size_t length) {
+    VCDPackedVector vec;
+    vec.resize(length);
+    pack_ascii(text, length, vec.value_words(), vec.unknown_words());
+    return vec;
+  }
+
+  /*!
+  @brief Convert VCD binary text into the two planes of a vector.
+  @details Full blocks of 64 characters are classified with SSE2 or AVX2
+  where the compiler targets them, the remainder with scalar code.
+  @param text in - Characters, most significant bit first.
+  @param length in - Number of characters.
+  @param value out - (length + 63) / 64 words of the value plane.
+  @param unknown out - (length + 63) / 64 words of the unknown plane.
+  */
+  static void pack_ascii(const char* text, std::size_t length, uint64_t* value, uint64_t* unknown) {
+    const std::size_t full = length / 64;
+    const std::size_t rest = length % 64;
+
+    // Word w holds the characters [length - 64 (w + 1), length - 64 w).
+    for (std::size_t w = 0; w < full; ++w) {
+      const char* block = text + length - 64 * (w + 1);
+      uint64_t is_one, is_z, is_known;
+      classify64(block, is_one, is_z, is_known);
+      value[w] = reverse_bits(is_one | is_z);
+      unknown[w] = reverse_bits(~is_known);
+    }
+
+    if (rest != 0) {
+      uint64_t v = 0;
+      uint64_t u = 0;
+      for (std::size_t i = 0; i < rest; ++i) {
+        const uint64_t code = char_code(text[i]);
+        v = (v << 1) | (code & 1);
+        u = (u << 1) | (code >> 1);
+      }
+      value[full] = v;
+      unknown[full] = u;
+    }
+  }
+
+  //! Number of bits in the vector.
+  [[nodiscard]] std::size_t width() const {
+    return bits;
+  }
+
+  //! Number of 64-bit words in each plane.
+  [[nodiscard]] std::size_t words() const {
+    return (bits + 63) / 64;
+  }
+
+  //! Words of the value plane, least significant first.
+  [[nodiscard]] const uint64_t* value_words() const {
+    return data();
+  }
+
+  //! Words of the unknown plane, least significant first.
+  [[nodiscard]] const uint64_t* unknown_words() const {
+    return data() + words();
+  }
+
+  //! Words of the value plane, least significant first.
+  uint64_t* value_words() {
+    return data();
+  }
+
+  //! Words of the unknown plane, least significant first.
+  uint64_t* unknown_words() {
+    return data() + words();
+  }
+
+  //! Return the bit at position i, 0 being the least significant bit.
+  [[nodiscard]] VCDBit get(std::size_t i) const {
+    const uint64_t v = (value_words()[i / 64] >> (i % 64)) & 1;
+    const uint64_t u = (unknown_words()[i / 64] >> (i % 64)) & 1;
+    return static_cast<VCDBit>(v | (u << 1));
+  }
+
+  //! Return the bit at position i, 0 being the least significant bit.
+  VCDBit operator[](std::size_t i) const {
+    return get(i);
+  }
+
+  //! Set the bit at position i, 0 being the least significant bit.
+  void set(std::size_t i, VCDBit bit) {
+    const uint64_t mask = uint64_t(1) << (i % 64);
+    const auto code = static_cast<uint64_t>(bit);
+    uint64_t& v = value_words()[i / 64];
+    uint64_t& u = unknown_words()[i / 64];
+    v = (code & 1) ? (v | mask) : (v & ~mask);
+    u = (code & 2) ? (u | mask) : (u & ~mask);
+  }
+
+  //! Does any bit hold X or Z?
+  [[nodiscard]] bool has_unknown() const {
+    for (std::size_t w = 0; w < words(); ++w) {
+      if (unknown_words()[w] != 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /*!
+  @brief Return the vector as unsigned integer.
+  @returns false if the vector is wider than 64 bits or holds X or Z.
+  */
+  bool to_uint64(uint64_t& out) const {
+    if (bits > 64 || has_unknown()) {
+      return false;
+    }
+    out = bits == 0 ? 0 : value_words()[0];
+    return true;
+  }
+
+  //! Convert to the unpacked representation, most significant bit first.
+  [[nodiscard]] VCDBitVector to_bit_vector() const {
+    VCDBitVector vec(bits);
+    for (std::size_t i = 0; i < bits; ++i) {
+      vec[bits - 1 - i] = get(i);
+    }
+    return vec;
+  }
+
+  //! Convert to text, most significant bit first.
+  [[nodiscard]] std::string to_string() const {
+    static constexpr char chars[] = {'0', '1', 'X', 'Z'};
+    std::string text(bits, '0');
+    for (std::size_t i = 0; i < bits; ++i) {
+      text[bits - 1 - i] = chars[static_cast<int>(get(i))];
+    }
+    return text;
+  }
+
+  /*!
+  @brief Return the bits [lsb, lsb + width) as a new vector.
+  @details Bits above the width of this vector read as 0.
+  */
+  [[nodiscard]] VCDPackedVector slice(std::size_t lsb, std::size_t width) const {
+    VCDPackedVector result;
+    result.resize(width);
+    for (std::size_t w = 0; w < result.words(); ++w) {
+      result.value_words()[w] = extract(value_words(), lsb + 64 * w) & result.word_mask(w);
+      result.unknown_words()[w] = extract(unknown_words(), lsb + 64 * w) & result.word_mask(w);
+    }
+    return result;
+  }
+
+  //! Four-state bitwise AND, the shorter operand is zero extended.
+  friend VCDPackedVector operator&(const VCDPackedVector& a, const VCDPackedVector& b) {
+    return combine(a, b, [](uint64_t a1, uint64_t a0, uint64_t b1, uint64_t b0, uint64_t& r1, uint64_t& r0) {
+      r1 = a1 & b1;
+      r0 = a0 | b0;
+    });
+  }
+
+  //! Four-state bitwise OR, the shorter operand is zero extended.
+  friend VCDPackedVector operator|(const VCDPackedVector& a, const VCDPackedVector& b) {
+    return combine(a, b, [](uint64_t a1, uint64_t a0, uint64_t b1, uint64_t b0, uint64_t& r1, uint64_t& r0) {
+      r1 = a1 | b1;
+      r0 = a0 & b0;
+    });
+  }
+
+  //! Four-state bitwise XOR, the shorter operand is zero extended.
+  friend VCDPackedVector operator^(const VCDPackedVector& a, const VCDPackedVector& b) {
+    return combine(a, b, [](uint64_t a1, uint64_t a0, uint64_t b1, uint64_t b0, uint64_t& r1, uint64_t& r0) {
+      r1 = (a1 & b0) | (a0 & b1);
+      r0 = (a1 & b1) | (a0 & b0);
+    });
+  }
+
+  //! Four-state bitwise NOT, X and Z become X.
+  friend VCDPackedVector operator~(const VCDPackedVector& a) {
+    VCDPackedVector result;
+    result.resize(a.width());
+    for (std::size_t w = 0; w < a.words(); ++w) {
+      const uint64_t u = a.unknown_words()[w];
+      result.value_words()[w] = ~a.value_words()[w] & ~u & a.word_mask(w);
+      result.unknown_words()[w] = u;
+    }
+    return result;
+  }
+
+  //! Case equality: same width and identical bits, X and Z included.
+  friend bool operator==(const VCDPackedVector& a, const VCDPackedVector& b) {
+    return a.bits == b.bits && std::memcmp(a.data(), b.data(), 2 * a.words() * sizeof(uint64_t)) == 0;
+  }
+
+  //! Case inequality.
+  friend bool operator!=(const VCDPackedVector& a, const VCDPackedVector& b) {
+    return !(a == b);
+  }
+
+protected:
+  //! Change the width, discarding the contents.
+  void resize(std::size_t width) {
+    if ((width > inline_bits || bits > inline_bits) && (width + 63) / 64 != words()) {
+      release();
+      if (width > inline_bits) {
+        heap = new uint64_t[2 * ((width + 63) / 64)]();
+      }
+    }
+    bits = width;
+    std::memset(data(), 0, 2 * words() * sizeof(uint64_t));
+  }
+
+  //! Free heap storage, if any, leaving an empty vector.
+  void release() {
+    if (bits > inline_bits) {
+      delete[] heap;
+    }
+    bits = 0;
+    local[0] = local[1] = 0;
+  }
+
+  //! Both planes, value plane first.
+  [[nodiscard]] const uint64_t* data() const {
+    return bits > inline_bits ? heap : local;
+  }
+
+  //! Both planes, value plane first.
+  uint64_t* data() {
+    return bits > inline_bits ? heap : local;
+  }
+
+  //! Mask of the bits of word w which lie within the width.
+  [[nodiscard]] uint64_t word_mask(std::size_t w) const {
+    const std::size_t used = bits - 64 * w;
+    return used >= 64 ? ~uint64_t(0) : (uint64_t(1) << used) - 1;
+  }
+
+  //! Read 64 bits of a plane starting at bit position, zero above the width.
+  [[nodiscard]] uint64_t extract(const uint64_t* plane, std::size_t position) const {
+    const std::size_t w = position / 64;
+    const std::size_t shift = position % 64;
+    uint64_t low = w < words() ? plane[w] >> shift : 0;
+    if (shift != 0 && w + 1 < words()) {
+      low |= plane[w + 1] << (64 - shift);
+    }
+    return low;
+  }
+
+  /*!
+  @brief Apply a four-state operator word by word.
+  @details The operator receives the known-one and known-zero masks of
+  both operands and returns those of the result, any bit in neither
+  result mask becomes X.
+  */
+  template <typename Op>
+  static VCDPackedVector combine(const VCDPackedVector& a, const VCDPackedVector& b, Op op) {
+    VCDPackedVector result;
+    result.resize(std::max(a.width(), b.width()));
+    for (std::size_t w = 0; w < result.words(); ++w) {
+      const uint64_t mask = result.word_mask(w);
+      const uint64_t av = w < a.words() ? a.value_words()[w] : 0;
+      const uint64_t au = w < a.words() ? a.unknown_words()[w] : 0;
+      const uint64_t bv = w < b.words() ? b.value_words()[w] : 0;
+      const uint64_t bu = w < b.words() ? b.unknown_words()[w] : 0;
+      uint64_t r1, r0;
+      op(av & ~au, ~av & ~au & mask, bv & ~bu, ~bv & ~bu & mask, r1, r0);
+      result.value_words()[w] = r1;
+      result.unknown_words()[w] = ~(r1 | r0) & mask;
+    }
+    return result;
+  }
+
+  //! Numeric VCDBit value of a character.
+  static uint64_t char_code(char c) {
+    switch (c) {
+      case '0':
+        return 0;
+      case '1':
+        return 1;
+      case 'z':
+      case 'Z':
+        return 3;
+      default:
+        return 2;
+    }
+  }
+
+  //! Reverse the order of the bits in a word.
+  static uint64_t reverse_bits(uint64_t x) {
+    x = ((x >> 1) & 0x5555555555555555ull) | ((x & 0x5555555555555555ull) << 1);
+    x = ((x >> 2) & 0x3333333333333333ull) | ((x & 0x3333333333333333ull) << 2);
+    x = ((x >> 4) & 0x0F0F0F0F0F0F0F0Full) | ((x & 0x0F0F0F0F0F0F0F0Full) << 4);
+    x = ((x >> 8) & 0x00FF00FF00FF00FFull) | ((x & 0x00FF00FF00FF00FFull) << 8);
+    x = ((x >> 16) & 0x0000FFFF0000FFFFull) | ((x & 0x0000FFFF0000FFFFull) << 16);
+    return (x >> 32) | (x << 32);
+  }
+
+  /*!
+  @brief Classify 64 characters, bit j of each mask describes block[j].
+  @param is_one out - Characters '1'.
+  @param is_z out - Characters 'z' and 'Z'.
+  @param is_known out - Characters '0' and '1'.
+  */
+  static void classify64(const char* block, uint64_t& is_one, uint64_t& is_z, uint64_t& is_known) {
+#if defined(__AVX2__)
+    const __m256i one = _mm256_set1_epi8('1');
+    const __m256i zero = _mm256_set1_epi8('0');
+    const __m256i z = _mm256_set1_epi8('z');
+    const __m256i lower = _mm256_set1_epi8(0x20);
+    is_one = is_z = is_known = 0;
+    for (int half = 0; half < 2; ++half) {
+      const __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32 * half));
+      const __m256i eq1 = _mm256_cmpeq_epi8(c, one);
+      const __m256i eq0 = _mm256_cmpeq_epi8(c, zero);
+      const __m256i eqz = _mm256_cmpeq_epi8(_mm256_or_si256(c, lower), z);
+      const int shift = 32 * half;
+      is_one |= uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(eq1))) << shift;
+      is_z |= uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(eqz))) << shift;
+      is_known |= uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(eq0, eq1)))) << shift;
+    }
+#elif defined(VCD_PARSER_SSE2)
+    const __m128i one = _mm_set1_epi8('1');
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i z = _mm_set1_epi8('z');
+    const __m128i lower = _mm_set1_epi8(0x20);
+    is_one = is_z = is_known = 0;
+    for (int quarter = 0; quarter < 4; ++quarter) {
+      const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16 * quarter));
+      const __m128i eq1 = _mm_cmpeq_epi8(c, one);
+      const __m128i eq0 = _mm_cmpeq_epi8(c, zero);
+      const __m128i eqz = _mm_cmpeq_epi8(_mm_or_si128(c, lower), z);
+      const int shift = 16 * quarter;
+      is_one |= uint64_t(static_cast<uint32_t>(_mm_movemask_epi8(eq1))) << shift;
+      is_z |= uint64_t(static_cast<uint32_t>(_mm_movemask_epi8(eqz))) << shift;
+      is_known |= uint64_t(static_cast<uint32_t>(_mm_movemask_epi8(_mm_or_si128(eq0, eq1)))) << shift;
+    }
+#else
+    is_one = is_z = is_known = 0;
+    for (int j = 0; j < 64; ++j) {
+      const uint64_t code = char_code(block[j]);
+      is_one |= uint64_t(code == 1) << j;
+      is_z |= uint64_t(code == 3) << j;
+      is_known |= uint64_t(code < 2) << j;
+    }
+#endif
+  }
+
+  //! Number of bits.
+  std::size_t bits = 0;
+
+  //! Inline planes for narrow vectors, heap planes for wide ones.
+  union {
+    uint64_t local[2] = {0, 0};
+    uint64_t* heap;
+  };
+};
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <vcd-parser/VCDTypes.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <numeric>
+#include <string>
+#include <vector>
+
+/*!
+@file VCDParseStats.hpp
+@brief Counters and phase timers of a parse.
+*/
+
+/*!
+@brief Statistics collected by VCDFileParser when collect_stats is set.
+@details Counters are exact. storage_seconds is extrapolated from timing
+one in storage_sample value changes, so the clock does not dominate the
+cost of a change. The phases of a parallel parse are summed over all
+threads, so they may add up to more than the wall clock time.
+*/
+struct VCDParseStats {
+
+  //! One in this many value changes is timed for storage_seconds.
+  static constexpr uint64_t storage_sample = 64;
+
+  //! Bytes handed to the scanner.
+  uint64_t bytes = 0;
+
+  //! Number of tokens of each kind, by grammar symbol name.
+  std::map<std::string, uint64_t> tokens;
+
+  //! Number of #time lines.
+  uint64_t timestamps = 0;
+
+  //! Number of scalar value changes.
+  uint64_t scalar_changes = 0;
+
+  //! Number of vector value changes.
+  uint64_t vector_changes = 0;
+
+  //! Number of real value changes.
+  uint64_t real_changes = 0;
+
+  //! Seconds spent up to $enddefinitions.
+  double header_seconds = 0.0;
+
+  //! Seconds spent after $enddefinitions, including storage.
+  double body_seconds = 0.0;
+
+  //! Estimated seconds spent in the visitor storing value changes.
+  double storage_seconds = 0.0;
+
+  //! Number of value changes by signal index.
+  std::vector<uint64_t> signal_changes;
+
+  //! Estimated bytes held by the timeline of each signal index, when parsed into a VCDFile.
+  std::vector<std::size_t> signal_bytes;
+
+  //! Reset all counters.
+  void clear() {
+    *this = VCDParseStats();
+  }
+
+  //! Total number of value changes.
+  [[nodiscard]] uint64_t changes() const {
+    return scalar_changes + vector_changes + real_changes;
+  }
+
+  //! Count a value change of a signal.
+  void count_change(VCDSignalIndex index) {
+    if (index >= signal_changes.size()) {
+      signal_changes.resize(index + 1, 0);
+    }
+    signal_changes[index]++;
+  }
+
+  //! Add the counters of another parse, e.g. of a chunk parsed by another thread.
+  void merge(const VCDParseStats& other) {
+    bytes += other.bytes;
+    for (const auto& [name, count] : other.tokens) {
+      tokens[name] += count;
+    }
+    timestamps += other.timestamps;
+    scalar_changes += other.scalar_changes;
+    vector_changes += other.vector_changes;
+    real_changes += other.real_changes;
+    header_seconds += other.header_seconds;
+    body_seconds += other.body_seconds;
+    storage_seconds += other.storage_seconds;
+
+    if (other.signal_changes.size() > signal_changes.size()) {
+      signal_changes.resize(other.signal_changes.size(), 0);
+    }
+    for (std::size_t i = 0; i < other.signal_changes.size(); ++i) {
+      signal_changes[i] += other.signal_changes[i];
+    }
+  }
+
+  /*!
+  @brief Return the signal indices with the most bytes held, or the most
+  changes if no bytes were recorded.
+  @param count in - The maximum number of indices to return.
+  */
+  [[nodiscard]] std::vector<VCDSignalIndex> top_signals(std::size_t count) const {
+    const bool by_bytes = !signal_bytes.empty();
+    const std::size_t size = by_bytes ? signal_bytes.size() : signal_changes.size();
+
+    std::vector<VCDSignalIndex> indices(size);
+    std::iota(indices.begin(), indices.end(), VCDSignalIndex(0));
+
+    const auto key = [&](VCDSignalIndex i) -> uint64_t {
+      if (by_bytes) {
+        return signal_bytes[i];
+      }
+      return signal_changes[i];
+    };
+
+    count = std::min(count, indices.size());
+    std::partial_sort(indices.begin(), indices.begin() + static_cast<std::ptrdiff_t>(count), indices.end(),
+                      [&](VCDSignalIndex a, VCDSignalIndex b) { return key(a) > key(b); });
+    indices.resize(count);
+    return indices;
+  }
+};
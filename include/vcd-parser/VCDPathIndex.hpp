@@ -0,0 +1,257 @@
+#pragma once
+
+#include <vcd-parser/VCDSignalSelection.hpp>
+#include <vcd-parser/VCDTypes.hpp>
+
+#include <charconv>
+#include <cstddef>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/*!
+@file VCDPathIndex.hpp
+@brief Lookup of scopes and signals by hierarchical path.
+*/
+
+/*!
+@brief Hashed map of the hierarchical paths of the scopes and signals of a file.
+@details Paths are the scope names below $root and the signal
+reference, joined by '.', e.g. "testbench.uut.clk", as in
+VCDSignalSelection. Scopes and signals are added as they are declared,
+so a lookup hashes the path once and costs O(path length). Scopes
+opened more than once under the same path share an entry.
+*/
+class VCDPathIndex {
+
+public:
+  VCDPathIndex() = default;
+
+  // A plain copy would point at the scopes and signals of the original.
+  VCDPathIndex(const VCDPathIndex&) = delete;
+  VCDPathIndex& operator=(const VCDPathIndex&) = delete;
+  VCDPathIndex(VCDPathIndex&&) = default;
+  VCDPathIndex& operator=(VCDPathIndex&&) = default;
+
+  /*!
+  @brief Copy an index onto copies of the scopes and signals it was built from.
+  @param other in - The index to copy.
+  @param scope_copies in - The copy of each scope added to other.
+  @param signal_copies in - The copy of each signal added to other.
+  */
+  VCDPathIndex(const VCDPathIndex& other, const std::unordered_map<const VCDScope*, VCDScope*>& scope_copies,
+               const std::unordered_map<const VCDSignal*, VCDSignal*>& signal_copies)
+      : entries(other.entries) {
+    for (Entry& entry : entries) {
+      if (entry.scope != nullptr) {
+        entry.scope = scope_copies.at(entry.scope);
+      }
+      for (const VCDSignal*& signal : entry.signals) {
+        signal = signal_copies.at(signal);
+      }
+    }
+    for (const auto& [scope, entry] : other.scope_entries) {
+      scope_entries.emplace(scope_copies.at(scope), entry);
+    }
+    rebuild();
+  }
+
+  //! Add a scope whose parent has been added, the root scope has no parent.
+  void add_scope(const VCDScope* scope) {
+    if (scope->parent == nullptr) {
+      scope_entries[scope] = VCD_PATH_NONE;
+      return;
+    }
+    const std::size_t entry = intern(child_path(scope->parent, scope->name));
+    if (entries[entry].scope == nullptr) {
+      entries[entry].scope = scope;
+    }
+    scope_entries[scope] = entry;
+  }
+
+  //! Add a signal whose scope has been added.
+  void add_signal(const VCDSignal* signal) {
+    entries[intern(child_path(signal->scope, signal->reference))].signals.push_back(signal);
+  }
+
+  /*!
+  @brief Find a scope by path, e.g. "testbench.uut".
+  @returns The first scope opened with the path, nullptr if there is none.
+  */
+  [[nodiscard]] const VCDScope* find_scope(std::string_view path) const {
+    const auto entry = by_path.find(path);
+    return entry == by_path.end() ? nullptr : entries[entry->second].scope;
+  }
+
+  /*!
+  @brief Find a signal by path, optionally followed by its index range.
+  @details "testbench.uut.pc" finds the first signal named pc in that
+  scope, "testbench.uut.pc[31:0]" or "testbench.uut.pc [31:0]" only one
+  declared with that range, as does "pc[3]" for a single bit.
+  @returns The signal, nullptr if there is none.
+  */
+  [[nodiscard]] const VCDSignal* find_signal(std::string_view path) const {
+    auto entry = by_path.find(path);
+    if (entry != by_path.end()) {
+      const auto& signals = entries[entry->second].signals;
+      return signals.empty() ? nullptr : signals.front();
+    }
+
+    int lindex = -1;
+    int rindex = -1;
+    const std::string_view base = split_range(path, lindex, rindex);
+    if (base.size() == path.size() || (entry = by_path.find(base)) == by_path.end()) {
+      return nullptr;
+    }
+    for (const VCDSignal* signal : entries[entry->second].signals) {
+      if (signal->lindex == lindex && signal->rindex == rindex) {
+        return signal;
+      }
+    }
+    return nullptr;
+  }
+
+  //! Return all signals declared with a path, without index range.
+  [[nodiscard]] std::vector<const VCDSignal*> find_signals(std::string_view path) const {
+    const auto entry = by_path.find(path);
+    return entry == by_path.end() ? std::vector<const VCDSignal*>() : entries[entry->second].signals;
+  }
+
+  //! Return the path of an added scope, empty for the root scope.
+  [[nodiscard]] std::string scope_path(const VCDScope* scope) const {
+    const auto entry = scope_entries.find(scope);
+    return entry == scope_entries.end() || entry->second == VCD_PATH_NONE ? std::string() : entries[entry->second].path;
+  }
+
+  //! Return the path of a signal, which does not need to be added.
+  [[nodiscard]] std::string signal_path(const VCDSignal& signal) const {
+    return child_path(signal.scope, signal.reference);
+  }
+
+  /*!
+  @brief Return the signals whose paths start with a scope path, in declaration order.
+  @param scope in - The scope path, e.g. "testbench.uut", empty for all signals.
+  */
+  [[nodiscard]] std::vector<const VCDSignal*> signals_in(std::string_view scope) const {
+    std::vector<const VCDSignal*> result;
+    for (const Entry& entry : entries) {
+      const std::string_view path = entry.path;
+      if (scope.empty() || (path.size() > scope.size() && path.compare(0, scope.size(), scope) == 0 &&
+                            path[scope.size()] == '.')) {
+        result.insert(result.end(), entry.signals.begin(), entry.signals.end());
+      }
+    }
+    return result;
+  }
+
+  /*!
+  @brief Return the signals whose paths match a glob, in declaration order.
+  @details See vcd_glob_match(). Paths not starting with the part of
+  the glob before its first wildcard are skipped without matching.
+  */
+  [[nodiscard]] std::vector<const VCDSignal*> signals_matching(std::string_view glob) const {
+    const std::string_view literal = glob.substr(0, glob.find_first_of("*?"));
+    std::vector<const VCDSignal*> result;
+    for (const Entry& entry : entries) {
+      const std::string_view path = entry.path;
+      if (!entry.signals.empty() && path.compare(0, literal.size(), literal) == 0 && vcd_glob_match(glob, path)) {
+        result.insert(result.end(), entry.signals.begin(), entry.signals.end());
+      }
+    }
+    return result;
+  }
+
+  //! Number of distinct paths of scopes and signals.
+  [[nodiscard]] std::size_t size() const {
+    return entries.size();
+  }
+
+  //! Remove all paths.
+  void clear() {
+    entries.clear();
+    scope_entries.clear();
+    by_path.clear();
+  }
+
+protected:
+  //! A scope or signal path.
+  struct Entry {
+    std::string path;
+    const VCDScope* scope = nullptr;
+    std::vector<const VCDSignal*> signals;
+  };
+
+  //! Entry of the root scope or a scope that was not added.
+  static constexpr std::size_t VCD_PATH_NONE = static_cast<std::size_t>(-1);
+
+  //! Return the path of a name in a scope.
+  [[nodiscard]] std::string child_path(const VCDScope* scope, const std::string& name) const {
+    std::string path = scope_path(scope);
+    if (!path.empty()) {
+      path += '.';
+    }
+    path += name;
+    return path;
+  }
+
+  //! Return the entry of a path, adding it if it is new.
+  std::size_t intern(std::string path) {
+    const auto found = by_path.find(path);
+    if (found != by_path.end()) {
+      return found->second;
+    }
+    entries.push_back({std::move(path), nullptr, {}});
+    // Deque elements do not move, so the key stays valid.
+    by_path.emplace(entries.back().path, entries.size() - 1);
+    return entries.size() - 1;
+  }
+
+  //! Map the paths of a copied index to its own entries.
+  void rebuild() {
+    by_path.clear();
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+      by_path.emplace(entries[i].path, i);
+    }
+  }
+
+  /*!
+  @brief Split "name[l:r]" or "name [l]" into its name and indices.
+  @returns The name, or the whole path if it does not end in a valid range.
+  */
+  static std::string_view split_range(std::string_view path, int& lindex, int& rindex) {
+    const std::size_t open = path.rfind('[');
+    if (path.empty() || path.back() != ']' || open == std::string_view::npos) {
+      return path;
+    }
+    const std::string_view range = path.substr(open + 1, path.size() - open - 2);
+    const std::size_t colon = range.find(':');
+    const std::string_view left = range.substr(0, colon);
+    if (std::from_chars(left.data(), left.data() + left.size(), lindex).ptr != left.data() + left.size() ||
+        left.empty()) {
+      return path;
+    }
+    if (colon != std::string_view::npos) {
+      const std::string_view right = range.substr(colon + 1);
+      if (right.empty() || std::from_chars(right.data(), right.data() + right.size(), rindex).ptr !=
+                               right.data() + right.size()) {
+        return path;
+      }
+    }
+    std::string_view base = path.substr(0, open);
+    while (!base.empty() && base.back() == ' ') {
+      base.remove_suffix(1);
+    }
+    return base;
+  }
+
+  //! Scope and signal paths in the order they were first declared.
+  std::deque<Entry> entries;
+
+  //! Entry of each added scope.
+  std::unordered_map<const VCDScope*, std::size_t> scope_entries;
+
+  //! Entry of each path, keyed by the path stored in the entry.
+  std::unordered_map<std::string_view, std::size_t> by_path;
+};
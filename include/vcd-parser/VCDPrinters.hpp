@@ -1,6 +1,8 @@
 #pragma once
 
 #include <vcd-parser/VCDTypes.hpp>
+#include <vcd-parser/VCDTimedValue.hpp>
+#include <vcd-parser/VCDTimeline.hpp>
 
 #include <ostream>
 
@@ -129,6 +131,10 @@ inline std::ostream &operator<<(std::ostream &out, const VCDBitVector &val) {
     return out << "]";
 }
 
+inline std::ostream &operator<<(std::ostream &out, const VCDPackedVector &val) {
+    return out << "[" << val.to_string() << "]";
+}
+
 inline std::ostream &operator<<(std::ostream &out, const VCDValue &val) {
     switch (val.get_type()) {
         case VCDValueType::REAL:
@@ -136,7 +142,7 @@ inline std::ostream &operator<<(std::ostream &out, const VCDValue &val) {
         case VCDValueType::SCALAR:
             return out << val.get_value_bit();
         case VCDValueType::VECTOR:
-            return out << val.get_value_vector();
+            return out << val.get_value_packed();
         case VCDValueType::EMPTY:
             return out << "empty";
     }
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <vcd-parser/VCDTimeline.hpp>
+#include <vcd-parser/VCDTypes.hpp>
+#include <vcd-parser/VCDValue.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+
+/*!
+@file VCDSignalCursor.hpp
+@brief Sequential access to the value of one signal over time.
+*/
+
+/*!
+@brief A position in a VCDTimeline, moved by time.
+@details The cursor only reads the timeline, so any number of cursors may
+walk the same VCDFile from different threads. seek() jumps anywhere with
+a binary search. advance_to() searches forward from the current position
+with exponentially growing steps, so walking a timeline in time order
+costs O(1) amortized per step.
+*/
+class VCDSignalCursor {
+
+public:
+  VCDSignalCursor() = default;
+
+  //! Create a cursor placed before the first value of a timeline.
+  explicit VCDSignalCursor(const VCDTimeline& timeline) : values(&timeline) {}
+
+  /*!
+  @brief Move to the value in effect at time t.
+  @returns valid()
+  */
+  bool seek(VCDTime t) {
+    const auto times = values->times();
+    pos = static_cast<std::size_t>(std::upper_bound(times.begin(), times.end(), t) - times.begin());
+    query = t;
+    return valid();
+  }
+
+  /*!
+  @brief Move forward to the value in effect at time t.
+  @details Falls back to seek() if t is before the previous query time.
+  @returns valid()
+  */
+  bool advance_to(VCDTime t) {
+    if (t < query) {
+      return seek(t);
+    }
+    query = t;
+
+    const auto times = values->times();
+    const std::size_t n = times.size();
+    if (pos >= n || times[pos] > t) {
+      return valid();
+    }
+
+    // Gallop to a bound, then binary search the last step.
+    std::size_t step = 1;
+    std::size_t lo = pos;
+    while (lo + step < n && times[lo + step] <= t) {
+      lo += step;
+      step *= 2;
+    }
+    const std::size_t hi = std::min(n, lo + step);
+    pos = static_cast<std::size_t>(std::upper_bound(times.begin() + lo, times.begin() + hi, t) - times.begin());
+    return valid();
+  }
+
+  //! Is there a value at the current time?
+  [[nodiscard]] bool valid() const {
+    return pos > 0;
+  }
+
+  //! Index in the timeline of the current value, valid() must hold.
+  [[nodiscard]] std::size_t index() const {
+    return pos - 1;
+  }
+
+  //! Time at which the current value was set, valid() must hold.
+  [[nodiscard]] VCDTime time() const {
+    return values->time_at(pos - 1);
+  }
+
+  //! The current value, valid() must hold.
+  [[nodiscard]] VCDValue value() const {
+    return values->value_at(pos - 1);
+  }
+
+  //! Time of the next change, or the largest VCDTime if there is none.
+  [[nodiscard]] VCDTime next_time() const {
+    return pos < values->size() ? values->time_at(pos) : std::numeric_limits<VCDTime>::max();
+  }
+
+  //! The timeline the cursor walks.
+  [[nodiscard]] const VCDTimeline& timeline() const {
+    return *values;
+  }
+
+protected:
+  //! The timeline the cursor walks.
+  const VCDTimeline* values = nullptr;
+
+  //! Number of values with a time not after the query time.
+  std::size_t pos = 0;
+
+  //! Time of the last seek() or advance_to().
+  VCDTime query = std::numeric_limits<VCDTime>::min();
+};
@@ -0,0 +1,286 @@
+#pragma once
+
+#include <vcd-parser/VCDFile.hpp>
+#include <vcd-parser/VCDTimeline.hpp>
+#include <vcd-parser/VCDTypes.hpp>
+#include <vcd-parser/VCDValue.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <utility>
+#include <vector>
+
+/*!
+@file VCDSignalMerge.hpp
+@brief Time ordered walks over the values of several signals.
+*/
+
+/*!
+@brief k-way merge of the timelines of several signals.
+@details Changes are taken from a binary heap holding the next change
+of every signal, so each step costs O(log k) for k signals and
+allocates nothing. Changes at the same time come in the order of the
+signals. Besides the stream of changes, the merge keeps the index of
+the value in effect of every signal, which next_snapshot() and
+advance() move a whole time step at a time. The timelines must outlive
+the merge and must not be compressed.
+*/
+class VCDSignalMerge {
+
+public:
+  //! A value change of one of the merged signals.
+  struct Event {
+    VCDTime time;        //!< Time of the change
+    std::size_t signal;  //!< Position of the signal in the merge
+    std::size_t index;   //!< Index of the value in the timeline of the signal
+  };
+
+  //! Returned by current_index() for a signal without a value yet.
+  static constexpr std::size_t npos = VCDTimeline::npos;
+
+  VCDSignalMerge() = default;
+
+  //! Merge timelines, the position of each is its signal number in events.
+  explicit VCDSignalMerge(std::vector<const VCDTimeline*> merged) : timelines(std::move(merged)) {
+    positions.assign(timelines.size(), 0);
+    current.assign(timelines.size(), npos);
+    heap.reserve(timelines.size());
+    for (std::size_t k = 0; k < timelines.size(); ++k) {
+      if (!timelines[k]->empty()) {
+        heap.push_back({timelines[k]->time_at(0), k});
+      }
+    }
+    std::make_heap(heap.begin(), heap.end(), later);
+  }
+
+  //! Merge signals of a file by their dense index.
+  VCDSignalMerge(const VCDFile& file, const std::vector<VCDSignalIndex>& indices)
+      : VCDSignalMerge(timelines_of(file, indices)) {}
+
+  /*!
+  @brief Take the next change of any signal.
+  @returns false if all changes were taken.
+  */
+  bool next(Event& event) {
+    if (heap.empty()) {
+      return false;
+    }
+    std::pop_heap(heap.begin(), heap.end(), later);
+    const std::size_t k = heap.back().signal;
+    event = {heap.back().time, k, positions[k]};
+    current[k] = positions[k]++;
+
+    if (positions[k] < timelines[k]->size()) {
+      heap.back() = {timelines[k]->time_at(positions[k]), k};
+      std::push_heap(heap.begin(), heap.end(), later);
+    } else {
+      heap.pop_back();
+    }
+    return true;
+  }
+
+  //! Have all changes been taken?
+  [[nodiscard]] bool empty() const {
+    return heap.empty();
+  }
+
+  //! Time of the next change, or the largest VCDTime if there is none.
+  [[nodiscard]] VCDTime next_time() const {
+    return heap.empty() ? std::numeric_limits<VCDTime>::max() : heap.front().time;
+  }
+
+  /*!
+  @brief Take all changes of the next time with changes.
+  @param time out - That time.
+  @returns false if all changes were taken.
+  */
+  bool next_snapshot(VCDTime& time) {
+    if (heap.empty()) {
+      return false;
+    }
+    time = heap.front().time;
+    advance(time, true);
+    return true;
+  }
+
+  /*!
+  @brief Take all changes before t, or up to and including t.
+  @param t in - The time to move to.
+  @param inclusive in - Take the changes at t too.
+  */
+  void advance(VCDTime t, bool inclusive) {
+    Event event;
+    while (!heap.empty() && (heap.front().time < t || (inclusive && heap.front().time == t))) {
+      next(event);
+    }
+  }
+
+  //! Number of merged signals.
+  [[nodiscard]] std::size_t size() const {
+    return timelines.size();
+  }
+
+  //! Timeline of a merged signal.
+  [[nodiscard]] const VCDTimeline& timeline(std::size_t signal) const {
+    return *timelines[signal];
+  }
+
+  //! Index in its timeline of the value in effect of a signal, npos if it has none yet.
+  [[nodiscard]] std::size_t current_index(std::size_t signal) const {
+    return current[signal];
+  }
+
+  //! Does a signal have a value yet?
+  [[nodiscard]] bool has_value(std::size_t signal) const {
+    return current[signal] != npos;
+  }
+
+  //! Value in effect of a signal, has_value() must hold.
+  [[nodiscard]] VCDValue value(std::size_t signal) const {
+    return timelines[signal]->value_at(current[signal]);
+  }
+
+protected:
+  //! Next change of a signal.
+  struct Head {
+    VCDTime time;
+    std::size_t signal;
+  };
+
+  //! Heap order, the earliest change and then the first signal on top.
+  static bool later(const Head& a, const Head& b) {
+    return a.time > b.time || (a.time == b.time && a.signal > b.signal);
+  }
+
+  static std::vector<const VCDTimeline*> timelines_of(const VCDFile& file, const std::vector<VCDSignalIndex>& indices) {
+    std::vector<const VCDTimeline*> result;
+    result.reserve(indices.size());
+    for (VCDSignalIndex index : indices) {
+      result.push_back(&file.get_signal_values(index));
+    }
+    return result;
+  }
+
+  //! The merged timelines.
+  std::vector<const VCDTimeline*> timelines;
+
+  //! Index of the next change of each signal.
+  std::vector<std::size_t> positions;
+
+  //! Index of the value in effect of each signal.
+  std::vector<std::size_t> current;
+
+  //! Next changes of the signals with changes left.
+  std::vector<Head> heap;
+};
+
+
+//! Clock edges sampled by VCDClockSampler.
+enum class VCDEdge {
+  POSEDGE,  //!< 0 to 1, x or z, and x or z to 1
+  NEGEDGE,  //!< 1 to 0, x or z, and x or z to 0
+  ANY       //!< Both
+};
+
+/*!
+@brief The values of several signals at each edge of a clock.
+@details Edges are those of IEEE 1800 posedge and negedge. The first
+value of the clock sets its initial state and is never an edge. By
+default, signals are sampled just before the edge, as a flip-flop
+clocked by it sees them, so changes at the time of the edge are
+excluded. Each step costs O(log k) per change of the k signals passed.
+*/
+class VCDClockSampler {
+
+public:
+  /*!
+  @brief Sample signals at the edges of a scalar clock.
+  @param clock in - The timeline of the clock.
+  @param signals in - The timelines of the sampled signals.
+  @param edge in - The edges to sample at.
+  @param before_edge in - Exclude the changes at the time of the edge.
+  */
+  VCDClockSampler(const VCDTimeline& clock, std::vector<const VCDTimeline*> signals, VCDEdge edge = VCDEdge::POSEDGE,
+                  bool before_edge = true)
+      : clock(&clock), merge(std::move(signals)), edge(edge), before_edge(before_edge) {}
+
+  /*!
+  @brief Move to the next edge.
+  @returns false if the clock has no more edges.
+  */
+  bool next() {
+    const std::size_t n = clock->size();
+    while (clock_pos < n) {
+      const VCDTime t = clock->time_at(clock_pos);
+      bool found = false;
+      for (; clock_pos < n && clock->time_at(clock_pos) == t; ++clock_pos) {
+        const VCDBit bit = clock_bit(clock_pos);
+        found = found || (clock_pos > 0 && is_edge(state, bit));
+        state = bit;
+      }
+      if (found) {
+        edge_time = t;
+        merge.advance(t, !before_edge);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  //! Time of the current edge.
+  [[nodiscard]] VCDTime time() const {
+    return edge_time;
+  }
+
+  //! Sampled values, by position of the signal, see VCDSignalMerge::value().
+  [[nodiscard]] const VCDSignalMerge& samples() const {
+    return merge;
+  }
+
+protected:
+  //! Value of the clock at index i.
+  [[nodiscard]] VCDBit clock_bit(std::size_t i) const {
+    if (clock->column_type() == VCDColumnType::SCALAR) {
+      return clock->scalar_at(i);
+    }
+    const VCDValue value = clock->value_at(i);
+    return value.get_type() == VCDValueType::SCALAR ? value.get_value_bit() : VCDBit::VCD_X;
+  }
+
+  //! Is a change from to to an edge to sample at?
+  [[nodiscard]] bool is_edge(VCDBit from, VCDBit to) const {
+    const bool rising = (from == VCDBit::VCD_0 && to != VCDBit::VCD_0) || (from != VCDBit::VCD_1 && to == VCDBit::VCD_1);
+    const bool falling = (from == VCDBit::VCD_1 && to != VCDBit::VCD_1) || (from != VCDBit::VCD_0 && to == VCDBit::VCD_0);
+    switch (edge) {
+      case VCDEdge::POSEDGE:
+        return rising && from != to;
+      case VCDEdge::NEGEDGE:
+        return falling && from != to;
+      case VCDEdge::ANY:
+      default:
+        return (rising || falling) && from != to;
+    }
+  }
+
+  //! The clock.
+  const VCDTimeline* clock;
+
+  //! The sampled signals.
+  VCDSignalMerge merge;
+
+  //! Edges to sample at.
+  VCDEdge edge;
+
+  //! Exclude the changes at the time of the edge.
+  bool before_edge;
+
+  //! Index of the next value of the clock.
+  std::size_t clock_pos = 0;
+
+  //! Value of the clock.
+  VCDBit state = VCDBit::VCD_X;
+
+  //! Time of the current edge.
+  VCDTime edge_time = 0;
+};
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <vcd-parser/VCDTypes.hpp>
+
+#include <functional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*!
+@file VCDSignalSelection.hpp
+@brief Selection of the signals whose value changes are parsed.
+*/
+
+/*!
+@brief Match a text against a glob pattern.
+@details '*' matches any sequence of characters, including the '.'
+separating scopes, and '?' matches any single character.
+*/
+inline bool vcd_glob_match(std::string_view pattern, std::string_view text) {
+  std::size_t p = 0;
+  std::size_t t = 0;
+  std::size_t star = std::string_view::npos;
+  std::size_t star_text = 0;
+
+  while (t < text.size()) {
+    if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == text[t])) {
+      p++;
+      t++;
+    } else if (p < pattern.size() && pattern[p] == '*') {
+      star = p++;
+      star_text = t;
+    } else if (star != std::string_view::npos) {
+      p = star + 1;
+      t = ++star_text;
+    } else {
+      return false;
+    }
+  }
+
+  while (p < pattern.size() && pattern[p] == '*') {
+    p++;
+  }
+  return p == pattern.size();
+}
+
+/*!
+@brief A set of signals selected by path, scope, id code or var type.
+@details Hierarchical paths are the scope names below $root and the
+signal reference, joined by '.', e.g. "testbench.uut.clk". A signal is
+selected if it matches any path glob, scope or id code, or if none were
+given. Var types restrict the selection further. An empty selection
+selects every signal.
+*/
+class VCDSignalSelection {
+
+public:
+  //! Select signals whose hierarchical path matches a glob.
+  void add_path(const std::string& glob) {
+    paths.push_back(glob);
+  }
+
+  //! Select all signals in a scope and its subscopes, e.g. "testbench.uut".
+  void add_scope(const std::string& path) {
+    scopes.push_back(path);
+  }
+
+  //! Select the signal with an id code.
+  void add_id_code(const VCDSignalHash& code) {
+    id_codes.insert(code);
+  }
+
+  //! Restrict the selection to signals of a var type.
+  void add_var_type(VCDVarType type) {
+    var_types.insert(type);
+  }
+
+  //! Remove all criteria, selecting every signal again.
+  void clear() {
+    paths.clear();
+    scopes.clear();
+    id_codes.clear();
+    var_types.clear();
+  }
+
+  //! Return true if every signal is selected.
+  [[nodiscard]] bool empty() const {
+    return paths.empty() && scopes.empty() && id_codes.empty() && var_types.empty();
+  }
+
+  /*!
+  @brief Return true if a declared signal is selected.
+  @param signal in - The signal declaration.
+  @param path in - The hierarchical path of the signal.
+  */
+  [[nodiscard]] bool selects(const VCDSignal& signal, std::string_view path) const {
+    if (!var_types.empty() && var_types.count(signal.type) == 0) {
+      return false;
+    }
+
+    if (paths.empty() && scopes.empty() && id_codes.empty()) {
+      return true;
+    }
+
+    if (selects_id_code(signal.hash)) {
+      return true;
+    }
+
+    for (const std::string& glob : paths) {
+      if (vcd_glob_match(glob, path)) {
+        return true;
+      }
+    }
+
+    for (const std::string& scope : scopes) {
+      if (path.size() > scope.size() && path.compare(0, scope.size(), scope) == 0 && path[scope.size()] == '.') {
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  //! Return true if an id code was selected explicitly.
+  [[nodiscard]] bool selects_id_code(std::string_view code) const {
+    return id_codes.find(code) != id_codes.end();
+  }
+
+protected:
+  //! Path globs.
+  std::vector<std::string> paths;
+
+  //! Scope paths whose subtrees are selected.
+  std::vector<std::string> scopes;
+
+  //! Explicitly selected id codes.
+  std::set<VCDSignalHash, std::less<>> id_codes;
+
+  //! Var types the selection is restricted to.
+  std::set<VCDVarType> var_types;
+};
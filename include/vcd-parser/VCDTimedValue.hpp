@@ -1,6 +1,5 @@
 #pragma once
 
-#include <deque>
 #include <vcd-parser/VCDValue.hpp>
 
 //! A signal value tagged with times.
@@ -8,6 +7,3 @@ struct VCDTimedValue {
   VCDTime     time{};
   VCDValue    value;
 };
-
-//! A vector of tagged time/value pairs, sorted by time values.
-typedef std::deque<VCDTimedValue> VCDSignalValues;
\ No newline at end of file
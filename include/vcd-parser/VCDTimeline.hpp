@@ -0,0 +1,582 @@
+#pragma once
+
+#include <vcd-parser/VCDPackedVector.hpp>
+#include <vcd-parser/VCDTimedValue.hpp>
+#include <vcd-parser/VCDTypes.hpp>
+#include <vcd-parser/VCDValue.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory_resource>
+#include <utility>
+#include <vector>
+
+/*!
+@file VCDTimeline.hpp
+@brief Columnar storage of the values of one signal over time.
+*/
+
+//! Describes how the values of a VCDTimeline are stored.
+enum class VCDColumnType {
+    SCALAR,  //!< Two bits per VCDBit, 32 values per word
+    VECTOR,  //!< Fixed stride arena of VCDPackedVector planes
+    REAL,    //!< Array of doubles
+    GENERIC  //!< Array of VCDValue, for values not matching the declaration
+};
+
+
+/*!
+@brief Read-only view of a contiguous array.
+*/
+template <typename T>
+class VCDArrayView {
+
+public:
+  VCDArrayView() = default;
+
+  VCDArrayView(const T* data, std::size_t size) : ptr(data), count(size) {}
+
+  [[nodiscard]] const T* data() const { return ptr; }
+  [[nodiscard]] std::size_t size() const { return count; }
+  [[nodiscard]] bool empty() const { return count == 0; }
+  [[nodiscard]] const T* begin() const { return ptr; }
+  [[nodiscard]] const T* end() const { return ptr + count; }
+  [[nodiscard]] const T& front() const { return ptr[0]; }
+  [[nodiscard]] const T& back() const { return ptr[count - 1]; }
+  const T& operator[](std::size_t i) const { return ptr[i]; }
+
+protected:
+  const T* ptr = nullptr;
+  std::size_t count = 0;
+};
+
+
+/*!
+@brief The values of one signal, sorted by time.
+@details Times are stored in one contiguous array, values in a column
+chosen from the declared var type and size: packed scalars, a fixed
+stride arena of vector planes, or doubles. Vectors shorter than the
+column width are extended as described in IEEE 1800 21.7.2.1: with X or
+Z if the leftmost character is x or z, with 0 otherwise. Values not
+matching the column move the whole timeline to a GENERIC column.
+Elements are returned as VCDTimedValue by value. The columns are
+allocated from a std::pmr::memory_resource, the default resource unless
+one is passed on construction; copies use the default resource.
+*/
+class VCDTimeline {
+
+public:
+  /*!
+  @brief Random access iterator over the elements of a timeline.
+  */
+  class const_iterator {
+
+  public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = VCDTimedValue;
+    using difference_type = std::ptrdiff_t;
+    using reference = VCDTimedValue;
+
+    //! Makes it->time work on a value returned by copy.
+    struct pointer {
+      VCDTimedValue element;
+      const VCDTimedValue* operator->() const { return &element; }
+    };
+
+    const_iterator() = default;
+
+    const_iterator(const VCDTimeline* timeline, std::size_t index) : owner(timeline), pos(index) {}
+
+    reference operator*() const { return (*owner)[pos]; }
+    pointer operator->() const { return {(*owner)[pos]}; }
+    reference operator[](difference_type n) const { return (*owner)[pos + n]; }
+
+    const_iterator& operator++() { ++pos; return *this; }
+    const_iterator operator++(int) { auto old = *this; ++pos; return old; }
+    const_iterator& operator--() { --pos; return *this; }
+    const_iterator operator--(int) { auto old = *this; --pos; return old; }
+    const_iterator& operator+=(difference_type n) { pos += n; return *this; }
+    const_iterator& operator-=(difference_type n) { pos -= n; return *this; }
+
+    friend const_iterator operator+(const_iterator it, difference_type n) { return it += n; }
+    friend const_iterator operator+(difference_type n, const_iterator it) { return it += n; }
+    friend const_iterator operator-(const_iterator it, difference_type n) { return it -= n; }
+    friend difference_type operator-(const const_iterator& a, const const_iterator& b) {
+      return static_cast<difference_type>(a.pos) - static_cast<difference_type>(b.pos);
+    }
+
+    friend bool operator==(const const_iterator& a, const const_iterator& b) { return a.pos == b.pos; }
+    friend bool operator!=(const const_iterator& a, const const_iterator& b) { return a.pos != b.pos; }
+    friend bool operator<(const const_iterator& a, const const_iterator& b) { return a.pos < b.pos; }
+    friend bool operator>(const const_iterator& a, const const_iterator& b) { return a.pos > b.pos; }
+    friend bool operator<=(const const_iterator& a, const const_iterator& b) { return a.pos <= b.pos; }
+    friend bool operator>=(const const_iterator& a, const const_iterator& b) { return a.pos >= b.pos; }
+
+    //! Index of the element in the timeline.
+    [[nodiscard]] std::size_t index() const { return pos; }
+
+  protected:
+    const VCDTimeline* owner = nullptr;
+    std::size_t pos = 0;
+  };
+
+  using iterator = const_iterator;
+  using value_type = VCDTimedValue;
+  using size_type = std::size_t;
+
+  //! Create a timeline storing arbitrary VCDValues.
+  VCDTimeline() = default;
+
+  //! Create a timeline storing arbitrary VCDValues, allocated from resource.
+  explicit VCDTimeline(std::pmr::memory_resource* resource)
+      : time_column(resource), scalar_column(resource), vector_column(resource), real_column(resource),
+        generic_column(resource) {}
+
+  /*!
+  @brief Create a timeline with the column matching a var declaration.
+  @param type in - The declared var type.
+  @param size in - The declared size in bits.
+  @param resource in - Allocates the columns, it must outlive the timeline.
+  */
+  VCDTimeline(VCDVarType type, VCDSignalSize size,
+              std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+      : VCDTimeline(resource) {
+    column = column_for(type, size);
+    if (column == VCDColumnType::VECTOR && type != VCDVarType::VCD_VAR_PARAMETER) {
+      // The size of a parameter is not necessarily its width.
+      set_width(static_cast<std::size_t>(std::max<VCDSignalSize>(size, 0)));
+    }
+  }
+
+  //! Return the column type used for a var declaration.
+  static VCDColumnType column_for(VCDVarType type, VCDSignalSize size) {
+    if (type == VCDVarType::VCD_VAR_REAL || type == VCDVarType::VCD_VAR_REALTIME) {
+      return VCDColumnType::REAL;
+    }
+    if (size == 1 || type == VCDVarType::VCD_VAR_EVENT) {
+      return VCDColumnType::SCALAR;
+    }
+    return VCDColumnType::VECTOR;
+  }
+
+  //! How the values are stored.
+  [[nodiscard]] VCDColumnType column_type() const {
+    return column;
+  }
+
+  //! Width in bits of the values of a VECTOR column.
+  [[nodiscard]] std::size_t vector_width() const {
+    return width;
+  }
+
+  //! Number of 64-bit words in each plane of a VECTOR column value.
+  [[nodiscard]] std::size_t vector_words() const {
+    return stride / 2;
+  }
+
+  //! Number of values.
+  [[nodiscard]] std::size_t size() const {
+    return time_column.size();
+  }
+
+  //! Is the timeline empty?
+  [[nodiscard]] bool empty() const {
+    return time_column.empty();
+  }
+
+  //! Estimate the heap bytes held by the timeline, including unused capacity.
+  [[nodiscard]] std::size_t memory_usage() const {
+    std::size_t bytes = time_column.capacity() * sizeof(VCDTime) + scalar_column.capacity() * sizeof(uint64_t) +
+                        vector_column.capacity() * sizeof(uint64_t) + real_column.capacity() * sizeof(VCDReal) +
+                        generic_column.capacity() * sizeof(VCDValue);
+    for (const VCDValue& value : generic_column) {
+      if (value.get_type() == VCDValueType::VECTOR && value.get_value_packed().width() > VCDPackedVector::inline_bits) {
+        bytes += 2 * value.get_value_packed().words() * sizeof(uint64_t);
+      }
+    }
+    return bytes;
+  }
+
+  //! Reserve space for a number of values.
+  void reserve(std::size_t count) {
+    time_column.reserve(count);
+    switch (column) {
+      case VCDColumnType::SCALAR:
+        scalar_column.reserve((count + 31) / 32);
+        break;
+      case VCDColumnType::VECTOR:
+        vector_column.reserve(count * stride);
+        break;
+      case VCDColumnType::REAL:
+        real_column.reserve(count);
+        break;
+      case VCDColumnType::GENERIC:
+        generic_column.reserve(count);
+        break;
+    }
+  }
+
+  //! All times, sorted ascending.
+  [[nodiscard]] VCDArrayView<VCDTime> times() const {
+    return {time_column.data(), time_column.size()};
+  }
+
+  //! Values of a REAL column.
+  [[nodiscard]] VCDArrayView<VCDReal> reals() const {
+    return {real_column.data(), real_column.size()};
+  }
+
+  //! Time of the value at index i.
+  [[nodiscard]] VCDTime time_at(std::size_t i) const {
+    return time_column[i];
+  }
+
+  //! Value at index i of a SCALAR column.
+  [[nodiscard]] VCDBit scalar_at(std::size_t i) const {
+    return static_cast<VCDBit>((scalar_column[i / 32] >> (2 * (i % 32))) & 3);
+  }
+
+  //! Value at index i of a REAL column.
+  [[nodiscard]] VCDReal real_at(std::size_t i) const {
+    return real_column[i];
+  }
+
+  /*!
+  @brief Planes of the value at index i of a VECTOR column.
+  @returns vector_words() words of the value plane followed by as many
+  words of the unknown plane.
+  */
+  [[nodiscard]] const uint64_t* vector_words_at(std::size_t i) const {
+    return vector_column.data() + i * stride;
+  }
+
+  //! Value at index i of a VECTOR column.
+  [[nodiscard]] VCDPackedVector vector_at(std::size_t i) const {
+    const uint64_t* planes = vector_words_at(i);
+    return {width, planes, planes + stride / 2};
+  }
+
+  //! Value at index i, whatever the column type.
+  [[nodiscard]] VCDValue value_at(std::size_t i) const {
+    switch (column) {
+      case VCDColumnType::SCALAR:
+        return VCDValue(scalar_at(i));
+      case VCDColumnType::VECTOR:
+        return VCDValue(vector_at(i));
+      case VCDColumnType::REAL:
+        return VCDValue(real_at(i));
+      case VCDColumnType::GENERIC:
+      default:
+        return generic_column[i];
+    }
+  }
+
+  //! Time and value at index i.
+  VCDTimedValue operator[](std::size_t i) const {
+    return {time_at(i), value_at(i)};
+  }
+
+  //! First time and value.
+  [[nodiscard]] VCDTimedValue front() const {
+    return (*this)[0];
+  }
+
+  //! Last time and value.
+  [[nodiscard]] VCDTimedValue back() const {
+    return (*this)[size() - 1];
+  }
+
+  [[nodiscard]] const_iterator begin() const {
+    return {this, 0};
+  }
+
+  [[nodiscard]] const_iterator end() const {
+    return {this, size()};
+  }
+
+  //! Returned by find() if no value exists at the requested time.
+  static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+
+  /*!
+  @brief Return the index of the value in effect at a time.
+  @details Binary search for the last value with a time not after t.
+  @returns The index, or npos if t is before the first value.
+  */
+  [[nodiscard]] std::size_t find(VCDTime t) const {
+    auto it = std::upper_bound(time_column.begin(), time_column.end(), t);
+    return it == time_column.begin() ? npos : static_cast<std::size_t>(it - time_column.begin()) - 1;
+  }
+
+  /*!
+  @brief Return the values with first <= time < last.
+  */
+  [[nodiscard]] std::pair<const_iterator, const_iterator> range(VCDTime first, VCDTime last) const {
+    auto lo = std::lower_bound(time_column.begin(), time_column.end(), first);
+    auto hi = std::lower_bound(lo, time_column.end(), last);
+    return {{this, static_cast<std::size_t>(lo - time_column.begin())},
+            {this, static_cast<std::size_t>(hi - time_column.begin())}};
+  }
+
+  //! Append a scalar value.
+  void push_back(VCDTime time, VCDBit bit) {
+    if (column != VCDColumnType::SCALAR) {
+      push_back_generic(time, VCDValue(bit));
+      return;
+    }
+    const std::size_t i = time_column.size();
+    if (i % 32 == 0) {
+      scalar_column.push_back(0);
+    }
+    scalar_column.back() |= static_cast<uint64_t>(bit) << (2 * (i % 32));
+    time_column.push_back(time);
+  }
+
+  /*!
+  @brief Append a vector value given as VCD binary text.
+  @param time in - The time of the value.
+  @param text in - Characters, most significant bit first, without the 'b'.
+  @param length in - Number of characters.
+  */
+  void push_back_ascii(VCDTime time, const char* text, std::size_t length) {
+    if (column != VCDColumnType::VECTOR) {
+      push_back_generic(time, VCDValue(VCDPackedVector::from_ascii(text, length)));
+      return;
+    }
+    if (length > width) {
+      set_width(length);
+    }
+    uint64_t* planes = append_vector_slot(time);
+    VCDPackedVector::pack_ascii(text, length, planes, planes + stride / 2);
+    extend(planes, length, length == 0 ? 0 : char_extension(text[0]));
+  }
+
+  //! Append a vector value.
+  void push_back(VCDTime time, const VCDPackedVector& vec) {
+    if (column != VCDColumnType::VECTOR) {
+      push_back_generic(time, VCDValue(vec));
+      return;
+    }
+    if (vec.width() > width) {
+      set_width(vec.width());
+    }
+    uint64_t* planes = append_vector_slot(time);
+    std::copy_n(vec.value_words(), vec.words(), planes);
+    std::copy_n(vec.unknown_words(), vec.words(), planes + stride / 2);
+    extend(planes, vec.width(), vec.width() == 0 ? 0 : bit_extension(vec.get(vec.width() - 1)));
+  }
+
+  //! Append a real value.
+  void push_back(VCDTime time, VCDReal real) {
+    if (column != VCDColumnType::REAL) {
+      push_back_generic(time, VCDValue(real));
+      return;
+    }
+    real_column.push_back(real);
+    time_column.push_back(time);
+  }
+
+  //! Append any value.
+  void push_back(VCDTime time, const VCDValue& value) {
+    switch (value.get_type()) {
+      case VCDValueType::SCALAR:
+        push_back(time, value.get_value_bit());
+        break;
+      case VCDValueType::VECTOR:
+        push_back(time, value.get_value_packed());
+        break;
+      case VCDValueType::REAL:
+        push_back(time, value.get_value_real());
+        break;
+      case VCDValueType::EMPTY:
+        push_back_generic(time, value);
+        break;
+    }
+  }
+
+  //! Append a time and value pair.
+  void push_back(const VCDTimedValue& time_val) {
+    push_back(time_val.time, time_val.value);
+  }
+
+  //! Append a time and value pair.
+  void emplace_back(const VCDTimedValue& time_val) {
+    push_back(time_val);
+  }
+
+  /*!
+  @brief Append all values of another timeline of the same signal.
+  @details Columns of the same type and width are copied in bulk, the
+  times of other must not be before the last time of this timeline.
+  */
+  void append(const VCDTimeline& other) {
+    if (other.empty()) {
+      return;
+    }
+    const bool same_layout = column == other.column &&
+        (column != VCDColumnType::VECTOR || (width == other.width && stride == other.stride));
+    if (!same_layout || (column == VCDColumnType::SCALAR && size() % 32 != 0)) {
+      for (std::size_t i = 0; i < other.size(); ++i) {
+        push_back(other.time_at(i), other.value_at(i));
+      }
+      return;
+    }
+
+    time_column.insert(time_column.end(), other.time_column.begin(), other.time_column.end());
+    scalar_column.insert(scalar_column.end(), other.scalar_column.begin(), other.scalar_column.end());
+    vector_column.insert(vector_column.end(), other.vector_column.begin(), other.vector_column.end());
+    real_column.insert(real_column.end(), other.real_column.begin(), other.real_column.end());
+    generic_column.insert(generic_column.end(), other.generic_column.begin(), other.generic_column.end());
+  }
+
+  /*!
+  @brief Remove the first count values.
+  @note Takes time linear in the size of the timeline.
+  */
+  void erase_front(std::size_t count) {
+    count = std::min(count, size());
+    if (count == 0) {
+      return;
+    }
+    if (column == VCDColumnType::SCALAR) {
+      std::pmr::vector<uint64_t> kept(scalar_column.get_allocator());
+      kept.reserve((size() - count + 31) / 32);
+      for (std::size_t i = count; i < size(); ++i) {
+        const std::size_t j = i - count;
+        if (j % 32 == 0) {
+          kept.push_back(0);
+        }
+        kept.back() |= static_cast<uint64_t>(scalar_at(i)) << (2 * (j % 32));
+      }
+      scalar_column.swap(kept);
+    }
+    vector_column.erase(vector_column.begin(), vector_column.begin() + std::min(vector_column.size(), count * stride));
+    real_column.erase(real_column.begin(), real_column.begin() + std::min(real_column.size(), count));
+    generic_column.erase(generic_column.begin(), generic_column.begin() + std::min(generic_column.size(), count));
+    time_column.erase(time_column.begin(), time_column.begin() + count);
+  }
+
+protected:
+  //! Numeric VCDBit used to extend text starting with c.
+  static uint64_t char_extension(char c) {
+    switch (c) {
+      case 'x':
+      case 'X':
+        return 2;
+      case 'z':
+      case 'Z':
+        return 3;
+      default:
+        return 0;
+    }
+  }
+
+  //! Numeric VCDBit used to extend a vector whose top bit is b.
+  static uint64_t bit_extension(VCDBit b) {
+    return b == VCDBit::VCD_X || b == VCDBit::VCD_Z ? static_cast<uint64_t>(b) : 0;
+  }
+
+  //! Fill the bits [from, width) of a slot with the numeric VCDBit code.
+  void extend(uint64_t* planes, std::size_t from, uint64_t code) {
+    if (code == 0) {
+      return;
+    }
+    for (std::size_t w = from / 64; w < stride / 2; ++w) {
+      const std::size_t lo = std::max(from, 64 * w) - 64 * w;
+      const std::size_t hi = std::min(width, 64 * w + 64) - 64 * w;
+      if (lo >= hi) {
+        continue;
+      }
+      const uint64_t high = hi == 64 ? ~uint64_t(0) : (uint64_t(1) << hi) - 1;
+      const uint64_t mask = high & ~((uint64_t(1) << lo) - 1);
+      if (code & 1) {
+        planes[w] |= mask;
+      }
+      if (code & 2) {
+        planes[stride / 2 + w] |= mask;
+      }
+    }
+  }
+
+  //! Append a time and a zeroed vector slot, returning the slot.
+  uint64_t* append_vector_slot(VCDTime time) {
+    time_column.push_back(time);
+    vector_column.resize(vector_column.size() + stride, 0);
+    return vector_column.data() + vector_column.size() - stride;
+  }
+
+  //! Change the width of a VECTOR column, extending the stored values.
+  void set_width(std::size_t new_width) {
+    const std::size_t old_width = width;
+    const std::size_t old_stride = stride;
+    width = new_width;
+    stride = 2 * ((new_width + 63) / 64);
+    if (old_stride == stride && old_width == 0) {
+      return;
+    }
+
+    std::pmr::vector<uint64_t> widened(size() * stride, 0, vector_column.get_allocator());
+    for (std::size_t i = 0; i < size(); ++i) {
+      const uint64_t* from = vector_column.data() + i * old_stride;
+      uint64_t* to = widened.data() + i * stride;
+      std::copy_n(from, old_stride / 2, to);
+      std::copy_n(from + old_stride / 2, old_stride / 2, to + stride / 2);
+      if (old_width > 0) {
+        const uint64_t v = (from[(old_width - 1) / 64] >> ((old_width - 1) % 64)) & 1;
+        const uint64_t u = (from[old_stride / 2 + (old_width - 1) / 64] >> ((old_width - 1) % 64)) & 1;
+        extend(to, old_width, bit_extension(static_cast<VCDBit>(v | (u << 1))));
+      }
+    }
+    vector_column.swap(widened);
+  }
+
+  //! Append a value after moving the timeline to a GENERIC column.
+  void push_back_generic(VCDTime time, VCDValue value) {
+    if (column != VCDColumnType::GENERIC) {
+      std::pmr::vector<VCDValue> values(generic_column.get_allocator());
+      values.reserve(size() + 1);
+      for (std::size_t i = 0; i < size(); ++i) {
+        values.push_back(value_at(i));
+      }
+      generic_column.swap(values);
+      scalar_column.clear();
+      vector_column.clear();
+      real_column.clear();
+      column = VCDColumnType::GENERIC;
+    }
+    generic_column.push_back(std::move(value));
+    time_column.push_back(time);
+  }
+
+  //! How values are stored.
+  VCDColumnType column = VCDColumnType::GENERIC;
+
+  //! Width of the values of a VECTOR column.
+  std::size_t width = 0;
+
+  //! Words per value of a VECTOR column, both planes.
+  std::size_t stride = 0;
+
+  //! Times of all values.
+  std::pmr::vector<VCDTime> time_column;
+
+  //! Values of a SCALAR column, 32 per word.
+  std::pmr::vector<uint64_t> scalar_column;
+
+  //! Values of a VECTOR column, stride words each.
+  std::pmr::vector<uint64_t> vector_column;
+
+  //! Values of a REAL column.
+  std::pmr::vector<VCDReal> real_column;
+
+  //! Values of a GENERIC column.
+  std::pmr::vector<VCDValue> generic_column;
+
+  friend class VCDCache;
+  friend class VCDCompressedTimeline;
+};
+
+
+//! The values of a signal, sorted by time.
+typedef VCDTimeline VCDSignalValues;
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <utility>
 #include <string>
 #include <vector>
@@ -19,6 +20,9 @@ typedef std::string VCDScopeName;
 //! Compressed hash representation of a signal.
 typedef std::string VCDSignalHash;
 
+//! Dense index of a signal hash, in order of first declaration.
+typedef uint32_t VCDSignalIndex;
+
 //! Represents a single instant in time in a trace
 typedef int64_t VCDTime;
 
@@ -103,6 +107,7 @@ struct VCDScope;
 //! Represents a single signal reference within a VCD file
 struct VCDSignal {
     VCDSignalHash       hash;
+    VCDSignalIndex      index;  // dense index of hash, shared by aliases
     VCDSignalReference  reference;
     VCDScope          * scope;
     VCDSignalSize       size;
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <vcd-parser/VCDPackedVector.hpp>
 #include <vcd-parser/VCDTypes.hpp>
 
 #include <variant>
@@ -44,7 +45,15 @@ public:
   */
   explicit VCDValue(const VCDBitVector& value) {
     type = VCDValueType::VECTOR;
-    m_value = value;
+    m_value = VCDPackedVector(value);
+  }
+
+  /*!
+  @brief Create a new VCDValue with the type VCD_VECTOR
+  */
+  explicit VCDValue(VCDPackedVector value) {
+    type = VCDValueType::VECTOR;
+    m_value = std::move(value);
   }
 
   /*!
@@ -65,9 +74,14 @@ public:
     return std::get<VCDBit>(m_value);
   }
 
-  //! Get the vector value of the instance.
+  //! Get the vector value of the instance, unpacked to one VCDBit per element.
   [[nodiscard]] VCDBitVector get_value_vector() const {
-    return std::get<VCDBitVector>(m_value);
+    return std::get<VCDPackedVector>(m_value).to_bit_vector();
+  }
+
+  //! Get the packed vector value of the instance.
+  [[nodiscard]] const VCDPackedVector& get_value_packed() const {
+    return std::get<VCDPackedVector>(m_value);
   }
 
   //! Get the real value of the instance.
@@ -81,5 +95,5 @@ protected:
   VCDValueType type = VCDValueType::EMPTY;
 
   //! The actual value stored, as identified by type.
-  std::variant<VCDBit, VCDBitVector, VCDReal> m_value;
+  std::variant<VCDBit, VCDPackedVector, VCDReal> m_value;
 };
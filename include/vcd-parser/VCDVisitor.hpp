@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vcd-parser/VCDTypes.hpp>
+
+#include <string_view>
+
+/*!
+@file VCDVisitor.hpp
+@brief Callback interface driven by VCDFileParser while it parses.
+*/
+
+/*!
+@brief Receives the contents of a VCD file as the parser reads them.
+@details Every callback does nothing by default. Strings and objects
+passed by reference are only valid during the callback. Scopes and
+signals refer to the parser's current scope stack: the parent and scope
+pointers are valid while the scope is open. Value changes before
+VCDFileParser::start_time or after VCDFileParser::end_time are not
+reported.
+*/
+class VCDVisitor {
+
+public:
+  virtual ~VCDVisitor() = default;
+
+  //! Text of the $date section.
+  virtual void on_date([[maybe_unused]] std::string_view text) {}
+
+  //! Text of the $version section.
+  virtual void on_version([[maybe_unused]] std::string_view text) {}
+
+  //! Text of a $comment section in the header.
+  virtual void on_comment([[maybe_unused]] std::string_view text) {}
+
+  //! Contents of the $timescale section.
+  virtual void on_timescale([[maybe_unused]] VCDTimeRes resolution, [[maybe_unused]] VCDTimeUnit units) {}
+
+  //! A $scope was opened, scope.parent is the enclosing scope.
+  virtual void on_scope([[maybe_unused]] const VCDScope& scope) {}
+
+  //! The innermost open scope was closed by $upscope.
+  virtual void on_upscope() {}
+
+  //! A $var was declared in signal.scope, signal.index is its dense index.
+  virtual void on_var([[maybe_unused]] const VCDSignal& signal) {}
+
+  //! A value change refers to an id code that no $var declared.
+  virtual void on_undeclared([[maybe_unused]] VCDSignalIndex index, [[maybe_unused]] std::string_view hash) {}
+
+  //! $enddefinitions was reached.
+  virtual void on_header_done() {}
+
+  //! A #time line.
+  virtual void on_timestamp([[maybe_unused]] VCDTime time) {}
+
+  //! A scalar value change.
+  virtual void on_scalar_change([[maybe_unused]] VCDTime time, [[maybe_unused]] VCDSignalIndex index,
+                                [[maybe_unused]] VCDBit value) {}
+
+  //! A vector value change, digits most significant first, without the 'b'.
+  virtual void on_vector_change([[maybe_unused]] VCDTime time, [[maybe_unused]] VCDSignalIndex index,
+                                [[maybe_unused]] std::string_view digits) {}
+
+  //! A real value change.
+  virtual void on_real_change([[maybe_unused]] VCDTime time, [[maybe_unused]] VCDSignalIndex index,
+                              [[maybe_unused]] VCDReal value) {}
+
+  //! The whole input was parsed successfully.
+  virtual void on_finish() {}
+};
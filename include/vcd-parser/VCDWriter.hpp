@@ -0,0 +1,624 @@
+#pragma once
+
+#include <vcd-parser/VCDFile.hpp>
+#include <vcd-parser/VCDPrinters.hpp>
+#include <vcd-parser/VCDSignalMerge.hpp>
+#include <vcd-parser/VCDSignalSelection.hpp>
+#include <vcd-parser/VCDTimeline.hpp>
+#include <vcd-parser/VCDTypes.hpp>
+#include <vcd-parser/VCDValue.hpp>
+#include <vcd-parser/VCDVisitor.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/*!
+@file VCDWriter.hpp
+@brief Writing of VCD files, from a VCDFile or while parsing.
+*/
+
+/*!
+@brief Writes a selection of the signals of a VCD file in a time window.
+@details The written file declares only the selected signals and the
+scopes containing them, with new compact id codes unless keep_id_codes
+is set. With a start_time, it starts with a timestamp at start_time,
+whose $dumpvars block holds the value of every selected signal at that
+time, followed by the timestamps and changes after it, up to end_time.
+Text goes through a buffer of buffer_size bytes, and formatting a value
+change allocates nothing. A whole file is written by write(). Passed to
+VCDFileParser::parse_file() as a visitor instead, the writer emits the
+file while it is parsed, without storing it; the parser's start_time
+and end_time must then be left unset.
+*/
+class VCDWriter : public VCDVisitor {
+
+public:
+  /*!
+  @brief Create a writer.
+  @param out in - The stream written to, which must outlive the writer.
+  @param buffer_size in - Bytes collected before each write to out.
+  */
+  explicit VCDWriter(std::ostream& out, std::size_t buffer_size = std::size_t(1) << 20)
+      : out(out), buffer(std::max<std::size_t>(buffer_size, 256)) {}
+
+  VCDWriter(const VCDWriter&) = delete;
+  VCDWriter& operator=(const VCDWriter&) = delete;
+
+  ~VCDWriter() override {
+    flush();
+  }
+
+  //! Signals written, all if empty.
+  VCDSignalSelection selection;
+
+  //! Start of the window, the first timestamp if unset.
+  VCDTime start_time = -std::numeric_limits<VCDTime>::max();
+
+  //! End of the window, inclusive.
+  VCDTime end_time = std::numeric_limits<VCDTime>::max();
+
+  //! Write the id codes of the source instead of new compact ones.
+  bool keep_id_codes = false;
+
+  /*!
+  @brief Write a file.
+  @returns false if the stream failed.
+  */
+  bool write(const VCDFile& file) {
+    codes.clear();
+    next_code = 0;
+    written_scopes = 0;
+    write_header_sections(file.date, file.version, file.comment, file.time_resolution, file.time_units);
+    if (file.root_scope != nullptr) {
+      std::vector<const VCDScope*> open;
+      write_scope(file, *file.root_scope, open);
+    }
+    put("$enddefinitions $end\n");
+
+    // The selected signals, once per id code.
+    std::vector<VCDSignalIndex> indices;
+    for (VCDSignalIndex i = 0; i < codes.size(); ++i) {
+      if (!codes[i].empty()) {
+        indices.push_back(i);
+      }
+    }
+    std::vector<VCDTimeline> decompressed;
+    std::vector<const VCDTimeline*> timelines;
+    if (file.timelines_compressed()) {
+      decompressed.reserve(indices.size());
+      for (VCDSignalIndex i : indices) {
+        decompressed.push_back(file.copy_signal_values(i));
+      }
+      for (const VCDTimeline& timeline : decompressed) {
+        timelines.push_back(&timeline);
+      }
+    } else {
+      for (VCDSignalIndex i : indices) {
+        timelines.push_back(&file.get_signal_values(i));
+      }
+    }
+    write_body(file.get_timestamps(), indices, timelines);
+
+    flush();
+    return out.good();
+  }
+
+  //! Write the buffered text to the stream.
+  void flush() {
+    if (used > 0) {
+      out.write(buffer.data(), static_cast<std::streamsize>(used));
+      used = 0;
+    }
+  }
+
+  void on_date(std::string_view text) override {
+    write_section("$date", text);
+  }
+
+  void on_version(std::string_view text) override {
+    write_section("$version", text);
+  }
+
+  void on_comment(std::string_view text) override {
+    write_section("$comment", text);
+  }
+
+  void on_timescale(VCDTimeRes resolution, VCDTimeUnit units) override {
+    write_timescale(resolution, units);
+  }
+
+  void on_scope(const VCDScope& scope) override {
+    pending_scopes.push_back({scope.name, scope.type, nullptr, {}, {}});
+    if (selection.empty()) {
+      open_scopes(pending_scopes);
+    }
+  }
+
+  void on_upscope() override {
+    if (pending_scopes.empty()) {
+      return;
+    }
+    if (written_scopes == pending_scopes.size()) {
+      put("$upscope $end\n");
+      written_scopes--;
+    }
+    pending_scopes.pop_back();
+  }
+
+  void on_var(const VCDSignal& signal) override {
+    std::string path;
+    for (const VCDScope& scope : pending_scopes) {
+      path += scope.name;
+      path += '.';
+    }
+    path += signal.reference;
+    if (!selection.selects(signal, path)) {
+      return;
+    }
+
+    open_scopes(pending_scopes);
+    write_var(signal, code_for(signal.index, signal.hash));
+  }
+
+  void on_header_done() override {
+    while (written_scopes > 0) {
+      put("$upscope $end\n");
+      written_scopes--;
+    }
+    pending_scopes.clear();
+    put("$enddefinitions $end\n");
+    // Without a window start, changes are written as they come.
+    started = start_time == -std::numeric_limits<VCDTime>::max();
+    ended = false;
+    state.clear();
+  }
+
+  void on_timestamp(VCDTime time) override {
+    if (time > end_time) {
+      ended = true;
+      return;
+    }
+    if (!started) {
+      if (time < start_time) {
+        return;
+      }
+      begin_stream();
+      if (time == start_time) {
+        return;
+      }
+    }
+    write_time(time);
+  }
+
+  void on_scalar_change([[maybe_unused]] VCDTime time, VCDSignalIndex index, VCDBit value) override {
+    if (!selected(index)) {
+      return;
+    }
+    if (!started) {
+      track(index, VCDValue(value));
+      return;
+    }
+    write_scalar(value, codes[index]);
+  }
+
+  void on_vector_change([[maybe_unused]] VCDTime time, VCDSignalIndex index, std::string_view digits) override {
+    if (!selected(index)) {
+      return;
+    }
+    if (!started) {
+      track(index, VCDValue(VCDPackedVector::from_ascii(digits.data(), digits.size())));
+      return;
+    }
+    write_digits(digits, codes[index]);
+  }
+
+  void on_real_change([[maybe_unused]] VCDTime time, VCDSignalIndex index, VCDReal value) override {
+    if (!selected(index)) {
+      return;
+    }
+    if (!started) {
+      track(index, VCDValue(value));
+      return;
+    }
+    write_real(value, codes[index]);
+  }
+
+  void on_finish() override {
+    if (!started && !ended && !state.empty()) {
+      begin_stream();
+    }
+    flush();
+  }
+
+protected:
+  //! Write the sections before the scopes.
+  void write_header_sections(const std::string& date, const std::string& version, const std::string& comment,
+                             VCDTimeRes resolution, VCDTimeUnit units) {
+    write_section("$date", date);
+    write_section("$version", version);
+    write_section("$comment", comment);
+    write_timescale(resolution, units);
+  }
+
+  //! Write a section holding text as parsed, nothing if the text is empty.
+  void write_section(std::string_view keyword, std::string_view text) {
+    if (text.empty()) {
+      return;
+    }
+    put(keyword);
+    if (!std::isspace(static_cast<unsigned char>(text.front()))) {
+      put(" ");
+    }
+    put(text);
+    if (!std::isspace(static_cast<unsigned char>(text.back()))) {
+      put(" ");
+    }
+    put("$end\n");
+  }
+
+  void write_timescale(VCDTimeRes resolution, VCDTimeUnit units) {
+    std::ostringstream text;
+    text << "$timescale\n\t" << resolution << units << "\n$end\n";
+    put(text.str());
+  }
+
+  void write_scope_line(const VCDScopeName& name, VCDScopeType type) {
+    std::ostringstream text;
+    text << "$scope " << type << " " << name << " $end\n";
+    put(text.str());
+  }
+
+  void write_var(const VCDSignal& signal, const std::string& code) {
+    std::ostringstream text;
+    text << "$var " << signal.type << " " << signal.size << " " << code << " " << signal.reference;
+    if (signal.lindex != -1) {
+      text << " [" << signal.lindex;
+      if (signal.rindex != -1) {
+        text << ":" << signal.rindex;
+      }
+      text << "]";
+    }
+    text << " $end\n";
+    put(text.str());
+  }
+
+  /*!
+  @brief Write the selected signals of a scope of a file and its subscopes.
+  @param open in - The enclosing scopes below the root.
+  */
+  void write_scope(const VCDFile& file, const VCDScope& scope, std::vector<const VCDScope*>& open) {
+    const bool root = scope.parent == nullptr;
+    if (!root) {
+      open.push_back(&scope);
+      if (selection.empty()) {
+        open_scopes(open);
+      }
+    }
+
+    for (const VCDSignal* signal : scope.signals) {
+      if (signal != nullptr && selection.selects(*signal, file.get_signal_path(*signal))) {
+        open_scopes(open);
+        write_var(*signal, code_for(signal->index, signal->hash));
+      }
+    }
+    for (const VCDScope* child : scope.children) {
+      write_scope(file, *child, open);
+    }
+
+    if (!root) {
+      if (written_scopes == open.size()) {
+        put("$upscope $end\n");
+        written_scopes--;
+      }
+      open.pop_back();
+    }
+  }
+
+  //! Write the $scope lines of the open scopes not written yet.
+  template <class Scopes>
+  void open_scopes(const Scopes& open) {
+    for (; written_scopes < open.size(); ++written_scopes) {
+      write_scope_line(scope_of(open[written_scopes]).name, scope_of(open[written_scopes]).type);
+    }
+  }
+
+  static const VCDScope& scope_of(const VCDScope* scope) {
+    return *scope;
+  }
+
+  static const VCDScope& scope_of(const VCDScope& scope) {
+    return scope;
+  }
+
+  /*!
+  @brief Write the timestamps and changes of the selected timelines of a file.
+  @details Without a window start, the body starts at the first
+  timestamp or change, and changes before the first timestamp are
+  written before it, as in the source. Timestamps without changes and
+  repeated timestamps are kept.
+  */
+  void write_body(const std::vector<VCDTime>& times, const std::vector<VCDSignalIndex>& indices,
+                  const std::vector<const VCDTimeline*>& timelines) {
+    VCDSignalMerge merge(timelines);
+    constexpr VCDTime none = std::numeric_limits<VCDTime>::max();
+
+    const bool windowed = start_time != -std::numeric_limits<VCDTime>::max();
+    VCDTime start = start_time;
+    if (!windowed) {
+      if (times.empty() && merge.empty()) {
+        return;
+      }
+      start = std::min(times.empty() ? none : times.front(), merge.next_time());
+    }
+    if (start > end_time) {
+      return;
+    }
+
+    // The values in effect at the start, unless they change at it, then the changes at it.
+    merge.advance(start, false);
+    auto time = std::lower_bound(times.begin(), times.end(), start);
+    if (windowed || (time != times.end() && *time == start)) {
+      write_time(start);
+    }
+    if (time != times.end() && *time == start) {
+      ++time;
+    }
+    put("$dumpvars\n");
+    for (std::size_t k = 0; k < timelines.size(); ++k) {
+      const std::size_t i = merge.current_index(k);
+      if (i != VCDSignalMerge::npos && (i + 1 == timelines[k]->size() || timelines[k]->time_at(i + 1) != start)) {
+        write_value(*timelines[k], i, codes[indices[k]]);
+      }
+    }
+    VCDSignalMerge::Event event;
+    while (!merge.empty() && merge.next_time() == start && merge.next(event)) {
+      write_value(*timelines[event.signal], event.index, codes[indices[event.signal]]);
+    }
+    put("$end\n");
+    for (; time != times.end() && *time == start; ++time) {
+      write_time(start);
+    }
+
+    while (time != times.end() || !merge.empty()) {
+      const VCDTime t = std::min(time != times.end() ? *time : none, merge.next_time());
+      if (t > end_time) {
+        break;
+      }
+      write_time(t);
+      if (time != times.end() && *time == t) {
+        ++time;
+      }
+      while (!merge.empty() && merge.next_time() == t && merge.next(event)) {
+        write_value(*timelines[event.signal], event.index, codes[indices[event.signal]]);
+      }
+      for (; time != times.end() && *time == t; ++time) {
+        write_time(t);
+      }
+    }
+  }
+
+  //! Write the value at index i of a timeline.
+  void write_value(const VCDTimeline& timeline, std::size_t i, const std::string& code) {
+    switch (timeline.column_type()) {
+      case VCDColumnType::SCALAR:
+        write_scalar(timeline.scalar_at(i), code);
+        break;
+      case VCDColumnType::VECTOR:
+        write_vector(timeline.vector_words_at(i), timeline.vector_width(), timeline.vector_words(), code, true);
+        break;
+      case VCDColumnType::REAL:
+        write_real(timeline.real_at(i), code);
+        break;
+      case VCDColumnType::GENERIC:
+      default:
+        write_generic(timeline.value_at(i), code);
+        break;
+    }
+  }
+
+  //! Write a VCDValue, nothing for an EMPTY one.
+  void write_generic(const VCDValue& value, const std::string& code) {
+    switch (value.get_type()) {
+      case VCDValueType::SCALAR:
+        write_scalar(value.get_value_bit(), code);
+        break;
+      case VCDValueType::VECTOR: {
+        // Written in full, a GENERIC column keeps the width of each value.
+        const VCDPackedVector& vec = value.get_value_packed();
+        write_vector(vec.value_words(), vec.width(), vec.words(), code, false);
+        break;
+      }
+      case VCDValueType::REAL:
+        write_real(value.get_value_real(), code);
+        break;
+      case VCDValueType::EMPTY:
+        break;
+    }
+  }
+
+  void write_scalar(VCDBit bit, const std::string& code) {
+    reserve(code.size() + 2);
+    buffer[used++] = "01xz"[static_cast<unsigned>(bit) & 3];
+    append(code);
+    buffer[used++] = '\n';
+  }
+
+  /*!
+  @brief Write a vector given as value and unknown planes.
+  @param planes in - words words of the value plane, then as many of the unknown plane.
+  @param shorten in - Leave out the leading digits a reader extends back
+  to the same value, as described in IEEE 1800 21.7.2.1.
+  */
+  void write_vector(const uint64_t* planes, std::size_t width, std::size_t words, const std::string& code,
+                    bool shorten) {
+    reserve(width + code.size() + 4);
+    buffer[used++] = 'b';
+    std::size_t bit = width;
+    auto digit = [&](std::size_t b) {
+      const unsigned v = (planes[b / 64] >> (b % 64)) & 1;
+      const unsigned u = (planes[words + b / 64] >> (b % 64)) & 1;
+      return "01xz"[v | (u << 1)];
+    };
+    while (shorten && bit > 1) {
+      const char top = digit(bit - 1);
+      const char below = digit(bit - 2);
+      const bool redundant = top == '0' ? (below == '0' || below == '1') : (top != '1' && below == top);
+      if (!redundant) {
+        break;
+      }
+      bit--;
+    }
+    if (bit == 0) {
+      buffer[used++] = '0';
+    }
+    while (bit > 0) {
+      buffer[used++] = digit(--bit);
+    }
+    buffer[used++] = ' ';
+    append(code);
+    buffer[used++] = '\n';
+  }
+
+  //! Write a vector given as parsed digits, unchanged.
+  void write_digits(std::string_view digits, const std::string& code) {
+    reserve(digits.size() + code.size() + 3);
+    buffer[used++] = 'b';
+    append(digits);
+    buffer[used++] = ' ';
+    append(code);
+    buffer[used++] = '\n';
+  }
+
+  //! Write a real with as many digits as it takes to read back the same double.
+  void write_real(VCDReal value, const std::string& code) {
+    reserve(code.size() + 32);
+    buffer[used++] = 'r';
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    used = static_cast<std::size_t>(std::to_chars(buffer.data() + used, buffer.data() + buffer.size(), value).ptr -
+                                    buffer.data());
+#else
+    used += static_cast<std::size_t>(std::snprintf(buffer.data() + used, 28, "%.17g", value));
+#endif
+    buffer[used++] = ' ';
+    append(code);
+    buffer[used++] = '\n';
+  }
+
+  void write_time(VCDTime time) {
+    reserve(24);
+    buffer[used++] = '#';
+    used = static_cast<std::size_t>(std::to_chars(buffer.data() + used, buffer.data() + buffer.size(), time).ptr -
+                                    buffer.data());
+    buffer[used++] = '\n';
+  }
+
+  //! Start the window of a parse, writing the values tracked before it.
+  void begin_stream() {
+    started = true;
+    write_time(start_time);
+    if (state.empty()) {
+      return;
+    }
+    put("$dumpvars\n");
+    for (VCDSignalIndex i = 0; i < state.size(); ++i) {
+      if (selected(i)) {
+        write_generic(state[i], codes[i]);
+      }
+    }
+    put("$end\n");
+    state.clear();
+  }
+
+  //! Remember the value of a signal before the window.
+  void track(VCDSignalIndex index, VCDValue value) {
+    if (index >= state.size()) {
+      state.resize(index + 1);
+    }
+    state[index] = std::move(value);
+  }
+
+  //! Is a signal of the source selected?
+  [[nodiscard]] bool selected(VCDSignalIndex index) const {
+    return !ended && index < codes.size() && !codes[index].empty();
+  }
+
+  //! Return the code of a signal of the source, assigning one if it has none.
+  const std::string& code_for(VCDSignalIndex index, const VCDSignalHash& hash) {
+    if (index >= codes.size()) {
+      codes.resize(index + 1);
+    }
+    if (codes[index].empty()) {
+      codes[index] = keep_id_codes ? hash : compact_code(next_code++);
+    }
+    return codes[index];
+  }
+
+  //! Return the n-th id code, in base 94 of the printable characters.
+  static std::string compact_code(std::size_t n) {
+    std::string code;
+    do {
+      code += static_cast<char>('!' + n % 94);
+      n /= 94;
+    } while (n > 0);
+    return code;
+  }
+
+  //! Make room for n more bytes.
+  void reserve(std::size_t n) {
+    if (used + n > buffer.size()) {
+      flush();
+      if (n > buffer.size()) {
+        buffer.resize(n);
+      }
+    }
+  }
+
+  void append(std::string_view text) {
+    std::memcpy(buffer.data() + used, text.data(), text.size());
+    used += text.size();
+  }
+
+  void put(std::string_view text) {
+    reserve(text.size());
+    append(text);
+  }
+
+  //! The stream written to.
+  std::ostream& out;
+
+  //! Text not yet written to out.
+  std::vector<char> buffer;
+
+  //! Bytes of buffer in use.
+  std::size_t used = 0;
+
+  //! Written id code by signal index of the source, empty if not selected.
+  std::vector<std::string> codes;
+
+  //! Number of compact codes handed out.
+  std::size_t next_code = 0;
+
+  //! Names and types of the scopes opened by a parse.
+  std::vector<VCDScope> pending_scopes;
+
+  //! Number of scopes whose $scope line is written.
+  std::size_t written_scopes = 0;
+
+  //! Values of the selected signals before the window, while parsing.
+  std::vector<VCDValue> state;
+
+  //! Has the window of a parse started?
+  bool started = false;
+
+  //! Has a parse passed end_time?
+  bool ended = false;
+};
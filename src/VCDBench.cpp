@@ -0,0 +1,526 @@
+/*!
+@file
+@brief Throughput, memory and query benchmark of the VCDFileParser.
+*/
+
+#include "VCDGenerator.hpp"
+
+#include <vcd-parser/VCDFileParser.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#if !defined(VCD_PARSER_VERSION)
+#define VCD_PARSER_VERSION "unknown"
+#endif
+
+// GCC flags free() of pointers from the replaced operator new as mismatched.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+//! Number of calls to operator new since the start of the program.
+static std::atomic<uint64_t> allocations{0};
+
+void* operator new(std::size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* p = std::malloc(size == 0 ? 1 : size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+  std::free(p);
+}
+
+// Memory resources allocate with an alignment.
+void* operator new(std::size_t size, std::align_val_t alignment) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  const auto align = std::max(static_cast<std::size_t>(alignment), sizeof(void*));
+  void* p = nullptr;
+#if defined(_WIN32)
+  p = _aligned_malloc(size == 0 ? 1 : size, align);
+#else
+  if (posix_memalign(&p, align, size == 0 ? 1 : size) != 0) {
+    p = nullptr;
+  }
+#endif
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+#if defined(_WIN32)
+  _aligned_free(p);
+#else
+  std::free(p);
+#endif
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t alignment) noexcept {
+  operator delete(p, alignment);
+}
+
+/*!
+@brief Reset the peak resident set size to the current one.
+@details Only Linux can reset the peak, through /proc/self/clear_refs.
+Memory freed by earlier runs is returned to the system first.
+@returns false if peak_rss_kib() keeps the peak of the whole process.
+*/
+static bool reset_peak_rss() {
+#if defined(__GLIBC__)
+  malloc_trim(0);
+#endif
+#if defined(__linux__)
+  std::ofstream clear_refs("/proc/self/clear_refs");
+  clear_refs << "5";
+  clear_refs.close();
+  return !clear_refs.fail();
+#else
+  return false;
+#endif
+}
+
+//! Return the peak resident set size in KiB since the last reset_peak_rss(), 0 if unknown.
+static uint64_t peak_rss_kib() {
+#if defined(__linux__)
+  std::ifstream status("/proc/self/status");
+  for (std::string line; std::getline(status, line);) {
+    if (line.rfind("VmHWM:", 0) == 0) {
+      return std::strtoull(line.c_str() + 6, nullptr, 10);
+    }
+  }
+#endif
+#if defined(_WIN32)
+  PROCESS_MEMORY_COUNTERS counters{};
+  if (K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+    return counters.PeakWorkingSetSize / 1024;
+  }
+  return 0;
+#else
+  struct rusage usage{};
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+#if defined(__APPLE__)
+  return static_cast<uint64_t>(usage.ru_maxrss) / 1024;
+#else
+  return static_cast<uint64_t>(usage.ru_maxrss);
+#endif
+#endif
+}
+
+//! The result of parsing one file in one configuration.
+struct ParseResult {
+  std::string name;
+  std::string file;
+  unsigned threads = 1;
+  double mb_per_s = 0.0;
+  double changes_per_s = 0.0;
+  uint64_t changes = 0;
+  uint64_t allocations = 0;
+  uint64_t peak_rss_kib = 0;
+  bool peak_rss_reset = false; //!< false if peak_rss_kib is the peak of the process so far.
+  double teardown_ms = 0.0;
+  double speedup = 1.0; //!< Throughput relative to the sequential memory mapped parse.
+};
+
+//! Latencies of the queries on a parsed file.
+struct QueryResult {
+  double value_at_ns = 0.0;
+  double values_ns = 0.0;
+  double scan_ns_per_value = 0.0;
+};
+
+//! Return the number of value changes stored in a file.
+static uint64_t count_changes(const VCDFile& file) {
+  uint64_t changes = 0;
+  for (VCDSignalIndex i = 0; i < file.get_signal_index_count(); ++i) {
+    changes += file.get_signal_values(i).size();
+  }
+  return changes;
+}
+
+/*!
+@brief Parse a file repeatedly and keep the best run.
+@param megabytes in - Size the throughput is computed for, the
+uncompressed size for compressed files.
+*/
+static ParseResult measure(const std::string& name, const std::string& infile, bool memory_map, unsigned threads,
+                           int repeats, double megabytes, bool arena = false) {
+  ParseResult result;
+  result.name = name;
+  result.file = infile;
+  result.threads = threads;
+  result.peak_rss_reset = reset_peak_rss();
+
+  for (int i = 0; i < repeats; ++i) {
+    VCDFileParser parser;
+    parser.memory_map = memory_map;
+    parser.threads = threads;
+    parser.use_arena = arena;
+
+    const uint64_t allocations_before = allocations.load();
+    auto start = std::chrono::steady_clock::now();
+    auto trace = parser.parse_file(infile);
+    auto stop = std::chrono::steady_clock::now();
+    const uint64_t allocations_after = allocations.load();
+
+    if (!trace) {
+      std::cerr << "Parse of " << infile << " failed." << std::endl;
+      std::exit(1);
+    }
+
+    const double seconds = std::chrono::duration<double>(stop - start).count();
+    if (megabytes / seconds > result.mb_per_s) {
+      result.changes = count_changes(*trace);
+      result.mb_per_s = megabytes / seconds;
+      result.changes_per_s = static_cast<double>(result.changes) / seconds;
+      result.allocations = allocations_after - allocations_before;
+    }
+
+    start = std::chrono::steady_clock::now();
+    trace.reset();
+    stop = std::chrono::steady_clock::now();
+    const double teardown_ms = std::chrono::duration<double, std::milli>(stop - start).count();
+    if (i == 0 || teardown_ms < result.teardown_ms) {
+      result.teardown_ms = teardown_ms;
+    }
+  }
+
+  result.peak_rss_kib = peak_rss_kib();
+  return result;
+}
+
+//! Measure random point queries, lookups and full scans of a parsed file.
+static QueryResult measure_queries(const VCDFile& file, std::size_t count, uint64_t seed) {
+  QueryResult result;
+  const auto& signals = file.get_signals();
+  const auto& times = file.get_timestamps();
+  if (signals.empty() || times.empty()) {
+    return result;
+  }
+
+  VCDGeneratorRandom random(seed);
+  std::vector<std::pair<const VCDSignal*, VCDTime>> queries(count);
+  for (auto& [signal, time] : queries) {
+    signal = &signals[random.below(signals.size())];
+    time = times[random.below(times.size())];
+  }
+
+  // Keeps the compiler from dropping the queries.
+  uint64_t sink = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  for (const auto& [signal, time] : queries) {
+    try {
+      sink += static_cast<uint64_t>(file.get_signal_value_at(signal->hash, time).get_type());
+    } catch (const std::exception&) {
+      // No value before time, still a valid query.
+    }
+  }
+  auto stop = std::chrono::steady_clock::now();
+  result.value_at_ns = std::chrono::duration<double, std::nano>(stop - start).count() / static_cast<double>(count);
+
+  start = std::chrono::steady_clock::now();
+  for (const auto& [signal, time] : queries) {
+    if (file.timelines_compressed()) {
+      sink += file.get_compressed_values(file.get_signal_index(signal->hash)).size();
+    } else {
+      sink += file.get_signal_values(signal->hash).size();
+    }
+  }
+  stop = std::chrono::steady_clock::now();
+  result.values_ns = std::chrono::duration<double, std::nano>(stop - start).count() / static_cast<double>(count);
+
+  uint64_t values = 0;
+  start = std::chrono::steady_clock::now();
+  const auto scan = [&](const auto& timeline) {
+    for (const VCDTimedValue& timed : timeline) {
+      sink += static_cast<uint64_t>(timed.time);
+      values++;
+    }
+  };
+  for (VCDSignalIndex i = 0; i < file.get_signal_index_count(); ++i) {
+    if (file.timelines_compressed()) {
+      scan(file.get_compressed_values(i));
+    } else {
+      scan(file.get_signal_values(i));
+    }
+  }
+  stop = std::chrono::steady_clock::now();
+  result.scan_ns_per_value =
+      values == 0 ? 0.0 : std::chrono::duration<double, std::nano>(stop - start).count() / static_cast<double>(values);
+
+  if (sink == 42) {
+    std::cerr << std::endl;
+  }
+  return result;
+}
+
+//! Quote a string for JSON.
+static std::string json_string(const std::string& text) {
+  std::string quoted = "\"";
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      quoted += '\\';
+    }
+    quoted += c;
+  }
+  return quoted + "\"";
+}
+
+static void print_usage(const char* program) {
+  std::cout << "Usage: " << program << " [options] [file.vcd [file.vcd.gz|.zst|.xz ...]]\n"
+            << "Benchmarks a file, or a generated one if none is given.\n"
+            << "Compressed copies of the file are parsed too.\n\n"
+            << "  --repeats N      runs per measurement, the best counts (3)\n"
+            << "  --queries N      random point queries (100000)\n"
+            << "  --json           print the results as JSON\n"
+            << "  --threads N      parse in parallel with every count from 2 to N\n"
+            << "                   (powers of two up to the number of cores)\n"
+            << "  --generate PATH  only write the generated file to PATH\n\n"
+            << "Generator settings:\n"
+            << "  --signals N      declared signals (1000)\n"
+            << "  --min-width N    smallest signal width (1)\n"
+            << "  --max-width N    largest signal width (64)\n"
+            << "  --density F      fraction of signals changing per timestamp (0.05)\n"
+            << "  --reals F        fraction of real signals (0.02)\n"
+            << "  --xz F           probability of an x or z bit (0.01)\n"
+            << "  --size MB        file size (64)\n"
+            << "  --seed N         random seed (1)" << std::endl;
+}
+
+/*!
+@brief Measure the stdio and the memory mapped input path, the scaling of
+the parallel parse with the number of threads, compressed input and the
+query latency, on a given or a generated file.
+*/
+int main(int argc, char **argv) {
+
+  VCDGeneratorConfig config;
+  int repeats = 3;
+  std::size_t query_count = 100000;
+  bool json = false;
+  std::string generate_path;
+  unsigned max_threads = 0;
+  std::vector<std::string> files;
+
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    const bool has_value = i + 1 < argc;
+    if (arg == "--help" || arg == "-h") {
+      print_usage(argv[0]);
+      return 0;
+    } else if (arg == "--json") {
+      json = true;
+    } else if (arg.rfind("--", 0) == 0 && !has_value) {
+      std::cerr << "Missing value of " << arg << std::endl;
+      return 1;
+    } else if (arg == "--repeats") {
+      repeats = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--queries") {
+      query_count = std::max<std::size_t>(1, std::strtoull(argv[++i], nullptr, 10));
+    } else if (arg == "--threads") {
+      max_threads = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+    } else if (arg == "--generate") {
+      generate_path = argv[++i];
+    } else if (arg == "--signals") {
+      config.signals = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--min-width") {
+      config.min_width = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--max-width") {
+      config.max_width = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--density") {
+      config.density = std::atof(argv[++i]);
+    } else if (arg == "--reals") {
+      config.reals = std::atof(argv[++i]);
+    } else if (arg == "--xz") {
+      config.xz_ratio = std::atof(argv[++i]);
+    } else if (arg == "--size") {
+      config.bytes = static_cast<std::size_t>(std::atof(argv[++i]) * 1024 * 1024);
+    } else if (arg == "--seed") {
+      config.seed = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg.rfind("--", 0) == 0) {
+      std::cerr << "Unknown option " << arg << std::endl;
+      return 1;
+    } else {
+      files.push_back(arg);
+    }
+  }
+
+  const bool generated = files.empty();
+  if (generated) {
+    const std::string path = !generate_path.empty()
+                                 ? generate_path
+                                 : (std::filesystem::temp_directory_path() /
+                                    ("vcd-bench-" + std::to_string(config.seed) + ".vcd")).string();
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+      std::cerr << "Cannot write " << path << std::endl;
+      return 1;
+    }
+    vcd_generate(config, out);
+    if (!generate_path.empty()) {
+      return 0;
+    }
+    files.push_back(path);
+  }
+
+  const std::string& infile = files.front();
+  std::error_code size_error;
+  const auto size = std::filesystem::file_size(infile, size_error);
+  if (size_error) {
+    std::cerr << "Cannot open " << infile << std::endl;
+    return 1;
+  }
+  const double megabytes = static_cast<double>(size) / (1024.0 * 1024.0);
+
+  std::vector<ParseResult> results;
+  results.push_back(measure("stdio", infile, false, 1, repeats, megabytes));
+  results.push_back(measure("mmap", infile, true, 1, repeats, megabytes));
+  results.push_back(measure("arena", infile, true, 1, repeats, megabytes, true));
+
+  const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<unsigned> thread_counts;
+  if (max_threads > 0) {
+    for (unsigned threads = 2; threads <= max_threads; ++threads) {
+      thread_counts.push_back(threads);
+    }
+  } else {
+    for (unsigned threads = 2; threads < cores; threads *= 2) {
+      thread_counts.push_back(threads);
+    }
+    if (cores > 1) {
+      thread_counts.push_back(cores);
+    }
+  }
+  const double sequential_mb_per_s = results[1].mb_per_s;
+  for (unsigned threads : thread_counts) {
+    results.push_back(measure("parallel", infile, true, threads, repeats, megabytes));
+  }
+
+  for (std::size_t i = 1; i < files.size(); ++i) {
+    results.push_back(measure("compressed", files[i], true, 1, repeats, megabytes));
+  }
+
+  for (ParseResult& r : results) {
+    r.speedup = r.mb_per_s / sequential_mb_per_s;
+  }
+
+  VCDFileParser parser;
+  auto trace = parser.parse_file(infile);
+  const QueryResult queries = measure_queries(*trace, query_count, config.seed);
+
+  const std::size_t values_bytes = trace->values_memory_usage();
+  trace->compress_timelines();
+  const std::size_t compressed_bytes = trace->values_memory_usage();
+  const QueryResult compressed_queries = measure_queries(*trace, query_count, config.seed);
+
+  if (generated) {
+    std::filesystem::remove(infile);
+  }
+
+  std::cout << std::fixed << std::setprecision(1);
+  if (json) {
+    std::cout << "{\n"
+              << "  \"version\": " << json_string(VCD_PARSER_VERSION) << ",\n"
+              << "  \"file\": " << json_string(generated ? "generated" : infile) << ",\n"
+              << "  \"megabytes\": " << megabytes << ",\n"
+              << "  \"cores\": " << cores << ",\n"
+              << "  \"signals\": " << trace->get_signals().size() << ",\n"
+              << "  \"timestamps\": " << trace->get_timestamps().size() << ",\n";
+    if (generated) {
+      std::cout << std::defaultfloat << "  \"generator\": {\"signals\": " << config.signals << ", \"min_width\": " << config.min_width
+                << ", \"max_width\": " << config.max_width << ", \"density\": " << config.density
+                << ", \"reals\": " << config.reals << ", \"xz\": " << config.xz_ratio
+                << ", \"seed\": " << config.seed << "},\n" << std::fixed;
+    }
+    std::cout << "  \"parse\": [\n";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+      const ParseResult& r = results[i];
+      std::cout << "    {\"name\": " << json_string(r.name) << ", \"file\": " << json_string(r.file)
+                << ", \"threads\": " << r.threads << ", \"mb_per_s\": " << r.mb_per_s
+                << ", \"changes_per_s\": " << r.changes_per_s << ", \"changes\": " << r.changes
+                << ", \"allocations\": " << r.allocations << ", \"peak_rss_kib\": " << r.peak_rss_kib
+                << ", \"peak_rss_per_run\": " << (r.peak_rss_reset ? "true" : "false")
+                << ", \"teardown_ms\": " << r.teardown_ms << ", \"speedup\": " << std::setprecision(2)
+                << r.speedup << std::setprecision(1) << "}"
+                << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    std::cout << "  ],\n"
+              << "  \"queries\": {\"count\": " << query_count
+              << ", \"get_signal_value_at_ns\": " << queries.value_at_ns
+              << ", \"get_signal_values_ns\": " << queries.values_ns
+              << ", \"scan_ns_per_value\": " << queries.scan_ns_per_value << "},\n"
+              << "  \"compressed_values\": {\"values_bytes\": " << values_bytes
+              << ", \"compressed_bytes\": " << compressed_bytes
+              << ", \"get_signal_value_at_ns\": " << compressed_queries.value_at_ns
+              << ", \"scan_ns_per_value\": " << compressed_queries.scan_ns_per_value << "}\n"
+              << "}" << std::endl;
+    return 0;
+  }
+
+  std::cout << "File:          " << (generated ? "generated" : infile) << " (" << megabytes << " MB, "
+            << trace->get_signals().size() << " signals, " << cores << " cores)" << std::endl;
+  for (const ParseResult& r : results) {
+    std::ostringstream name;
+    name << r.name;
+    if (r.name == "parallel") {
+      name << " x" << r.threads;
+    } else if (r.name == "compressed") {
+      name << " " << r.file;
+    }
+    std::cout << std::left << std::setw(15) << name.str() << std::right << std::setw(8) << r.mb_per_s << " MB/s "
+              << std::setw(12) << r.changes_per_s / 1e6 << " M changes/s " << std::setw(10) << r.allocations
+              << " allocations " << std::setw(8) << r.peak_rss_kib / 1024
+              << (r.peak_rss_reset ? " MiB peak RSS " : " MiB peak RSS*") << std::setw(8)
+              << r.teardown_ms << " ms teardown " << std::setprecision(2) << std::setw(6) << r.speedup
+              << "x mmap" << std::setprecision(1) << std::endl;
+  }
+  std::cout << std::setprecision(0)
+            << "get_signal_value_at: " << queries.value_at_ns << " ns" << std::endl
+            << "get_signal_values:   " << queries.values_ns << " ns" << std::endl
+            << "scan:                " << std::setprecision(1) << queries.scan_ns_per_value << " ns/value"
+            << std::endl
+            << "compressed values:   " << values_bytes / 1048576.0 << " -> " << compressed_bytes / 1048576.0
+            << " MiB, get_signal_value_at " << std::setprecision(0) << compressed_queries.value_at_ns
+            << " ns, scan " << std::setprecision(1) << compressed_queries.scan_ns_per_value << " ns/value"
+            << std::endl;
+  if (std::any_of(results.begin(), results.end(), [](const ParseResult& r) { return !r.peak_rss_reset; })) {
+    std::cout << "* peak RSS of the process so far, it cannot be reset on this system" << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,190 @@
+/*!
+@file
+@brief Deterministic generator of synthetic VCD files for benchmarks.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+//! Settings of a synthetic VCD file.
+struct VCDGeneratorConfig {
+  //! Number of declared signals.
+  std::size_t signals = 1000;
+
+  //! Smallest width of a non-real signal, 1 makes scalar wires.
+  std::size_t min_width = 1;
+
+  //! Largest width of a non-real signal.
+  std::size_t max_width = 64;
+
+  //! Fraction of signals changing at each timestamp.
+  double density = 0.05;
+
+  //! Fraction of signals declared as real.
+  double reals = 0.02;
+
+  //! Probability of a bit being x or z.
+  double xz_ratio = 0.01;
+
+  //! Size of the generated file, the last timestamp block may exceed it.
+  std::size_t bytes = std::size_t(64) << 20;
+
+  //! Seed, equal seeds and settings give identical files on every platform.
+  uint64_t seed = 1;
+};
+
+/*!
+@brief Random numbers with a fixed algorithm (splitmix64).
+@details The standard distributions are implementation defined, so they
+would make generated files differ between standard libraries.
+*/
+class VCDGeneratorRandom {
+
+public:
+  explicit VCDGeneratorRandom(uint64_t seed) : state(seed) {}
+
+  //! Next 64 random bits.
+  uint64_t next() {
+    uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+
+  //! A number in [0, n).
+  uint64_t below(uint64_t n) {
+    return n == 0 ? 0 : next() % n;
+  }
+
+  //! true with probability p.
+  bool chance(double p) {
+    return static_cast<double>(next() >> 11) * (1.0 / 9007199254740992.0) < p;
+  }
+
+protected:
+  uint64_t state;
+};
+
+/*!
+@brief Write a synthetic VCD file.
+@details Signals are spread over scopes of 64 signals below "top". The
+value change section starts with a $dumpvars of every signal, followed
+by timestamps 1 to 10 time units apart, each changing density * signals
+randomly picked signals.
+@returns The number of value changes written.
+*/
+inline uint64_t vcd_generate(const VCDGeneratorConfig& config, std::ostream& out) {
+  VCDGeneratorRandom random(config.seed);
+
+  struct Signal {
+    std::string code;
+    std::size_t width;
+    bool real;
+  };
+
+  std::vector<Signal> signals(std::max<std::size_t>(config.signals, 1));
+  const std::size_t min_width = std::max<std::size_t>(config.min_width, 1);
+  const std::size_t max_width = std::max(config.max_width, min_width);
+
+  std::string text;
+  text += "$date\n  synthetic\n$end\n";
+  text += "$version\n  vcd-bench generator, seed " + std::to_string(config.seed) + "\n$end\n";
+  text += "$timescale 1ps $end\n";
+  text += "$scope module top $end\n";
+
+  for (std::size_t i = 0; i < signals.size(); ++i) {
+    Signal& signal = signals[i];
+
+    // Id codes count in base 94 from '!'.
+    for (std::size_t n = i;; n = n / 94 - 1) {
+      signal.code += static_cast<char>('!' + n % 94);
+      if (n < 94) {
+        break;
+      }
+    }
+
+    signal.real = random.chance(config.reals);
+    signal.width = signal.real ? 64 : min_width + random.below(max_width - min_width + 1);
+
+    if (i % 64 == 0) {
+      if (i > 0) {
+        text += "$upscope $end\n";
+      }
+      text += "$scope module block" + std::to_string(i / 64) + " $end\n";
+    }
+
+    text += "$var ";
+    text += signal.real ? "real" : signal.width == 1 ? "wire" : "reg";
+    text += " " + std::to_string(signal.width) + " " + signal.code + " s" + std::to_string(i);
+    if (!signal.real && signal.width > 1) {
+      text += " [" + std::to_string(signal.width - 1) + ":0]";
+    }
+    text += " $end\n";
+  }
+  text += "$upscope $end\n$upscope $end\n$enddefinitions $end\n";
+
+  uint64_t changes = 0;
+  std::size_t written = 0;
+
+  const auto bit = [&]() {
+    if (random.chance(config.xz_ratio)) {
+      return random.below(2) == 0 ? 'x' : 'z';
+    }
+    return static_cast<char>('0' + random.below(2));
+  };
+
+  const auto change = [&](const Signal& signal) {
+    if (signal.real) {
+      text += 'r';
+      text += std::to_string(static_cast<double>(random.below(2000000)) / 1000.0 - 1000.0);
+      text += ' ';
+    } else if (signal.width == 1) {
+      text += bit();
+    } else {
+      text += 'b';
+      for (std::size_t b = 0; b < signal.width; ++b) {
+        text += bit();
+      }
+      text += ' ';
+    }
+    text += signal.code;
+    text += '\n';
+    changes++;
+  };
+
+  const auto flush = [&]() {
+    out.write(text.data(), static_cast<std::streamsize>(text.size()));
+    written += text.size();
+    text.clear();
+  };
+
+  text += "#0\n$dumpvars\n";
+  for (const Signal& signal : signals) {
+    change(signal);
+  }
+  text += "$end\n";
+
+  const auto per_step = std::max<std::size_t>(1, static_cast<std::size_t>(config.density * signals.size() + 0.5));
+  uint64_t time = 0;
+
+  while (written + text.size() < config.bytes) {
+    time += 1 + random.below(10);
+    text += '#';
+    text += std::to_string(time);
+    text += '\n';
+    for (std::size_t c = 0; c < per_step; ++c) {
+      change(signals[random.below(signals.size())]);
+    }
+    if (text.size() > (std::size_t(1) << 20)) {
+      flush();
+    }
+  }
+  flush();
+
+  return changes;
+}
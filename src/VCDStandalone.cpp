@@ -3,7 +3,114 @@
 @brief Definition of the VCDFileParser class
 */
 
+#include <vcd-parser/VCDArrayExporter.hpp>
+#include <vcd-parser/VCDDiff.hpp>
 #include <vcd-parser/VCDFileParser.hpp>
+#include <vcd-parser/VCDWriter.hpp>
+
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+/*!
+@brief Print the statistics of a parse and the signals holding the most memory.
+*/
+static void print_stats(const VCDParseStats& stats, const VCDFile& trace) {
+  std::cout << "Statistics:" << std::endl;
+  std::cout << "\tBytes:          " << stats.bytes << std::endl;
+  std::cout << "\tTimestamps:     " << stats.timestamps << std::endl;
+  std::cout << "\tScalar changes: " << stats.scalar_changes << std::endl;
+  std::cout << "\tVector changes: " << stats.vector_changes << std::endl;
+  std::cout << "\tReal changes:   " << stats.real_changes << std::endl;
+  std::cout << std::fixed << std::setprecision(3);
+  std::cout << "\tHeader:         " << stats.header_seconds << " s" << std::endl;
+  std::cout << "\tBody:           " << stats.body_seconds << " s" << std::endl;
+  std::cout << "\tStorage:        " << stats.storage_seconds << " s (estimated)" << std::endl;
+
+  std::cout << "Tokens:" << std::endl;
+  for (const auto& [name, count] : stats.tokens) {
+    std::cout << "\t" << std::left << std::setw(24) << name << std::right << count << std::endl;
+  }
+
+  // Name each signal index after the first signal declared with it.
+  std::vector<const VCDSignal*> names(trace.get_signal_index_count(), nullptr);
+  for (const VCDSignal& signal : trace.get_signals()) {
+    if (names[signal.index] == nullptr) {
+      names[signal.index] = &signal;
+    }
+  }
+
+  std::cout << "Largest signals:" << std::endl;
+  for (VCDSignalIndex index : stats.top_signals(10)) {
+    const VCDSignal* signal = index < names.size() ? names[index] : nullptr;
+    std::cout << "\t" << std::setw(12) << (index < stats.signal_bytes.size() ? stats.signal_bytes[index] : 0)
+              << " bytes " << std::setw(10) << (index < stats.signal_changes.size() ? stats.signal_changes[index] : 0)
+              << " changes\t" << (signal != nullptr ? trace.get_signal_path(*signal) : std::string("(undeclared)")) << std::endl;
+  }
+}
+
+/*!
+@brief Print the differences between two files.
+@returns The exit code, 0 if the files are equal.
+*/
+static int print_diff(const std::string& left, const std::string& right) {
+  VCDDiff diff;
+  VCDDiffResult result;
+  if (!diff.compare(left, right, result)) {
+    std::cout << "Parse Failed." << std::endl;
+    return 2;
+  }
+
+  if (result.timescales_differ) {
+    std::cout << "Timescales differ" << std::endl;
+  }
+  for (const std::string& path : result.only_left) {
+    std::cout << "Only in " << left << ":\t" << path << std::endl;
+  }
+  for (const std::string& path : result.only_right) {
+    std::cout << "Only in " << right << ":\t" << path << std::endl;
+  }
+  for (const VCDSignalDiff& signal : result.signals) {
+    std::cout << "Differs from " << signal.divergences.front().time << ":\t" << signal.path << std::endl;
+  }
+  if (result.identical()) {
+    std::cout << "Files are equal." << std::endl;
+  }
+  return result.identical() ? 0 : 1;
+}
+
+/*!
+@brief Rewrite a file while parsing it, with new id codes.
+@returns The exit code, 0 on success.
+*/
+static int rewrite(const std::string& infile, const std::string& outfile) {
+  std::ofstream out(outfile, std::ios::binary);
+  VCDWriter writer(out);
+  VCDFileParser parser;
+  if (!out || !parser.parse_file(infile, writer)) {
+    std::cout << "Parse Failed." << std::endl;
+    return 2;
+  }
+  writer.flush();
+  return out.good() ? 0 : 2;
+}
+
+/*!
+@brief Export the values of all signals of a file as .npy files.
+@returns The exit code, 0 on success.
+*/
+static int export_npy(const std::string& infile, const std::string& directory) {
+  VCDFileParser parser;
+  auto trace = parser.parse_file(infile);
+  VCDArrayExporter exporter;
+  if (!trace || !exporter.write_npy(*trace, directory)) {
+    std::cout << "Export Failed." << std::endl;
+    return 2;
+  }
+  std::cout << "Exported " << exporter.get_arrays().size() << " arrays to " << directory << std::endl;
+  return 0;
+}
 
 /*!
 @brief Standalone test function to allow testing of the VCD file parser.
@@ -12,14 +119,27 @@ int main(int argc, char **argv) {
 
   if (argc < 2) {
     std::cout << "Argument missing" << std::endl;
+    std::cout << "Usage: " << argv[0] << " <file.vcd> [--stats | --diff <other.vcd> | --write <out.vcd> | --npy <directory>]" << std::endl;
     return 0;
   }
 
   std::string infile(argv[1]);
+  if (argc > 3 && std::string(argv[2]) == "--diff") {
+    return print_diff(infile, argv[3]);
+  }
+  if (argc > 3 && std::string(argv[2]) == "--write") {
+    return rewrite(infile, argv[3]);
+  }
+  if (argc > 3 && std::string(argv[2]) == "--npy") {
+    return export_npy(infile, argv[3]);
+  }
+
+  const bool print_statistics = argc > 2 && std::string(argv[2]) == "--stats";
 
   std::cout << "Parsing " << infile << std::endl;
 
   VCDFileParser parser;
+  parser.collect_stats = print_statistics;
 
   auto trace = parser.parse_file(infile);
   trace = parser.parse_file(infile);
@@ -53,7 +173,10 @@ int main(int argc, char **argv) {
       }
     }
 
-
+    if (print_statistics)
+    {
+      print_stats(parser.stats, *trace);
+    }
 
     return 0;
   }
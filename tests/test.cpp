@@ -1,10 +1,28 @@
 #include <vcd-parser/VCDFileParser.hpp>
+#include <vcd-parser/VCDActivity.hpp>
+#include <vcd-parser/VCDArrayExporter.hpp>
 #include <vcd-parser/VCDComparisons.hpp>
+#include <vcd-parser/VCDDiff.hpp>
+#include <vcd-parser/VCDFileFollower.hpp>
+#include <vcd-parser/VCDLazyFile.hpp>
+#include <vcd-parser/VCDNumbers.hpp>
+#include <vcd-parser/VCDSignalMerge.hpp>
+#include <vcd-parser/VCDWriter.hpp>
 
 #include <catch2/catch_test_macros.hpp>
 
 #include <algorithm>
+#include <atomic>
 #include <cctype>
+#include <cmath>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <memory_resource>
+#include <thread>
 
 inline void ltrim(std::string &s) {
   s.erase(s.begin(), std::find_if(s.begin(), s.end(), [](unsigned char ch) {
@@ -35,6 +53,8 @@ TEST_CASE("Basic parsing", "[VCD]") {
   REQUIRE(trace != nullptr);
   CHECK(trim_copy(trace->version) == "Icarus Verilog");
   CHECK(trim_copy(trace->date) == "Wed Mar 01 17:08:44 2023");
+  CHECK(trace->time_resolution == 1);
+  CHECK(trace->time_units == VCDTimeUnit::TIME_S);
   CHECK(trace->get_signals().size() == 14);
   CHECK(trace->get_timestamps().size() == 11);
 }
@@ -46,6 +66,7 @@ TEST_CASE("Advanced parsing", "[VCD]") {
     REQUIRE(trace != nullptr);
     CHECK(trim_copy(trace->version) == "Icarus Verilog");
     CHECK(trim_copy(trace->date) == "Fri Oct  6 16:38:36 2023");
+    CHECK(trace->time_units == VCDTimeUnit::TIME_PS);
     CHECK(trace->get_signals().size() == 3354);
     CHECK(trace->get_timestamps().size() == 2201);
 }
@@ -69,4 +90,1361 @@ TEST_CASE("Basic compare", "[VCD]") {
   REQUIRE(trace2 != nullptr);
 
   CHECK(*trace1 == *trace2);
-}
\ No newline at end of file
+}
+
+TEST_CASE("Mapped and buffered input agree", "[VCD]") {
+  VCDFileParser parser;
+
+  parser.memory_map = true;
+  auto mapped = parser.parse_file("../../tests/testfiles/advanced.vcd");
+  REQUIRE(mapped != nullptr);
+
+  parser.memory_map = false;
+  auto buffered = parser.parse_file("../../tests/testfiles/advanced.vcd");
+  REQUIRE(buffered != nullptr);
+
+  CHECK(*mapped == *buffered);
+}
+
+TEST_CASE("Mapped segments split inside a comment", "[VCD]") {
+  const std::string path = (std::filesystem::temp_directory_path() / "segments.vcd").string();
+  std::ofstream(path, std::ios::binary)
+      << "$date\n  today\n$end\n$comment\n  first line\n  second line\n  third line\n$end\n"
+         "$timescale 1ns $end\n$scope module top $end\n$var wire 1 ! clk $end\n$upscope $end\n"
+         "$enddefinitions $end\n#0\n0!\n#10\n1!\n#20\n0!\n";
+
+  VCDFileParser parser;
+  parser.memory_map = false;
+  auto buffered = parser.parse_file(path);
+  REQUIRE(buffered != nullptr);
+
+  // Cut the file after "first line", inside the $comment block.
+  parser.memory_map = true;
+  parser.scan_segment_size = 50;
+  auto mapped = parser.parse_file(path);
+  REQUIRE(mapped != nullptr);
+  CHECK(mapped->comment == buffered->comment);
+  CHECK(mapped->date == buffered->date);
+  CHECK(*mapped == *buffered);
+
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("Dense signal indices", "[VCD]") {
+  VCDFileParser parser;
+
+  auto trace = parser.parse_file("../../tests/testfiles/advanced.vcd");
+  REQUIRE(trace != nullptr);
+
+  for (const auto& signal : trace->get_signals()) {
+    REQUIRE(signal.index < trace->get_signal_index_count());
+    CHECK(trace->get_signal_index(signal.hash) == signal.index);
+    CHECK(&trace->get_signal_values(signal.hash) == &trace->get_signal_values(signal.index));
+  }
+  CHECK(trace->get_signal_index("not a hash") == VCD_SIGNAL_NONE);
+
+  // Codes too long for the flat table, the copy outlives the original.
+  auto codes = std::make_unique<VCDIdCodeMap>();
+  for (int i = 0; i < 1000; ++i) {
+    CHECK(codes->intern("sparse_code_" + std::to_string(i)) == static_cast<VCDSignalIndex>(i));
+  }
+  CHECK(codes->intern("!") == 1000);
+  const VCDIdCodeMap copy = *codes;
+  VCDIdCodeMap moved = std::move(*codes);
+  codes.reset();
+  for (int i = 0; i < 1000; ++i) {
+    CHECK(copy.find("sparse_code_" + std::to_string(i)) == static_cast<VCDSignalIndex>(i));
+    CHECK(moved.find("sparse_code_" + std::to_string(i)) == static_cast<VCDSignalIndex>(i));
+  }
+  CHECK(copy.find("!") == 1000);
+  CHECK(copy.find("sparse_code_1000") == VCD_SIGNAL_NONE);
+}
+
+TEST_CASE("Packed four-state vectors", "[VCD]") {
+  VCDFileParser parser;
+
+  auto trace = parser.parse_file("../../tests/testfiles/ghdl_4_states.vcd");
+  REQUIRE(trace != nullptr);
+
+  const auto& xr = trace->get_signal_values("#");
+  REQUIRE(!xr.empty());
+  const VCDPackedVector first = xr.front().value.get_value_packed();
+  CHECK(first.width() == 5);
+  CHECK(first.to_string() == "XXXXX");
+  CHECK(first.has_unknown());
+  CHECK(xr.front().value.get_value_vector() == VCDBitVector(5, VCDBit::VCD_X));
+
+  auto a = VCDPackedVector::from_ascii("01xz01xz", 8);
+  auto b = VCDPackedVector::from_ascii("0000zzzz", 8);
+  CHECK((a & b).to_string() == "00000XXX");
+  CHECK((a | b).to_string() == "01XXX1XX");
+  CHECK((~a).to_string() == "10XX10XX");
+  CHECK(a.slice(4, 4).to_string() == "01XZ");
+  CHECK(a != b);
+}
+
+TEST_CASE("Columnar timelines", "[VCD]") {
+  VCDFileParser parser;
+
+  auto trace = parser.parse_file("../../tests/testfiles/simple.vcd");
+  REQUIRE(trace != nullptr);
+
+  const auto& counter = trace->get_signal_values("'");
+  CHECK(counter.column_type() == VCDColumnType::VECTOR);
+  CHECK(counter.vector_width() == 32);
+  REQUIRE(counter.size() == 11);
+  CHECK(counter.times().back() == 20);
+
+  uint64_t value = 0;
+  REQUIRE(counter.vector_at(10).to_uint64(value));
+  CHECK(value == 10);
+
+  auto window = counter.range(4, 10);
+  CHECK(window.second - window.first == 3);
+  CHECK(window.first->time == 4);
+
+  const auto& c = trace->get_signal_values("\"");
+  CHECK(c.column_type() == VCDColumnType::SCALAR);
+  CHECK(c.scalar_at(0) == VCDBit::VCD_1);
+}
+
+TEST_CASE("Point queries and cursors", "[VCD]") {
+  VCDFileParser parser;
+
+  std::shared_ptr<const VCDFile> trace = parser.parse_file("../../tests/testfiles/simple.vcd");
+  REQUIRE(trace != nullptr);
+
+  uint64_t value = 0;
+  REQUIRE(trace->get_signal_value_at("'", 7).get_value_packed().to_uint64(value));
+  CHECK(value == 3);
+  CHECK_THROWS(trace->get_signal_value_at("not a hash", 7));
+
+  VCDSignalCursor cursor = trace->get_signal_cursor("'");
+  for (VCDTime time : trace->get_timestamps()) {
+    REQUIRE(cursor.advance_to(time));
+    CHECK(cursor.time() == time);
+    CHECK(cursor.value() == trace->get_signal_value_at("'", time));
+  }
+
+  REQUIRE(cursor.seek(5));
+  CHECK(cursor.time() == 4);
+  CHECK(cursor.next_time() == 6);
+}
+
+TEST_CASE("Streaming visitor", "[VCD]") {
+  struct CountingVisitor : public VCDVisitor {
+    std::size_t vars = 0;
+    std::size_t timestamps = 0;
+    std::size_t changes = 0;
+    bool finished = false;
+
+    void on_var(const VCDSignal&) override { vars += 1; }
+    void on_timestamp(VCDTime) override { timestamps += 1; }
+    void on_scalar_change(VCDTime, VCDSignalIndex, VCDBit) override { changes += 1; }
+    void on_vector_change(VCDTime, VCDSignalIndex, std::string_view) override { changes += 1; }
+    void on_real_change(VCDTime, VCDSignalIndex, VCDReal) override { changes += 1; }
+    void on_finish() override { finished = true; }
+  };
+
+  VCDFileParser parser;
+  CountingVisitor visitor;
+
+  REQUIRE(parser.parse_file("../../tests/testfiles/advanced.vcd", visitor));
+  CHECK(visitor.finished);
+  CHECK(visitor.vars == 3354);
+  CHECK(visitor.timestamps == 2201);
+
+  auto trace = parser.parse_file("../../tests/testfiles/advanced.vcd");
+  REQUIRE(trace != nullptr);
+  std::size_t values = 0;
+  for (VCDSignalIndex i = 0; i < trace->get_signal_index_count(); ++i) {
+    values += trace->get_signal_values(i).size();
+  }
+  CHECK(values == visitor.changes);
+}
+
+TEST_CASE("Signal selection", "[VCD]") {
+  VCDFileParser parser;
+
+  auto full = parser.parse_file("../../tests/testfiles/simple.vcd");
+  REQUIRE(full != nullptr);
+
+  parser.selection.add_path("*.a_t");
+  parser.selection.add_scope("OneBitOr_tb.Ins");
+  parser.selection.add_var_type(VCDVarType::VCD_VAR_WIRE);
+
+  auto trace = parser.parse_file("../../tests/testfiles/simple.vcd");
+  REQUIRE(trace != nullptr);
+  CHECK(trace->get_signals().size() == full->get_signals().size());
+  CHECK(trace->get_timestamps() == full->get_timestamps());
+
+  // Every wire in Ins, and the a_t of the testbench is a reg.
+  for (const char* hash : {"#", ")", "%", "*", "\"", "+"}) {
+    CHECK(trace->get_signal_values(hash) == full->get_signal_values(hash));
+  }
+  for (const char* hash : {"!", "$", "&", "'", "("}) {
+    CHECK(trace->get_signal_values(hash).empty());
+  }
+
+  // Vector and real values may be separated from their id code by a newline.
+  const std::string path = (std::filesystem::temp_directory_path() / "selection.vcd").string();
+  std::ofstream(path) << "$timescale 1ps $end\n$scope module top $end\n$var wire 4 ! a $end\n$var wire 4 \" b $end\n"
+                         "$var real 64 # r $end\n$upscope $end\n$enddefinitions $end\n"
+                         "#0\nb0101\n!\nb1100\n\"\nr1.5\n#\n#1\nb0110 !\nb1\n\n\"\n";
+  VCDFileParser selecting;
+  selecting.selection.add_path("top.a");
+  auto selected = selecting.parse_file(path);
+  REQUIRE(selected != nullptr);
+  CHECK(selected->get_signal_values("!").size() == 2);
+  CHECK(selected->get_signal_values("\"").empty());
+  CHECK(selected->get_signal_values("#").empty());
+  std::filesystem::remove(path);
+
+  CHECK(vcd_glob_match("top.*.clk", "top.uut.core.clk"));
+  CHECK_FALSE(vcd_glob_match("top.?.clk", "top.uut.clk"));
+}
+
+TEST_CASE("Parallel parsing", "[VCD]") {
+  VCDFileParser parser;
+
+  auto sequential = parser.parse_file("../../tests/testfiles/advanced.vcd");
+  REQUIRE(sequential != nullptr);
+
+  for (unsigned threads : {2u, 3u, 8u}) {
+    parser.threads = threads;
+    auto parallel = parser.parse_file("../../tests/testfiles/advanced.vcd");
+    REQUIRE(parallel != nullptr);
+    CHECK(parallel->get_timestamps() == sequential->get_timestamps());
+    CHECK(*parallel == *sequential);
+  }
+}
+
+TEST_CASE("Parallel parsing skips comments", "[VCD]") {
+  const std::string path = (std::filesystem::temp_directory_path() / "body_comment.vcd").string();
+  {
+    std::ofstream out(path, std::ios::binary);
+    out << "$comment\n#1 is no time\n$end\n$timescale 1ns $end\n$scope module top $end\n"
+           "$var wire 1 ! clk $end\n$var wire 8 \" bus $end\n$upscope $end\n$enddefinitions $end\n";
+    for (int t = 0; t < 400; ++t) {
+      out << "#" << t * 10 << "\n" << (t % 2) << "!\nb" << (t % 4 == 0 ? "1010" : "11") << " \"\n";
+      if (t % 50 == 25) {
+        out << "$comment\n";
+        for (int line = 0; line < 40; ++line) {
+          out << "#" << line << " dumped by a test bench\n";
+        }
+        out << "$end\n";
+      }
+    }
+  }
+
+  VCDFileParser parser;
+  auto sequential = parser.parse_file(path);
+  REQUIRE(sequential != nullptr);
+  CHECK(sequential->get_timestamps().size() == 400);
+
+  for (unsigned threads : {2u, 4u, 16u}) {
+    parser.threads = threads;
+    auto parallel = parser.parse_file(path);
+    REQUIRE(parallel != nullptr);
+    CHECK(parallel->get_timestamps() == sequential->get_timestamps());
+    CHECK(*parallel == *sequential);
+  }
+
+  parser.threads = 1;
+  VCDCheckpointIndex index;
+  REQUIRE(parser.build_index(path, index, 256));
+  for (const VCDCheckpointIndex::Checkpoint& checkpoint : index.checkpoints) {
+    CHECK(checkpoint.time % 10 == 0);
+  }
+
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("Batch parsing", "[VCD]") {
+  const std::vector<std::string> paths = {
+      "../../tests/testfiles/simple.vcd",
+      "../../tests/testfiles/advanced.vcd",
+      "../../tests/testfiles/does_not_exist.vcd",
+      "../../tests/testfiles/ghdl_4_states.vcd",
+  };
+
+  VCDFileParser parser;
+  auto files = parser.parse_files(paths, 3);
+  REQUIRE(files.size() == paths.size());
+  CHECK(files[2] == nullptr);
+
+  for (std::size_t i : {0, 1, 3}) {
+    REQUIRE(files[i] != nullptr);
+    auto single = parser.parse_file(paths[i]);
+    REQUIRE(single != nullptr);
+    CHECK(*files[i] == *single);
+  }
+}
+
+TEST_CASE("Checkpoint index and windowed parsing", "[VCD]") {
+  const std::string path = "../../tests/testfiles/advanced.vcd";
+  VCDFileParser parser;
+
+  auto full = parser.parse_file(path);
+  REQUIRE(full != nullptr);
+
+  VCDCheckpointIndex built;
+  REQUIRE(parser.build_index(path, built, 64 * 1024));
+  CHECK(built.checkpoints.size() > 10);
+
+  const std::string index_path = (std::filesystem::temp_directory_path() / "advanced.vcd.idx").string();
+  REQUIRE(built.save(index_path));
+  VCDCheckpointIndex index;
+  REQUIRE(index.load(index_path));
+  std::filesystem::remove(index_path);
+  REQUIRE(index.checkpoints.size() == built.checkpoints.size());
+
+  const auto& times = full->get_timestamps();
+  parser.start_time = times[1500] + 1;
+  parser.end_time = times[1800];
+  REQUIRE(index.find(parser.start_time) != nullptr);
+
+  auto window = parser.parse_file_window(path, index);
+  REQUIRE(window != nullptr);
+  CHECK(window->get_signals().size() == full->get_signals().size());
+  REQUIRE(window->get_timestamps().size() == 1 + 300);
+  CHECK(window->get_timestamps().front() == parser.start_time);
+  CHECK(window->get_timestamps().back() == parser.end_time);
+
+  for (const VCDSignal& signal : full->get_signals()) {
+    const auto& values = window->get_signal_values(signal.hash);
+    REQUIRE_FALSE(values.empty());
+    CHECK(values.front().time == parser.start_time);
+    for (const VCDTimedValue& timed : values) {
+      CHECK(timed.value == full->get_signal_value_at(signal.hash, timed.time));
+    }
+  }
+
+  // A file of the same size written after the index is parsed from the start.
+  const std::string copy_path = (std::filesystem::temp_directory_path() / "stamped.vcd").string();
+  std::filesystem::copy_file(path, copy_path, std::filesystem::copy_options::overwrite_existing);
+  REQUIRE(parser.build_index(copy_path, index, 64 * 1024));
+  parser.collect_stats = true;
+  REQUIRE(parser.parse_file_window(copy_path, index) != nullptr);
+  const uint64_t indexed_timestamps = parser.stats.timestamps;
+
+  std::filesystem::last_write_time(copy_path, std::filesystem::last_write_time(copy_path) + std::chrono::hours(1));
+  auto stale = parser.parse_file_window(copy_path, index);
+  REQUIRE(stale != nullptr);
+  CHECK(parser.stats.timestamps > indexed_timestamps);
+  CHECK(*stale == *window);
+  std::filesystem::remove(copy_path);
+}
+
+TEST_CASE("Binary cache", "[VCD]") {
+  const auto directory = std::filesystem::temp_directory_path();
+  const std::string path = (directory / "cached.vcd").string();
+  std::filesystem::copy_file("../../tests/testfiles/advanced.vcd", path,
+                             std::filesystem::copy_options::overwrite_existing);
+  const std::string cache = VCDCache::cache_path(path);
+  std::filesystem::remove(cache);
+
+  VCDFileParser parser;
+  auto parsed = parser.parse_file(path);
+  REQUIRE(parsed != nullptr);
+
+  REQUIRE(VCDCache::save(*parsed, cache, path));
+  auto loaded = VCDCache::load(cache, path);
+  REQUIRE(loaded != nullptr);
+  CHECK(*loaded == *parsed);
+  CHECK(loaded->get_scope("testbench").children.size() == parsed->get_scope("testbench").children.size());
+
+  parser.use_cache = true;
+  auto reloaded = parser.parse_file(path);
+  REQUIRE(reloaded != nullptr);
+  CHECK(*reloaded == *parsed);
+
+  std::ofstream(path, std::ios::app) << "#999999999\n";
+  CHECK(VCDCache::load(cache, path) == nullptr);
+  auto reparsed = parser.parse_file(path);
+  REQUIRE(reparsed != nullptr);
+  CHECK(reparsed->get_timestamps().size() == parsed->get_timestamps().size() + 1);
+  CHECK(VCDCache::load(cache, path) != nullptr);
+
+  // Saving replaces the cache, a reader mapping the old one is not affected.
+  VCDMappedFile mapped;
+  REQUIRE(mapped.open(cache));
+  const std::string before(mapped.data(), mapped.size());
+  REQUIRE(VCDCache::save(*parsed, cache, path));
+  CHECK(std::string(mapped.data(), mapped.size()) == before);
+  for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+    CHECK(entry.path().filename().string().rfind("cached.vcd.cache.tmp", 0) == std::string::npos);
+  }
+
+  // A damaged column type is rejected, instead of reading past the columns.
+  const std::string real_path = (directory / "cached_real.vcd").string();
+  std::ofstream(real_path) << "$timescale 1ps $end\n$scope module top $end\n$var real 64 ! r $end\n$upscope $end\n"
+                              "$enddefinitions $end\n#0\nr0 !\n#1\nr1.5 !\n";
+  VCDFileParser real_parser;
+  auto real_file = real_parser.parse_file(real_path);
+  REQUIRE(real_file != nullptr);
+  const std::string real_cache = VCDCache::cache_path(real_path);
+  REQUIRE(VCDCache::save(*real_file, real_cache, real_path));
+  std::string bytes;
+  {
+    std::ifstream in(real_cache, std::ios::binary);
+    bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  }
+  const std::size_t column = bytes.rfind(std::string("!\x02\0\0\0", 5));
+  REQUIRE(column != std::string::npos);
+  for (char damaged : {'\x09', '\x00'}) {
+    bytes[column + 1] = damaged;
+    std::ofstream(real_cache, std::ios::binary) << bytes;
+    CHECK(VCDCache::load(real_cache, real_path) == nullptr);
+  }
+
+  std::filesystem::remove(real_cache);
+  std::filesystem::remove(real_path);
+  std::filesystem::remove(cache);
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("Compressed input", "[VCD]") {
+  VCDFileParser parser;
+  auto plain = parser.parse_file("../../tests/testfiles/advanced.vcd");
+  REQUIRE(plain != nullptr);
+
+  for (const std::string extension : {".xz", ".zst"}) {
+    const std::string path = "../../tests/testfiles/advanced.vcd" + extension;
+    const VCDCompression compression = vcd_file_compression(path);
+    CHECK(compression != VCDCompression::NONE);
+    if (!vcd_compression_supported(compression)) {
+      continue;
+    }
+
+    auto file = parser.parse_file(path);
+    REQUIRE(file != nullptr);
+    CHECK(*file == *plain);
+  }
+
+#if defined(VCD_PARSER_WITH_ZLIB)
+  const std::string path = (std::filesystem::temp_directory_path() / "advanced.vcd.gz").string();
+  std::ifstream source("../../tests/testfiles/advanced.vcd", std::ios::binary);
+  const std::string text((std::istreambuf_iterator<char>(source)), std::istreambuf_iterator<char>());
+
+  gzFile gz = gzopen(path.c_str(), "wb");
+  REQUIRE(gz != nullptr);
+  REQUIRE(gzwrite(gz, text.data(), static_cast<unsigned>(text.size())) == static_cast<int>(text.size()));
+  gzclose(gz);
+  CHECK(vcd_file_compression(path) == VCDCompression::GZIP);
+
+  parser.threads = 2;
+  auto file = parser.parse_file(path);
+  REQUIRE(file != nullptr);
+  CHECK(*file == *plain);
+
+  std::filesystem::resize_file(path, std::filesystem::file_size(path) / 2);
+  CHECK(parser.parse_file(path) == nullptr);
+  std::filesystem::remove(path);
+#endif
+}
+
+TEST_CASE("Parse statistics", "[VCD]") {
+  const std::string path = "../../tests/testfiles/advanced.vcd";
+  VCDFileParser parser;
+  parser.collect_stats = true;
+
+  auto file = parser.parse_file(path);
+  REQUIRE(file != nullptr);
+
+  const VCDParseStats& stats = parser.stats;
+  CHECK(stats.bytes == std::filesystem::file_size(path));
+  CHECK(stats.timestamps == file->get_timestamps().size());
+  CHECK(stats.tokens.size() > 5);
+  CHECK(stats.header_seconds > 0.0);
+  CHECK(stats.body_seconds > 0.0);
+
+  uint64_t stored = 0;
+  REQUIRE(stats.signal_changes.size() == file->get_signal_index_count());
+  REQUIRE(stats.signal_bytes.size() == file->get_signal_index_count());
+  for (VCDSignalIndex i = 0; i < file->get_signal_index_count(); ++i) {
+    CHECK(stats.signal_changes[i] == file->get_signal_values(i).size());
+    stored += file->get_signal_values(i).size();
+  }
+  CHECK(stats.changes() == stored);
+
+  const auto top = stats.top_signals(3);
+  REQUIRE(top.size() == 3);
+  CHECK(stats.signal_bytes[top[0]] >= stats.signal_bytes[top[1]]);
+  CHECK(stats.signal_bytes[top[1]] >= stats.signal_bytes[top[2]]);
+
+  parser.threads = 2;
+  REQUIRE(parser.parse_file(path) != nullptr);
+  CHECK(parser.stats.changes() == stored);
+  CHECK(parser.stats.timestamps == file->get_timestamps().size());
+  CHECK(parser.stats.bytes == std::filesystem::file_size(path));
+
+  parser.collect_stats = false;
+  REQUIRE(parser.parse_file(path) != nullptr);
+  CHECK(parser.stats.changes() == 0);
+}
+
+TEST_CASE("Numeric conversion", "[VCD]") {
+  VCDTime time = 0;
+  CHECK(vcd_parse_time("0", time));
+  CHECK(time == 0);
+  CHECK(vcd_parse_time("123456789012345678", time));
+  CHECK(time == 123456789012345678);
+  CHECK(vcd_parse_time("9223372036854775807", time));
+  CHECK(time == std::numeric_limits<VCDTime>::max());
+  CHECK_FALSE(vcd_parse_time("9223372036854775808", time));
+  CHECK_FALSE(vcd_parse_time("12a4", time));
+  CHECK_FALSE(vcd_parse_time("", time));
+
+  int index = 0;
+  CHECK(vcd_parse_integer("2147483647", index));
+  CHECK_FALSE(vcd_parse_integer("2147483648", index));
+  CHECK_FALSE(vcd_parse_integer("12 ", index));
+
+  VCDReal real = 0.0;
+  CHECK(vcd_parse_real("0.1", real));
+  CHECK(real == 0.1);
+  CHECK(vcd_parse_real("+2.5E+3", real));
+  CHECK(real == 2500.0);
+  CHECK(vcd_parse_real("-1.25e-300", real));
+  CHECK(real == -1.25e-300);
+  CHECK(vcd_parse_real("-inf", real));
+  CHECK(real == -std::numeric_limits<VCDReal>::infinity());
+  CHECK_FALSE(vcd_parse_real("1.5x", real));
+  CHECK_FALSE(vcd_parse_real("+", real));
+
+  VCDFileParser parser;
+  auto trace = parser.parse_file("../../tests/testfiles/numbers.vcd");
+  REQUIRE(trace != nullptr);
+  CHECK(trace->get_timestamps() == std::vector<VCDTime>{0, 4294967296, std::numeric_limits<VCDTime>::max()});
+  CHECK(trace->get_signal_value_at("!", 4294967296).get_value_real() == 0.1);
+  CHECK(trace->get_signal_value_at("!", std::numeric_limits<VCDTime>::max()).get_value_real() == -1.25e-300);
+
+  const VCDSignal& wide = trace->get_signals()[1];
+  CHECK(wide.lindex == 2147483647);
+  CHECK(wide.rindex == 2147483608);
+
+  const std::string path = (std::filesystem::temp_directory_path() / "numbers_overflow.vcd").string();
+  {
+    std::ofstream out(path);
+    out << "$timescale 1ps $end\n$scope module top $end\n$var wire 1 # clk $end\n$upscope $end\n"
+           "$enddefinitions $end\n#0\n0#\n#9223372036854775808\n1#\n";
+  }
+  CHECK(parser.parse_file(path) == nullptr);
+  std::filesystem::remove(path);
+
+  // A NaN equals itself, through the cache and the writer too.
+  const std::string nan_path = (std::filesystem::temp_directory_path() / "numbers_nan.vcd").string();
+  std::ofstream(nan_path) << "$timescale 1ps $end\n$scope module top $end\n$var real 64 ! r $end\n$upscope $end\n"
+                             "$enddefinitions $end\n#0\nr0 !\n#1\nrnan !\n#2\nr1.5 !\n";
+  auto with_nan = parser.parse_file(nan_path);
+  REQUIRE(with_nan != nullptr);
+  CHECK(std::isnan(with_nan->get_signal_value_at("!", 1).get_value_real()));
+  CHECK(*with_nan == *with_nan);
+  CHECK(*with_nan == *parser.parse_file(nan_path));
+
+  const std::string nan_cache = nan_path + ".cache";
+  REQUIRE(VCDCache::save(*with_nan, nan_cache, nan_path));
+  auto loaded = VCDCache::load(nan_cache, nan_path);
+  REQUIRE(loaded != nullptr);
+  CHECK(*loaded == *with_nan);
+
+  const std::string nan_copy = nan_path + ".copy.vcd";
+  {
+    std::ofstream out(nan_copy, std::ios::binary);
+    VCDWriter writer(out);
+    writer.keep_id_codes = true;
+    REQUIRE(writer.write(*with_nan));
+  }
+  auto rewritten = parser.parse_file(nan_copy);
+  REQUIRE(rewritten != nullptr);
+  CHECK(*rewritten == *with_nan);
+
+  std::filesystem::remove(nan_path);
+  std::filesystem::remove(nan_cache);
+  std::filesystem::remove(nan_copy);
+}
+
+TEST_CASE("Compressed timelines", "[VCD]") {
+  for (const char* name : {"advanced.vcd", "ghdl_4_states.vcd", "numbers.vcd"}) {
+    const std::string path = std::string("../../tests/testfiles/") + name;
+    VCDFileParser parser;
+    auto plain = parser.parse_file(path);
+    auto file = parser.parse_file(path);
+    REQUIRE(plain != nullptr);
+    REQUIRE(file != nullptr);
+
+    const std::size_t raw_bytes = file->values_memory_usage();
+    file->compress_timelines();
+    REQUIRE(file->timelines_compressed());
+    CHECK_THROWS_AS(file->get_signal_values(0), std::logic_error);
+    CHECK(*file == *plain);
+
+    for (VCDSignalIndex i = 0; i < plain->get_signal_index_count(); ++i) {
+      const VCDTimeline& expected = plain->get_signal_values(i);
+      const VCDCompressedTimeline& values = file->get_compressed_values(i);
+      REQUIRE(values.size() == expected.size());
+
+      std::size_t n = 0;
+      for (const VCDTimedValue& element : values) {
+        CHECK(element == expected[n]);
+        n++;
+      }
+      CHECK(n == expected.size());
+
+      const auto& times = plain->get_timestamps();
+      for (std::size_t t = 0; t < times.size(); t += std::max<std::size_t>(1, times.size() / 64)) {
+        const VCDTime time = times[t];
+        CHECK(values.find(time) == expected.find(time));
+        const VCDTime first = plain->get_timestamps().front();
+        const auto [lo, hi] = values.range(first + 1, time);
+        const auto [expected_lo, expected_hi] = expected.range(first + 1, time);
+        CHECK(lo.index() == expected_lo.index());
+        CHECK(hi.index() == expected_hi.index());
+      }
+      if (!expected.empty()) {
+        CHECK(values.back() == expected.back());
+        CHECK(file->get_signal_value_at(i, expected.back().time) == plain->get_signal_value_at(i, expected.back().time));
+      }
+    }
+
+    if (std::string(name) == "advanced.vcd") {
+      CHECK(file->values_memory_usage() * 2 < raw_bytes);
+    }
+
+    file->decompress_timelines();
+    CHECK_FALSE(file->timelines_compressed());
+    CHECK(*file == *plain);
+  }
+}
+
+TEST_CASE("Following a growing file", "[VCD]") {
+  const std::string source = "../../tests/testfiles/advanced.vcd";
+  std::ifstream in(source, std::ios::binary);
+  const std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+  VCDFileParser parser;
+  auto plain = parser.parse_file(source);
+  REQUIRE(plain != nullptr);
+
+  const std::string path = (std::filesystem::temp_directory_path() / "follow.vcd").string();
+  std::filesystem::remove(path);
+
+  VCDFileFollower follower(path);
+  CHECK(follower.update());
+  CHECK_FALSE(follower.header_parsed());
+
+  std::ofstream out(path, std::ios::binary);
+  for (std::size_t offset = 0; offset < text.size(); offset += 4093) {
+    out.write(text.data() + offset, static_cast<std::streamsize>(std::min<std::size_t>(4093, text.size() - offset)));
+    out.flush();
+    CHECK(follower.wait(std::chrono::milliseconds(1000)));
+    REQUIRE(follower.update());
+    CHECK(follower.parsed_bytes() <= offset + 4093);
+    CHECK_FALSE(follower.wait(std::chrono::milliseconds(0)));
+  }
+  CHECK(follower.header_parsed());
+  CHECK(follower.parsed_bytes() == text.size());
+  CHECK(*follower.get_file() == *plain);
+
+  std::thread writer([&out]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    out << "#100000000\n";
+    out.flush();
+  });
+  CHECK(follower.wait(std::chrono::milliseconds(10000)));
+  writer.join();
+  REQUIRE(follower.update());
+  CHECK(follower.get_file()->get_timestamps().back() == 100000000);
+
+  // A rewritten file starts over.
+  out.close();
+  out.open(path, std::ios::binary | std::ios::trunc);
+  out.write(text.data(), static_cast<std::streamsize>(text.size() / 2));
+  out.flush();
+  REQUIRE(follower.update());
+  CHECK(follower.get_file()->get_timestamps().size() < plain->get_timestamps().size());
+  CHECK(follower.parsed_bytes() <= text.size() / 2);
+
+  out.close();
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("Merging signals", "[VCD]") {
+  VCDFileParser parser;
+  auto file = parser.parse_file("../../tests/testfiles/advanced.vcd");
+  REQUIRE(file != nullptr);
+
+  std::vector<VCDSignalIndex> indices;
+  std::size_t changes = 0;
+  for (VCDSignalIndex i = 0; i < file->get_signal_index_count(); ++i) {
+    indices.push_back(i);
+    changes += file->get_signal_values(i).size();
+  }
+
+  VCDSignalMerge events(*file, indices);
+  VCDSignalMerge::Event event;
+  VCDSignalMerge::Event previous{std::numeric_limits<VCDTime>::min(), 0, 0};
+  std::size_t n = 0;
+  while (events.next(event)) {
+    CHECK((previous.time < event.time || (previous.time == event.time && previous.signal < event.signal)));
+    CHECK(events.timeline(event.signal).time_at(event.index) == event.time);
+    CHECK(events.current_index(event.signal) == event.index);
+    previous = event;
+    n++;
+  }
+  CHECK(n == changes);
+  CHECK(events.next_time() == std::numeric_limits<VCDTime>::max());
+
+  VCDSignalMerge snapshots(*file, indices);
+  VCDTime time = 0;
+  std::size_t steps = 0;
+  while (snapshots.next_snapshot(time)) {
+    CHECK(time < snapshots.next_time());
+    if (steps++ % 16 == 0) {
+      for (std::size_t k = 0; k < snapshots.size(); ++k) {
+        if (snapshots.has_value(k)) {
+          CHECK(snapshots.value(k) == file->get_signal_value_at(indices[k], time));
+        }
+      }
+    }
+  }
+  CHECK(steps > 1);
+
+  const VCDTimeline& clock = file->get_signal_values(file->get_signal_index("'"));
+  std::vector<const VCDTimeline*> sampled;
+  for (VCDSignalIndex i : indices) {
+    sampled.push_back(&file->get_signal_values(i));
+  }
+  VCDClockSampler sampler(clock, sampled);
+  std::size_t edges = 0;
+  while (sampler.next()) {
+    const VCDTime edge = sampler.time();
+    CHECK(file->get_signal_value_at(file->get_signal_index("'"), edge).get_value_bit() == VCDBit::VCD_1);
+    const VCDSignalMerge& samples = sampler.samples();
+    CHECK(samples.next_time() >= edge);
+    for (std::size_t k = 0; k < samples.size(); ++k) {
+      if (samples.has_value(k)) {
+        CHECK(samples.value(k) == file->get_signal_value_at(indices[k], edge - 1));
+      }
+    }
+    edges++;
+  }
+  CHECK(edges > 1);
+
+  VCDClockSampler any(clock, {}, VCDEdge::ANY);
+  std::size_t both = 0;
+  while (any.next()) {
+    both++;
+  }
+  CHECK(both >= 2 * edges - 1);
+}
+
+TEST_CASE("Diffing files", "[VCD]") {
+  const std::string source = "../../tests/testfiles/advanced.vcd";
+  std::ifstream in(source, std::ios::binary);
+  std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+  VCDDiff diff;
+  diff.step = 4096;
+  diff.threads = 4;
+  VCDDiffResult result;
+  REQUIRE(diff.compare(source, source, result));
+  CHECK(result.identical());
+
+  auto replace = [&text](const std::string& from, const std::string& to) {
+    const std::size_t pos = text.find(from);
+    REQUIRE(pos != std::string::npos);
+    text.replace(pos, from.size(), to);
+  };
+  replace("$var reg 1 * resetn $end", "$var reg 1 * resetn_n $end");
+  replace("#500000\n1'\n", "#500000\n1'\n1!\n");
+  replace("#505000\n0'\n", "#505000\n0'\n0!\n");
+  replace("#510000\n1'\n", "#510000\n1'\n1'\n#512000\n1'\n");
+  replace("#520000\n1'\n", "#520000\n1'\n1!\n");
+
+  const std::string path = (std::filesystem::temp_directory_path() / "diff.vcd").string();
+  std::ofstream(path, std::ios::binary) << text;
+
+  REQUIRE(diff.compare(source, path, result));
+  CHECK_FALSE(result.identical());
+  CHECK_FALSE(result.timescales_differ);
+  CHECK(result.only_left == std::vector<std::string>{"testbench.resetn"});
+  CHECK(result.only_right == std::vector<std::string>{"testbench.resetn_n"});
+  // The trap of uut is an alias of the same id code.
+  REQUIRE(result.signals.size() == 2);
+  CHECK(result.signals[0].path == "testbench.trap");
+  CHECK(result.signals[1].path == "testbench.uut.trap");
+  REQUIRE(result.signals[0].divergences.size() == 1);
+  CHECK(result.signals[0].divergences[0].time == 500000);
+  CHECK(result.signals[0].divergences[0].left.get_value_bit() == VCDBit::VCD_0);
+  CHECK(result.signals[0].divergences[0].right.get_value_bit() == VCDBit::VCD_1);
+
+  diff.all_divergences = true;
+  diff.threads = 1;
+  diff.step = 1 << 20;
+  REQUIRE(diff.compare(source, path, result));
+  REQUIRE(result.signals.size() == 2);
+  REQUIRE(result.signals[0].divergences.size() == 2);
+  CHECK(result.signals[0].divergences[1].time == 520000);
+
+  diff.early_exit = true;
+  diff.step = 4096;
+  REQUIRE(diff.compare(source, path, result));
+  CHECK(result.stopped_early);
+  REQUIRE(result.signals.size() == 2);
+  CHECK(result.signals[0].divergences.front().time == 500000);
+
+  const std::string reals = (std::filesystem::temp_directory_path() / "diff_real.vcd").string();
+  std::ofstream(reals, std::ios::binary)
+      << "$timescale 1ns $end\n$scope module top $end\n$var real 64 r value $end\n$upscope $end\n"
+         "$enddefinitions $end\n#0\nr1.5 r\n#10\nr2.0000001 r\n";
+  const std::string golden = (std::filesystem::temp_directory_path() / "diff_golden.vcd").string();
+  std::ofstream(golden, std::ios::binary)
+      << "$timescale 1ns $end\n$scope module top $end\n$var real 64 r value $end\n$upscope $end\n"
+         "$enddefinitions $end\n#0\nr1.5 r\n#10\nr2 r\n";
+
+  VCDDiff tolerant;
+  REQUIRE(tolerant.compare(golden, reals, result));
+  REQUIRE(result.signals.size() == 1);
+  CHECK(result.signals[0].divergences[0].time == 10);
+  tolerant.real_tolerance = 1e-6;
+  REQUIRE(tolerant.compare(golden, reals, result));
+  CHECK(result.identical());
+
+  std::filesystem::remove(path);
+  std::filesystem::remove(reals);
+  std::filesystem::remove(golden);
+}
+
+TEST_CASE("Hierarchical paths", "[VCD]") {
+  const std::string path = (std::filesystem::temp_directory_path() / "paths.vcd").string();
+  std::ofstream(path, std::ios::binary)
+      << "$timescale 1ns $end\n"
+         "$scope module tb $end\n"
+         "$scope module dut $end\n$scope module u_core $end\n"
+         "$var wire 32 ! pc [31:0] $end\n$var wire 1 \" pc [3] $end\n$var wire 1 # clk $end\n"
+         "$upscope $end\n$upscope $end\n"
+         "$scope module ref $end\n$scope module u_core $end\n$var wire 32 $ pc [31:0] $end\n"
+         "$upscope $end\n$upscope $end\n"
+         "$upscope $end\n$enddefinitions $end\n#0\nb1 !\n1\"\n0#\nb10 $\n";
+
+  VCDFileParser parser;
+  auto file = parser.parse_file(path);
+  REQUIRE(file != nullptr);
+
+  const VCDScope* dut = file->find_scope("tb.dut.u_core");
+  const VCDScope* ref = file->find_scope("tb.ref.u_core");
+  REQUIRE(dut != nullptr);
+  REQUIRE(ref != nullptr);
+  CHECK(dut != ref);
+  CHECK(dut->parent->name == "dut");
+  CHECK(&file->get_scope("tb.ref.u_core") == ref);
+  CHECK(&file->get_scope("u_core") == dut);
+  CHECK(file->find_scope("tb.u_core") == nullptr);
+
+  const VCDSignal* pc = file->find_signal("tb.dut.u_core.pc");
+  REQUIRE(pc != nullptr);
+  CHECK(pc->hash == "!");
+  CHECK(file->find_signal("tb.dut.u_core.pc[31:0]") == pc);
+  CHECK(file->find_signal("tb.dut.u_core.pc [31:0]") == pc);
+  REQUIRE(file->find_signal("tb.dut.u_core.pc[3]") != nullptr);
+  CHECK(file->find_signal("tb.dut.u_core.pc[3]")->hash == "\"");
+  CHECK(file->find_signal("tb.ref.u_core.pc[31:0]")->hash == "$");
+  CHECK(file->find_signal("tb.dut.u_core.pc[7:0]") == nullptr);
+  CHECK(file->find_signal("tb.dut.u_core") == nullptr);
+  CHECK(file->find_signal("tb.dut.missing") == nullptr);
+  CHECK(file->get_signal_path(*pc) == "tb.dut.u_core.pc");
+
+  const VCDPathIndex& paths = file->get_path_index();
+  CHECK(paths.find_signals("tb.dut.u_core.pc").size() == 2);
+  CHECK(paths.signals_in("tb.dut").size() == 3);
+  CHECK(paths.signals_in("tb.dut.u_co").empty());
+  CHECK(paths.signals_in("").size() == 4);
+  CHECK(paths.signals_matching("tb.*.u_core.pc").size() == 3);
+  CHECK(paths.signals_matching("*clk").size() == 1);
+
+  VCDFile copy = *file;
+  file.reset();
+  const VCDSignal* copied = copy.find_signal("tb.ref.u_core.pc");
+  REQUIRE(copied != nullptr);
+  CHECK(copied == &copy.get_signals()[3]);
+  CHECK(copied->scope == copy.find_scope("tb.ref.u_core"));
+  CHECK(copy.find_scope("tb.ref.u_core") == &copy.get_scopes()[5]);
+  CHECK(copy.get_signal_path(*copied) == "tb.ref.u_core.pc");
+  CHECK(copy.get_path_index().signals_in("tb").size() == 4);
+  CHECK(copy.root_scope == &copy.get_scopes()[0]);
+
+  VCDFileParser reader;
+  auto advanced = reader.parse_file("../../tests/testfiles/advanced.vcd");
+  REQUIRE(advanced != nullptr);
+  for (const VCDSignal& signal : advanced->get_signals()) {
+    const VCDSignal* found = advanced->find_signal(advanced->get_signal_path(signal));
+    REQUIRE(found != nullptr);
+    CHECK(found->reference == signal.reference);
+  }
+
+  std::filesystem::remove(path);
+}
+
+//! Counts the bytes allocated through it.
+class CountingResource : public std::pmr::memory_resource {
+
+public:
+  std::size_t allocated = 0;
+
+protected:
+  void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+    allocated += bytes;
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+  }
+
+  void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override {
+    std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+  }
+
+  [[nodiscard]] bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+    return this == &other;
+  }
+};
+
+TEST_CASE("Memory resources", "[VCD]") {
+  const std::string path = "../../tests/testfiles/advanced.vcd";
+  VCDFileParser plain_parser;
+  auto plain = plain_parser.parse_file(path);
+  REQUIRE(plain != nullptr);
+
+  for (unsigned threads : {1u, 4u}) {
+    VCDFileParser parser;
+    parser.threads = threads;
+    parser.use_arena = true;
+    auto file = parser.parse_file(path);
+    REQUIRE(file != nullptr);
+    CHECK(file->get_memory_resource() != std::pmr::get_default_resource());
+    CHECK(*file == *plain);
+
+    // Copies of the values do not refer to the arena.
+    const VCDTimeline copy = file->get_signal_values(0);
+    file->compress_timelines();
+    file->decompress_timelines();
+    CHECK(*file == *plain);
+
+    // Neither do copies of the file, which outlive the arena.
+    auto file_copy = std::make_unique<VCDFile>(*file);
+    CHECK(file_copy->get_memory_resource() == std::pmr::get_default_resource());
+    file.reset();
+    CHECK(copy == plain->get_signal_values(0));
+    CHECK(*file_copy == *plain);
+  }
+
+  CountingResource counting;
+  {
+    VCDFileParser parser;
+    parser.memory_resource = &counting;
+    auto file = parser.parse_file(path);
+    REQUIRE(file != nullptr);
+    CHECK(file->get_memory_resource() == &counting);
+    CHECK(*file == *plain);
+    CHECK(counting.allocated >= plain->get_signal_values(0).size() * sizeof(VCDTime));
+  }
+}
+
+TEST_CASE("Writing files", "[VCD]") {
+  const std::string path = (std::filesystem::temp_directory_path() / "written.vcd").string();
+
+  for (const char* name : {"simple.vcd", "advanced.vcd", "ghdl_4_states.vcd", "numbers.vcd"}) {
+    const std::string source = std::string("../../tests/testfiles/") + name;
+    VCDFileParser parser;
+    auto file = parser.parse_file(source);
+    REQUIRE(file != nullptr);
+
+    {
+      std::ofstream out(path, std::ios::binary);
+      VCDWriter writer(out, 4096);
+      writer.keep_id_codes = true;
+      REQUIRE(writer.write(*file));
+    }
+    auto written = parser.parse_file(path);
+    REQUIRE(written != nullptr);
+    CHECK(*written == *file);
+
+    // Written while parsing.
+    {
+      std::ofstream out(path, std::ios::binary);
+      VCDWriter writer(out);
+      writer.keep_id_codes = true;
+      REQUIRE(parser.parse_file(source, writer));
+    }
+    written = parser.parse_file(path);
+    REQUIRE(written != nullptr);
+    CHECK(*written == *file);
+
+    // New id codes, from compressed timelines.
+    file->compress_timelines();
+    {
+      std::ofstream out(path, std::ios::binary);
+      VCDWriter writer(out);
+      REQUIRE(writer.write(*file));
+    }
+    written = parser.parse_file(path);
+    REQUIRE(written != nullptr);
+    CHECK(written->get_signal_index_count() == file->get_signal_index_count());
+    CHECK(written->get_signals().front().hash == "!");
+    VCDDiff diff;
+    VCDDiffResult result;
+    REQUIRE(diff.compare(source, path, result));
+    CHECK(result.identical());
+  }
+
+  // A slice of some signals.
+  const std::string source = "../../tests/testfiles/advanced.vcd";
+  VCDFileParser parser;
+  auto file = parser.parse_file(source);
+  REQUIRE(file != nullptr);
+
+  VCDSignalSelection selection;
+  selection.add_scope("testbench.uut");
+  selection.add_path("testbench.clk");
+  for (bool streamed : {false, true}) {
+    {
+      std::ofstream out(path, std::ios::binary);
+      VCDWriter writer(out, 256);
+      writer.selection = selection;
+      writer.start_time = 502500;
+      writer.end_time = 600000;
+      if (streamed) {
+        REQUIRE(parser.parse_file(source, writer));
+      } else {
+        REQUIRE(writer.write(*file));
+      }
+    }
+    auto slice = parser.parse_file(path);
+    REQUIRE(slice != nullptr);
+    CHECK(slice->get_timestamps().front() == 502500);
+    CHECK(slice->get_timestamps().back() <= 600000);
+    REQUIRE(slice->find_signal("testbench.clk") != nullptr);
+    CHECK(slice->find_signal("testbench.trap") == nullptr);
+    CHECK(slice->find_scope("testbench.uut") != nullptr);
+
+    std::size_t compared = 0;
+    for (const VCDSignal& signal : slice->get_signals()) {
+      const VCDSignal* original = file->find_signal(slice->get_signal_path(signal) + (signal.lindex == -1 ? "" :
+          " [" + std::to_string(signal.lindex) + (signal.rindex == -1 ? "" : ":" + std::to_string(signal.rindex)) + "]"));
+      REQUIRE(original != nullptr);
+      for (VCDTime t : {VCDTime(502500), VCDTime(505000), VCDTime(550000), VCDTime(600000)}) {
+        CHECK(slice->get_signal_value_at(signal.hash, t) == file->get_signal_value_at(original->hash, t));
+        compared++;
+      }
+    }
+    CHECK(compared > 4);
+  }
+
+  std::filesystem::remove(path);
+}
+
+//! Read the header and data of a .npy file.
+static bool read_npy(const std::string& path, std::string& header, std::string& data) {
+  std::ifstream in(path, std::ios::binary);
+  const std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  if (text.size() < 10 || text.compare(0, 6, "\x93NUMPY") != 0) {
+    return false;
+  }
+  const std::size_t length = static_cast<unsigned char>(text[8]) | static_cast<unsigned char>(text[9]) << 8;
+  header = text.substr(10, length);
+  data = text.substr(10 + length);
+  return (10 + length) % 64 == 0;
+}
+
+template <typename T>
+static std::vector<T> npy_values(const std::string& data) {
+  std::vector<T> values(data.size() / sizeof(T));
+  std::memcpy(values.data(), data.data(), values.size() * sizeof(T));
+  return values;
+}
+
+TEST_CASE("Exporting arrays", "[VCD]") {
+  const std::string directory = (std::filesystem::temp_directory_path() / "vcd_arrays").string();
+  std::filesystem::remove_all(directory);
+
+  VCDFileParser parser;
+  auto numbers = parser.parse_file("../../tests/testfiles/numbers.vcd");
+  REQUIRE(numbers != nullptr);
+
+  VCDArrayExporter exporter;
+  exporter.threads = 2;
+  REQUIRE(exporter.write_npy(*numbers, directory));
+  CHECK(exporter.get_arrays().size() == 7);
+
+  std::string header;
+  std::string data;
+  REQUIRE(read_npy(directory + "/top.r.times.npy", header, data));
+  CHECK(header.find("'shape': (3,)") != std::string::npos);
+  CHECK(npy_values<int64_t>(data) == std::vector<int64_t>{0, 4294967296, std::numeric_limits<int64_t>::max()});
+  REQUIRE(read_npy(directory + "/top.r.values.npy", header, data));
+  CHECK(header.find("f8'") != std::string::npos);
+  CHECK(npy_values<double>(data) == std::vector<double>{0, 0.1, -1.25e-300});
+  REQUIRE(read_npy(directory + "/top.wide[2147483647_2147483608].values.npy", header, data));
+  CHECK(npy_values<uint64_t>(data) == std::vector<uint64_t>{0, 1});
+  REQUIRE(read_npy(directory + "/top.wide[2147483647_2147483608].unknown.npy", header, data));
+  CHECK(npy_values<uint64_t>(data) == std::vector<uint64_t>{0, 0});
+  REQUIRE(read_npy(directory + "/top.clk.values.npy", header, data));
+  CHECK(header.find("'|u1'") != std::string::npos);
+  CHECK(npy_values<uint8_t>(data) == std::vector<uint8_t>{0, 1, 0});
+
+  // Sampled on a grid, into one file.
+  auto file = parser.parse_file("../../tests/testfiles/advanced.vcd");
+  REQUIRE(file != nullptr);
+  const std::string path = directory + "/advanced.bin";
+  for (VCDExportGrid grid : {VCDExportGrid::TIMESTAMPS, VCDExportGrid::UNIFORM}) {
+    VCDArrayExporter sampler;
+    sampler.grid = grid;
+    sampler.grid_start = 1000;
+    sampler.grid_step = 2500;
+    sampler.selection.add_path("testbench.clk");
+    sampler.selection.add_path("testbench.mem_addr");
+    REQUIRE(sampler.write_columns(*file, path));
+    REQUIRE(sampler.get_arrays().size() == 3);
+
+    std::ifstream in(path, std::ios::binary);
+    const std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    REQUIRE(text.compare(0, 8, "VCDARRAY") == 0);
+    uint64_t header_size = 0;
+    std::memcpy(&header_size, text.data() + 8, 8);
+    const std::string listing = text.substr(16, header_size);
+    CHECK(listing.compare(0, 6, "times\t") == 0);
+    CHECK(listing.find("testbench.mem_addr[31:0].unknown\t") != std::string::npos);
+
+    const std::vector<VCDTime>& times = sampler.get_grid();
+    REQUIRE(!times.empty());
+    if (grid == VCDExportGrid::UNIFORM) {
+      CHECK(times.front() == 1000);
+      CHECK(times.back() <= file->get_timestamps().back());
+      CHECK(times.back() + 2500 > file->get_timestamps().back());
+    } else {
+      std::vector<VCDTime> distinct = file->get_timestamps();
+      distinct.erase(std::unique(distinct.begin(), distinct.end()), distinct.end());
+      CHECK(times == distinct);
+    }
+    std::vector<VCDTime> stored(times.size());
+    std::memcpy(stored.data(), text.data() + (16 + header_size + 63) / 64 * 64, stored.size() * sizeof(VCDTime));
+    CHECK(stored == times);
+
+    // In declaration order, mem_addr before clk.
+    const auto& arrays = sampler.get_arrays();
+    CHECK(arrays[0].name == "testbench.mem_addr[31:0].values");
+    CHECK(arrays[2].name == "testbench.clk.values");
+    CHECK(arrays[2].rows == times.size());
+    CHECK(arrays[2].offset % 64 == 0);
+    for (std::size_t i = 0; i < times.size(); i += 97) {
+      const VCDValue clk = file->get_signal_value_at("'", times[i]);
+      CHECK(static_cast<VCDBit>(text[arrays[2].offset + i]) == clk.get_value_bit());
+
+      uint64_t value = 0;
+      uint64_t unknown = 0;
+      std::memcpy(&value, text.data() + arrays[0].offset + 8 * i, 8);
+      std::memcpy(&unknown, text.data() + arrays[1].offset + 8 * i, 8);
+      const VCDPackedVector addr = file->get_signal_value_at("&", times[i]).get_value_packed();
+      CHECK(value == addr.value_words()[0]);
+      CHECK(unknown == addr.unknown_words()[0]);
+    }
+  }
+
+  exporter.grid = VCDExportGrid::UNIFORM;
+  exporter.grid_step = 0;
+  CHECK_FALSE(exporter.write_columns(*numbers, path));
+
+  std::filesystem::remove_all(directory);
+}
+
+TEST_CASE("Switching activity", "[VCD]") {
+  const std::string path = (std::filesystem::temp_directory_path() / "activity.vcd").string();
+  std::ofstream(path, std::ios::binary)
+      << "$timescale 1ns $end\n$scope module top $end\n"
+         "$var wire 1 ! clk $end\n$var wire 4 \" bus [3:0] $end\n"
+         "$scope module sub $end\n$var real 64 # r $end\n$var wire 1 $ en $end\n$var wire 1 ! clk $end\n"
+         "$upscope $end\n$upscope $end\n$enddefinitions $end\n"
+         "#0\n$dumpvars\n0!\nbx \"\nr0 #\nz$\n$end\n"
+         "#10\n1!\nb0101 \"\n"
+         "#20\n0!\nb1 \"\n1$\n"
+         "#30\n1!\nbx0 \"\nr1.5 #\n"
+         "#40\n";
+
+  VCDFileBuilder builder;
+  VCDActivityCounter counter(&builder);
+  counter.per_bit = true;
+  VCDFileParser parser;
+  REQUIRE(parser.parse_file(path, counter));
+  CHECK(counter.end_time() == 40);
+  CHECK(*builder.get_file() == *parser.parse_file(path));
+
+  const VCDActivity& clk = counter.get_activity(0);
+  CHECK(clk.changes == 4);
+  CHECK(clk.toggles == 3);
+  CHECK(clk.time_1 == 20);
+  CHECK(clk.observed == 40);
+  CHECK(clk.duty_cycle() == 0.5);
+  CHECK(clk.bit_toggles.empty());
+
+  const VCDActivity& bus = counter.get_activity(1);
+  CHECK(bus.changes == 4);
+  CHECK(bus.toggles == 2);
+  CHECK(bus.bit_toggles == std::vector<uint64_t>{1, 0, 1, 0});
+  CHECK(bus.time_1 == 30);
+  CHECK(bus.time_xz == 70);
+  CHECK(bus.observed == 160);
+
+  const VCDActivity& real = counter.get_activity(2);
+  CHECK(real.changes == 2);
+  CHECK(real.width == 0);
+  CHECK(real.observed == 0);
+
+  const VCDActivity& en = counter.get_activity(3);
+  CHECK(en.toggles == 0);
+  CHECK(en.time_1 == 20);
+  CHECK(en.xz_fraction() == 0.5);
+
+  // The alias of clk in sub counts for sub, and once for top.
+  const VCDActivity sub = counter.subtree("top.sub");
+  CHECK(sub.changes == 8);
+  CHECK(sub.time_1 == 40);
+  CHECK(sub.observed == 80);
+  const VCDActivity top = counter.subtree("top");
+  CHECK(top.changes == 12);
+  CHECK(top.toggles == 5);
+  CHECK(top.time_1 == 70);
+  CHECK(top.time_xz == 90);
+  CHECK(top.observed == 240);
+  CHECK(counter.subtree("").changes == 12);
+  CHECK(counter.subtree("to").changes == 0);
+
+  const auto scopes = counter.per_scope();
+  REQUIRE(scopes.size() == 2);
+  CHECK(scopes.at("top").changes == top.changes);
+  CHECK(scopes.at("top").observed == top.observed);
+  CHECK(scopes.at("top.sub").time_1 == sub.time_1);
+
+  // Against the timelines of a parsed file, with only the clock selected.
+  auto file = parser.parse_file("../../tests/testfiles/advanced.vcd");
+  REQUIRE(file != nullptr);
+  const VCDTimeline& clock = file->get_signal_values(file->find_signal("testbench.clk")->index);
+  uint64_t toggles = 0;
+  for (std::size_t i = 1; i < clock.size(); ++i) {
+    const VCDBit a = clock.scalar_at(i - 1);
+    const VCDBit b = clock.scalar_at(i);
+    toggles += a != b && a != VCDBit::VCD_X && a != VCDBit::VCD_Z && b != VCDBit::VCD_X && b != VCDBit::VCD_Z;
+  }
+  VCDActivityCounter streamed;
+  VCDFileParser selecting;
+  selecting.selection.add_path("testbench.clk");
+  REQUIRE(selecting.parse_file("../../tests/testfiles/advanced.vcd", streamed));
+  const VCDActivity& counted = streamed.get_activity(file->find_signal("testbench.clk")->index);
+  CHECK(counted.changes == clock.size());
+  CHECK(counted.toggles == toggles);
+  CHECK(counted.observed == static_cast<uint64_t>(file->get_timestamps().back() - clock.time_at(0)));
+  // Only the clock, which uut sees through an alias, has changes.
+  CHECK(streamed.subtree("testbench.uut").changes == counted.changes);
+  CHECK(streamed.subtree("").changes == counted.changes);
+
+  std::filesystem::remove(path);
+}
+
+TEST_CASE("Lazy loading", "[VCD]") {
+  VCDFileParser parser;
+  for (const char* name : {"simple.vcd", "advanced.vcd", "ghdl_4_states.vcd", "numbers.vcd"}) {
+    const std::string path = std::string("../../tests/testfiles/") + name;
+    const auto file = parser.parse_file(path);
+    REQUIRE(file != nullptr);
+
+    VCDLazyFile lazy;
+    REQUIRE(lazy.open(path));
+    CHECK(lazy.is_lazy());
+    CHECK(lazy.get_file()->get_timestamps() == file->get_timestamps());
+    CHECK(lazy.get_file()->get_signals().size() == file->get_signals().size());
+    REQUIRE(lazy.get_file()->get_signal_index_count() == file->get_signal_index_count());
+    CHECK(lazy.cached_bytes() == 0);
+    for (VCDSignalIndex i = 0; i < file->get_signal_index_count(); ++i) {
+      const auto values = lazy.get_signal_values(i);
+      REQUIRE(values != nullptr);
+      CHECK(*values == file->get_signal_values(i));
+      CHECK(lazy.get_signal_values(i) == values);
+    }
+  }
+
+  const std::string path = (std::filesystem::temp_directory_path() / "lazy.vcd").string();
+  std::ofstream(path, std::ios::binary)
+      << "$timescale 1ns $end\n$scope module top $end\n"
+         "$var wire 1 ! clk $end\n$var wire 4 \" bus [3:0] $end\n$var real 64 # r $end\n"
+         "$upscope $end\n$enddefinitions $end\n"
+         "$dumpvars\n0!\nbx \"\nr0 #\n$end\n"
+         "#10\n1!\nb0101 \"\n"
+         "#20\n0!\nb1 \"\nb10 \"\n"
+         "#30\n1!\nr1.5 #\n1%\n"
+         "#40\n0!\n";
+
+  const auto file = parser.parse_file(path);
+  REQUIRE(file != nullptr);
+  VCDLazyFile lazy;
+  REQUIRE(lazy.open(path));
+  REQUIRE(lazy.get_file()->get_signal_index_count() == 4);
+  CHECK(lazy.get_file()->get_timestamps() == file->get_timestamps());
+  for (VCDSignalIndex i = 0; i < 4; ++i) {
+    CHECK(*lazy.get_signal_values(i) == file->get_signal_values(i));
+  }
+  CHECK(lazy.get_signal_values("!")->size() == 5);
+  CHECK(lazy.get_signal_values("\"")->size() == 4);
+  CHECK(lazy.get_signal_values("?") == nullptr);
+
+  // Only the values read last stay cached.
+  lazy.cache_bytes = 0;
+  const auto clock = lazy.get_signal_values(0);
+  CHECK(lazy.cached_bytes() == clock->memory_usage());
+  const auto bus = lazy.get_signal_values(1);
+  CHECK(lazy.cached_bytes() == bus->memory_usage());
+  CHECK(clock->size() == 5);
+  CHECK(lazy.get_signal_values(0) != clock);
+
+  // The settings of the parser apply.
+  VCDFileParser window;
+  window.start_time = 10;
+  window.end_time = 30;
+  window.selection.add_path("top.bus");
+  const auto windowed = window.parse_file(path);
+  REQUIRE(windowed != nullptr);
+  VCDLazyFile lazy_window(window);
+  REQUIRE(lazy_window.open(path));
+  CHECK(lazy_window.get_file()->get_timestamps() == windowed->get_timestamps());
+  for (VCDSignalIndex i = 0; i < windowed->get_signal_index_count(); ++i) {
+    CHECK(*lazy_window.get_signal_values(i) == windowed->get_signal_values(i));
+  }
+  CHECK(lazy_window.get_signal_values(1)->size() == 2);
+  CHECK(lazy_window.get_signal_values(0)->empty());
+
+  // Compressed files are parsed entirely.
+  VCDLazyFile compressed;
+  if (compressed.open("../../tests/testfiles/advanced.vcd.zst")) {
+    CHECK_FALSE(compressed.is_lazy());
+    CHECK(compressed.get_signal_values(0)->size() ==
+          parser.parse_file("../../tests/testfiles/advanced.vcd")->get_signal_values(0).size());
+  }
+
+  // Invalid values are reported by whichever thread decodes them.
+  std::ofstream(path, std::ios::binary)
+      << "$scope module top $end\n$var real 64 ! r $end\n$var wire 1 \" clk $end\n$upscope $end\n"
+         "$enddefinitions $end\n#0\nr1.5 !\n0\"\n#10\nrnope !\n1\"\n";
+  VCDLazyFile invalid;
+  REQUIRE(invalid.open(path));
+  std::vector<std::thread> readers;
+  std::atomic<int> decoded{0};
+  for (int t = 0; t < 4; ++t) {
+    readers.emplace_back([&] {
+      decoded += invalid.get_signal_values("!") == nullptr ? 0 : 1;
+      decoded += invalid.get_signal_values("\"") == nullptr ? 0 : 1;
+    });
+  }
+  for (std::thread& reader : readers) {
+    reader.join();
+  }
+  CHECK(decoded == 4);
+
+  std::filesystem::remove(path);
+}